@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <iterator>
+
+#include "ack_coalescer.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+AckCoalescer::AckCoalescer( const unsigned int ack_every, const uint64_t ack_delay )
+  : ack_every_( ack_every < CoalescedAck::MAX_DATAGRAMS ? ack_every : CoalescedAck::MAX_DATAGRAMS ),
+    ack_delay_( ack_delay ),
+    received_(),
+    next_expected_( 0 ),
+    flow_id_( 0 ),
+    received_bytes_( 0 ),
+    waiting_bytes_( 0 ),
+    ack_(),
+    deadline_( 0 ),
+    due_( false )
+{}
+
+/* Add a sequence number to what has arrived, merging it into its
+   neighbours (and moving the cumulative ack up past it if it can) */
+void AckCoalescer::record( const uint64_t sequence_number )
+{
+  uint64_t & cumulative_ack = ack_.cumulative_ack;
+
+  if ( sequence_number < cumulative_ack ) {
+    return;
+  }
+
+  if ( sequence_number == cumulative_ack ) {
+    cumulative_ack++;
+    if ( not received_.empty() and received_.begin()->first == cumulative_ack ) {
+      cumulative_ack = received_.begin()->second;
+      received_.erase( received_.begin() );
+    }
+    return;
+  }
+
+  auto next = received_.upper_bound( sequence_number );
+  if ( next != received_.begin() ) {
+    const auto previous = prev( next );
+    if ( previous->second > sequence_number ) {
+      return; /* (already here) */
+    }
+
+    if ( previous->second == sequence_number ) {
+      previous->second++;
+      if ( next != received_.end() and next->first == previous->second ) {
+	previous->second = next->second;
+	received_.erase( next );
+      }
+      return;
+    }
+  }
+
+  if ( next != received_.end() and next->first == sequence_number + 1 ) {
+    received_[ sequence_number ] = next->second;
+    received_.erase( next );
+  } else {
+    received_[ sequence_number ] = sequence_number + 1;
+  }
+
+  /* too many holes: stop waiting for the oldest (and say where it ends,
+     for the sender not to take what was in it as having arrived) */
+  if ( received_.size() > MAX_TRACKED_RANGES ) {
+    ack_.holes_below = received_.begin()->first;
+    cumulative_ack = received_.begin()->second;
+    received_.erase( received_.begin() );
+  }
+}
+
+bool AckCoalescer::received( const ContestMessageView & datagram, const uint64_t recv_timestamp )
+{
+  const uint64_t sequence_number = datagram.sequence_number();
+  flow_id_ = datagram.flow_id();
+
+  /* out of order (a new hole, or something arriving late): ack right away */
+  if ( sequence_number != next_expected_ ) {
+    due_ = true;
+  }
+  next_expected_ = max( next_expected_, sequence_number + 1 );
+
+  record( sequence_number );
+
+  if ( ack_.datagrams.empty() ) {
+    deadline_ = recv_timestamp + ack_delay_;
+  }
+
+  ack_.datagrams.push_back( { sequence_number, datagram.send_timestamp(), recv_timestamp,
+			      datagram.payload_length(), datagram.delivered(),
+			      datagram.delivered_time() } );
+
+  if ( ack_.datagrams.size() >= ack_every_ ) {
+    due_ = true;
+  }
+
+  /* Each datagram says how much the sender knew to be delivered when it
+     sent it, so what has arrived beyond that was what it had in flight
+     (less any losses). If all of that is waiting here, the sender's
+     window is too small to reach ack_every: it can send nothing more
+     until it hears from us, so holding the ack would only stall it. */
+  received_bytes_ += datagram.payload_length();
+  waiting_bytes_ += datagram.payload_length();
+  const uint64_t in_flight = received_bytes_ - min( received_bytes_, datagram.delivered() );
+  if ( waiting_bytes_ >= in_flight ) {
+    due_ = true;
+  }
+
+  return due_;
+}
+
+PacketBuffer AckCoalescer::make_ack( const uint64_t sequence_number, PacketPool & pool )
+{
+  /* the header acks the newest datagram, as a single ack would */
+  const AckedDatagram & newest = ack_.datagrams.back();
+  ContestMessage::Header header( sequence_number, newest.delivered, newest.delivered_time, flow_id_ );
+  header.set_send_timestamp();
+  header.ack_sequence_number = newest.sequence_number;
+  header.ack_send_timestamp = newest.send_timestamp;
+  header.ack_recv_timestamp = newest.recv_timestamp;
+  header.ack_payload_length = newest.payload_length;
+
+  /* the lowest blocks above the cumulative ack (where a hole matters most) */
+  ack_.ranges.clear();
+  for ( const auto & range : received_ ) {
+    if ( ack_.ranges.size() == CoalescedAck::MAX_RANGES ) {
+      break;
+    }
+    ack_.ranges.push_back( { range.first, range.second } );
+  }
+
+  PacketBuffer ret = pool.acquire();
+  header.serialize( ret );
+  ack_.serialize( ret );
+
+  ack_.datagrams.clear();
+  waiting_bytes_ = 0;
+  due_ = false;
+  return ret;
+}
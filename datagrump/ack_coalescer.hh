@@ -0,0 +1,62 @@
+#ifndef ACK_COALESCER_HH
+#define ACK_COALESCER_HH
+
+#include <cstdint>
+#include <map>
+
+#include "contest_message.hh"
+
+/* The receiver's side of delayed, cumulative acks for one sender's flow:
+   remembers which sequence numbers have arrived and which datagrams
+   are waiting to be acknowledged, and says when an ack is due (after
+   ack_every datagrams, ack_delay microseconds after the oldest one
+   arrived, or right away when one arrives out of order or when the
+   sender can't have sent more until it hears an ack) */
+class AckCoalescer
+{
+private:
+  /* Most holes to keep track of before giving up on the oldest */
+  static const size_t MAX_TRACKED_RANGES = 32;
+
+  unsigned int ack_every_;
+  uint64_t ack_delay_;
+
+  /* Sequence numbers that have arrived above ack_.cumulative_ack (begin -> end) */
+  std::map<uint64_t, uint64_t> received_;
+
+  /* The sequence number after the highest one that has arrived
+     (any other is out of order) */
+  uint64_t next_expected_;
+
+  /* The sender's flow (echoed in each ack) */
+  uint64_t flow_id_;
+
+  /* Payload bytes of every datagram that has arrived, and of those waiting */
+  uint64_t received_bytes_;
+  uint64_t waiting_bytes_;
+
+  /* The next ack, with the datagrams it will acknowledge */
+  CoalescedAck ack_;
+
+  uint64_t deadline_; /* when the ack is due by the timer */
+  bool due_; /* the ack is due now */
+
+  void record( const uint64_t sequence_number );
+
+public:
+  AckCoalescer( const unsigned int ack_every, const uint64_t ack_delay );
+
+  /* A datagram arrived (returns true if an ack is now due) */
+  bool received( const ContestMessageView & datagram, const uint64_t recv_timestamp );
+
+  /* Are there datagrams waiting to be acknowledged, and until when? */
+  bool pending() const { return not ack_.datagrams.empty(); }
+  uint64_t deadline() const { return deadline_; }
+
+  /* Make the ack of everything waiting (stamped with this ack's own
+     sequence number, and sent now) in a buffer from pool, and forget
+     the datagrams */
+  PacketBuffer make_ack( const uint64_t sequence_number, PacketPool & pool );
+};
+
+#endif /* ACK_COALESCER_HH */
@@ -0,0 +1,99 @@
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+#include "application_input.hh"
+#include "util.hh"
+
+using namespace std;
+
+ApplicationInput::ApplicationInput( const int fd )
+  : input_( SystemCall( "dup", dup( fd ) ) ),
+    wakeup_( SystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) ),
+    stop_( SystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) ),
+    mutex_(), room_(), buffer_(), eof_( false ), stopping_( false ),
+    reader_( [this] () {
+	try {
+	  read_loop();
+	} catch ( const exception & e ) {
+	  print_exception( e );
+	  exit( EXIT_FAILURE );
+	}
+      } )
+{}
+
+ApplicationInput::~ApplicationInput()
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    stopping_ = true;
+  }
+  room_.notify_one();
+
+  /* (in case it's waiting for input) */
+  const uint64_t one = 1;
+  SystemCall( "write", ::write( stop_.fd_num(), &one, sizeof( one ) ) );
+
+  reader_.join();
+}
+
+/* tell the sender there's news */
+void ApplicationInput::wake()
+{
+  const uint64_t one = 1;
+  SystemCall( "write", ::write( wakeup_.fd_num(), &one, sizeof( one ) ) );
+}
+
+void ApplicationInput::read_loop()
+{
+  while ( true ) {
+    /* wait for room */
+    size_t room;
+    {
+      unique_lock<mutex> lock( mutex_ );
+      room_.wait( lock, [&] () { return stopping_ or buffer_.size() < BUFFER_SIZE; } );
+      if ( stopping_ ) {
+	return;
+      }
+      room = BUFFER_SIZE - buffer_.size();
+    }
+
+    /* wait for input (so as not to block in read() for good) */
+    pollfd fds[] = { { input_.fd_num(), POLLIN, 0 }, { stop_.fd_num(), POLLIN, 0 } };
+    SystemCall( "poll", ::poll( fds, 2, -1 ) );
+    if ( fds[ 1 ].revents ) {
+      return;
+    }
+
+    const string data = input_.read( room );
+
+    {
+      unique_lock<mutex> lock( mutex_ );
+      buffer_ += data;
+      eof_ = input_.eof();
+    }
+    wake();
+
+    if ( input_.eof() ) {
+      return;
+    }
+  }
+}
+
+void ApplicationInput::take( string & data )
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    data += buffer_;
+    buffer_.clear();
+  }
+  room_.notify_one();
+}
+
+bool ApplicationInput::finished()
+{
+  unique_lock<mutex> lock( mutex_ );
+  return eof_ and buffer_.empty();
+}
@@ -0,0 +1,58 @@
+#ifndef APPLICATION_INPUT_HH
+#define APPLICATION_INPUT_HH
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "file_descriptor.hh"
+
+/* The application's data for the sender, read from a file descriptor
+   (standard input, say) as it comes. Reading happens on a thread of its
+   own, so that neither a slow writer nor the hang-up of a pipe (which
+   ends a Poller's loop) holds up the sender; wakeup() becomes readable
+   whenever there is more data, or the end of it. */
+class ApplicationInput
+{
+private:
+  /* Most data to read ahead of the sender taking it */
+  static const size_t BUFFER_SIZE = 1 << 20;
+
+  FileDescriptor input_;
+  FileDescriptor wakeup_; /* an eventfd */
+  FileDescriptor stop_; /* an eventfd: readable once the reader should stop */
+
+  std::mutex mutex_;
+  std::condition_variable room_; /* the sender took data (or is going away) */
+  std::string buffer_; /* read, and not yet taken */
+  bool eof_;
+  bool stopping_;
+
+  std::thread reader_;
+
+  void read_loop();
+  void wake();
+
+public:
+  /* Start reading (from a duplicate of fd) */
+  explicit ApplicationInput( const int fd );
+
+  /* Readable when there's news (read it before taking the data) */
+  FileDescriptor & wakeup() { return wakeup_; }
+
+  /* Append everything read so far to data */
+  void take( std::string & data );
+
+  /* Has all the data been read and taken? */
+  bool finished();
+
+  /* Stop the reader (even if its input has nothing more to say) and wait for it */
+  ~ApplicationInput();
+
+  /* forbid copying or assigning */
+  ApplicationInput( const ApplicationInput & other ) = delete;
+  const ApplicationInput & operator=( const ApplicationInput & other ) = delete;
+};
+
+#endif /* APPLICATION_INPUT_HH */
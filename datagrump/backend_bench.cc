@@ -0,0 +1,147 @@
+/* compare the poll, epoll and io_uring engines on loopback:
+   a sender keeps a window of contest-sized datagrams in flight
+   to a receiver that acks each one, all on one event loop
+   (and poll again, with UDP segmentation and receive offload) */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "socket.hh"
+#include "poller.hh"
+#include "contest_message.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* datagrams kept in flight */
+static const size_t WINDOW = 64;
+
+/* CPU time (user + system) used so far by this process, in nanoseconds */
+static uint64_t cpu_ns()
+{
+  rusage usage;
+  SystemCall( "getrusage", getrusage( RUSAGE_SELF, &usage ) );
+  return ( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1000000000ULL
+    + ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1000ULL;
+}
+
+static void run( const Poller::Backend requested, const bool offload, const uint64_t duration_ms )
+{
+  Poller poller( requested );
+
+  UDPSocket sender, receiver;
+  receiver.bind( Address( "::1", 0 ) );
+  sender.bind( Address( "::1", 0 ) );
+  sender.connect( receiver.local_address() );
+
+  if ( poller.backend() == Poller::Backend::IoUring ) {
+    sender.enable_io_uring();
+    receiver.enable_io_uring();
+  }
+
+  /* datagrams both ways go out, and come in, a run at a time */
+  const bool offloaded = offload
+    and sender.enable_gso() and sender.enable_gro()
+    and receiver.enable_gso() and receiver.enable_gro();
+
+  const string payload( 1424, 'x' );
+  vector<char> headers( WINDOW * ContestMessage::Header::SIZE );
+  vector<UDPSocket::gathered_datagram> outgoing;
+  vector<UDPSocket::gathered_datagram> acks;
+
+  uint64_t sequence_number = 0, acked = 0, delivered = 0;
+
+  /* sender: fill the window */
+  poller.add_action( Action( sender, Direction::Out, [&] () {
+	outgoing.clear();
+	while ( sequence_number - acked < WINDOW ) {
+	  ContestMessage::Header header( sequence_number++, 0, 0 );
+	  header.set_send_timestamp();
+	  char * const buffer = &headers[ outgoing.size() * ContestMessage::Header::SIZE ];
+	  header.serialize( buffer );
+	  outgoing.push_back( { buffer, ContestMessage::Header::SIZE,
+				payload.data(), payload.size(), nullptr } );
+	}
+	sender.send_batch( outgoing );
+	return ResultType::Continue;
+      },
+      [&] () { return sequence_number - acked < WINDOW; } ) );
+
+  /* receiver: ack every datagram in place */
+  poller.add_action( Action( receiver.receive_event_fd(), Direction::In, [&] () {
+	auto batch = receiver.recv_batch( WINDOW );
+	acks.clear();
+	for ( auto & recd : batch ) {
+	  char * const datagram = &recd.payload[ 0 ];
+	  ContestMessage::transform_into_ack_in_place( datagram, recd.payload.size(),
+						       delivered++, recd.timestamp );
+	  acks.push_back( { datagram, ContestMessage::Header::SIZE,
+			    nullptr, 0, &recd.source_address } );
+	}
+	receiver.send_batch( acks );
+	return ResultType::Continue;
+      } ) );
+
+  /* sender: collect acks (treating any loss as an ack, to keep going) */
+  poller.add_action( Action( sender.receive_event_fd(), Direction::In, [&] () {
+	for ( const auto & recd : sender.recv_batch( WINDOW ) ) {
+	  const ContestMessageView ack( recd.payload.data(), recd.payload.size() );
+	  acked = max( acked, ack.ack_sequence_number() + 1 );
+	}
+	return ResultType::Continue;
+      } ) );
+
+  const uint64_t start_ms = timestamp_ms();
+  const uint64_t start_cpu = cpu_ns();
+
+  while ( timestamp_ms() - start_ms < duration_ms ) {
+    const auto ret = poller.poll( 100 );
+    if ( ret.result == PollResult::Exit ) {
+      throw runtime_error( "poller exited early" );
+    } else if ( ret.result == PollResult::Timeout ) {
+      /* datagrams were lost, so reopen the window */
+      acked = sequence_number;
+    }
+  }
+
+  const uint64_t elapsed_ms = timestamp_ms() - start_ms;
+  const uint64_t cpu = cpu_ns() - start_cpu;
+
+  cout << Poller::backend_name( requested );
+  if ( offload ) {
+    cout << ( offloaded ? " + GSO/GRO" : " (GSO/GRO unsupported)" );
+  }
+  if ( poller.backend() != requested ) {
+    cout << " (unsupported, ran " << Poller::backend_name( poller.backend() ) << ")";
+  }
+  cout << ": " << delivered * 1000 / max( elapsed_ms, uint64_t( 1 ) ) << " datagrams/s, "
+       << cpu / max( delivered, uint64_t( 1 ) ) << " ns CPU per datagram (send + ack + receive ack)"
+       << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc > 2 ) {
+    cerr << "Usage: " << argv[ 0 ] << " [SECONDS]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  const uint64_t duration_ms = 1000 * ( argc == 2 ? atoi( argv[ 1 ] ) : 3 );
+
+  for ( const auto backend : { Poller::Backend::Poll, Poller::Backend::Epoll, Poller::Backend::IoUring } ) {
+    run( backend, false, duration_ms );
+  }
+  run( Poller::Backend::Poll, true, duration_ms );
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,313 @@
+
+#include "bbr_controller.hh"
+#include "log.hh"
+#include <algorithm>
+#include "math.h"
+
+using namespace std;
+
+/* Payload bytes of a full datagram */
+static const uint64_t PACKET_BYTES = 1424;
+
+/* Smallest congestion window, and the one held during PROBE_RTT (in datagrams) */
+static const unsigned int MIN_CWND = 4;
+
+/* Congestion window before there is a bandwidth-delay estimate (in datagrams) */
+static const unsigned int INITIAL_CWND = 10;
+
+/* Gain that doubles the sending rate every round trip in STARTUP */
+static const double HIGH_GAIN = 2 / log(2);
+
+/* Pacing gains of the PROBE_BW cycle: probe for more bandwidth for
+   one RTprop, drain the queue that made for one more, then cruise */
+static const double PROBE_BW_GAINS[] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+static const unsigned int CYCLE_LENGTH = sizeof(PROBE_BW_GAINS) / sizeof(PROBE_BW_GAINS[0]);
+
+/* How long PROBE_RTT holds the window down (in microseconds) */
+static const uint64_t PROBE_RTT_DURATION = 200000;
+
+/* Default constructor */
+BBRController::BBRController()
+  : BBRController( Parameters() )
+{}
+
+/* With tunables other than the defaults */
+BBRController::BBRController( const Parameters & parameters )
+  : Controller(), state(STARTUP), rt_sample_timeout(parameters.rt_sample_timeout),
+      rt_filter(), rt_estimate(0),
+      rt_estimate_last_updated(0), stale_update_threshold(parameters.stale_update_threshold),
+      btlbw_sample_rounds(parameters.btlbw_sample_rounds), btlbw_filter(), btlbw_estimate(0),
+      round_count(0), next_round_delivered(0), round_start(false),
+      full_bw(0), startup_rounds_without_increase(0), filled_pipe(false),
+      cycle_index(0), cycle_stamp(0),
+      prng(parameters.seed ? parameters.seed : random_device()()),
+      probe_rtt_done_stamp(0), probe_rtt_round_done(false),
+      cwnd(INITIAL_CWND * PACKET_BYTES), num_packets_delivered(0),
+      probe_bw_cwnd_gain(parameters.cwnd_gain),
+      cwnd_gain(HIGH_GAIN), pacing_gain(HIGH_GAIN),
+      next_send_time(0)
+{}
+
+/* Get current window size, in datagrams */
+unsigned int BBRController::window_size()
+{
+  LOG( Trace, "At time {} window size is {}", now(), cwnd / PACKET_BYTES );
+
+  return cwnd / PACKET_BYTES;
+}
+
+/* Bandwidth-delay product (in bytes) scaled by gain */
+uint64_t BBRController::bdp( const double gain ) const
+{
+  return gain * rt_estimate * btlbw_estimate;
+}
+
+/* Pacing rate (in bytes per microsecond) */
+double BBRController::pacing_rate() const
+{
+  if (btlbw_estimate > 0) {
+    return pacing_gain * btlbw_estimate;
+  }
+
+  /* No bandwidth estimate yet: send the initial window over
+     one RTT (or over 1 ms, if there isn't an RTT either) */
+  return pacing_gain * INITIAL_CWND * PACKET_BYTES / (rt_estimate > 0 ? rt_estimate : 1000);
+}
+
+/* A datagram was sent */
+void BBRController::datagram_was_sent( const uint64_t sequence_number,
+            /* of the sent datagram */
+            const uint64_t send_timestamp,
+            /* in microseconds */
+            const uint64_t payload_length,
+            /* in bytes */
+            const bool after_timeout
+            /* datagram was sent because of a timeout */ )
+{
+  LOG( Debug, "At time {} sent datagram {} (timeout = {})",
+       send_timestamp, sequence_number, after_timeout );
+
+  count_sent(sequence_number, send_timestamp, payload_length, after_timeout);
+
+  // Pace: the next datagram may go out once this one has had time to
+  // drain at the pacing rate (without banking credit for idle time)
+  next_send_time = max(next_send_time, send_timestamp) + payload_length / pacing_rate();
+  LOG( Trace, "pacing_gain = {} next send @ time {}", pacing_gain, next_send_time );
+}
+
+/* Count round trips: a round ends when a packet sent after
+   the end of the previous round is acked */
+void BBRController::update_round( const uint64_t packet_delivered )
+{
+  round_start = false;
+  if (packet_delivered >= next_round_delivered) {
+    next_round_delivered = rate_sampler.delivered();
+    round_count++;
+    round_start = true;
+  }
+}
+
+/* Once per round in STARTUP (when not app-limited): is the bandwidth
+   estimate still growing? */
+void BBRController::check_full_pipe()
+{
+  if (filled_pipe or not round_start or rate_sampler.sample().is_app_limited) {
+    return;
+  }
+
+  if (btlbw_estimate >= full_bw * 1.25) {
+    full_bw = btlbw_estimate;
+    startup_rounds_without_increase = 0;
+    return;
+  }
+
+  if (++startup_rounds_without_increase >= 3) {
+    filled_pipe = true;
+  }
+}
+
+void BBRController::enter_probe_bw( const uint64_t now )
+{
+  state = PROBE_BW;
+  cwnd_gain = probe_bw_cwnd_gain;
+
+  /* Start anywhere in the cycle but the draining phase
+     (so that competing flows don't probe in lockstep) */
+  cycle_index = (2 + prng() % (CYCLE_LENGTH - 1)) % CYCLE_LENGTH;
+  cycle_stamp = now;
+  pacing_gain = PROBE_BW_GAINS[cycle_index];
+}
+
+/* Move to the next phase of the PROBE_BW cycle when this one is done */
+void BBRController::advance_cycle_phase( const uint64_t now, const unsigned int prior_inflight )
+{
+  const bool full_length = now - cycle_stamp > rt_estimate;
+  bool next_phase = full_length;
+
+  if (pacing_gain > 1) {
+    /* keep probing until the probe has filled the pipe to match */
+    next_phase = full_length and prior_inflight * PACKET_BYTES >= bdp(pacing_gain);
+  } else if (pacing_gain < 1) {
+    /* stop draining early once the queue is gone */
+    next_phase = full_length or prior_inflight * PACKET_BYTES <= bdp(1);
+  }
+
+  if (next_phase) {
+    cycle_index = (cycle_index + 1) % CYCLE_LENGTH;
+    cycle_stamp = now;
+    pacing_gain = PROBE_BW_GAINS[cycle_index];
+  }
+}
+
+/* Every stale_update_threshold without a new min RTT, drain the
+   pipe for a moment to measure RTprop again */
+void BBRController::check_probe_rtt( const uint64_t now )
+{
+  if (state != PROBE_RTT and rt_estimate > 0
+      and now - rt_estimate_last_updated > stale_update_threshold) {
+    state = PROBE_RTT;
+    pacing_gain = 1;
+    cwnd_gain = 1;
+    probe_rtt_done_stamp = 0;
+  }
+
+  if (state != PROBE_RTT) {
+    return;
+  }
+
+  if (probe_rtt_done_stamp == 0 and inflight <= MIN_CWND) {
+    /* drained: hold for PROBE_RTT_DURATION and at least one round */
+    probe_rtt_done_stamp = now + PROBE_RTT_DURATION;
+    probe_rtt_round_done = false;
+    next_round_delivered = rate_sampler.delivered();
+  } else if (probe_rtt_done_stamp != 0) {
+    if (round_start) {
+      probe_rtt_round_done = true;
+    }
+    if (probe_rtt_round_done and now > probe_rtt_done_stamp) {
+      rt_estimate_last_updated = now;
+      if (filled_pipe) {
+        enter_probe_bw(now);
+      } else {
+        state = STARTUP;
+        pacing_gain = cwnd_gain = HIGH_GAIN;
+      }
+    }
+  }
+}
+
+/* Grow the window towards cwnd_gain * bdp as data is delivered */
+void BBRController::update_cwnd( const uint64_t acked_bytes )
+{
+  const uint64_t target = max(bdp(cwnd_gain), uint64_t(MIN_CWND * PACKET_BYTES));
+
+  if (filled_pipe) {
+    cwnd = min(cwnd + acked_bytes, target);
+  } else if (cwnd < target or rate_sampler.delivered() < INITIAL_CWND * PACKET_BYTES) {
+    cwnd += acked_bytes;
+  }
+
+  cwnd = max(cwnd, uint64_t(MIN_CWND * PACKET_BYTES));
+  if (state == PROBE_RTT) {
+    cwnd = min(cwnd, uint64_t(MIN_CWND * PACKET_BYTES));
+  }
+}
+
+/* An ack was received
+ * In BBR: Each ack provides new RTT and average delivery rate measurements
+ * that update the RTprop and BtlBw estimates.
+ */
+void BBRController::ack_received( const uint64_t sequence_number_acked,
+             /* what sequence number was acknowledged */
+             const uint64_t send_timestamp_acked,
+             /* when the acknowledged datagram was sent (sender's clock) */
+             const uint64_t recv_timestamp_acked,
+             /* when the acknowledged datagram was received (receiver's clock)*/
+             const uint64_t timestamp_ack_received,
+             /* when the ack was received (by sender) */
+             const uint64_t payload_length,
+             /* payload length of message acked */
+             const uint64_t packet_delivered,
+             const uint64_t packet_delivered_time)
+{
+  LOG( Debug, "At time {} received ack for datagram {} (send @ time {}, "
+       "received @ time {} by receiver's clock), payload length = {}",
+       timestamp_ack_received, sequence_number_acked, send_timestamp_acked,
+       recv_timestamp_acked, payload_length );
+
+  LOG( Trace, "packet_delivered {} packet_delivered_time {}", packet_delivered, packet_delivered_time );
+
+  const unsigned int prior_inflight = inflight;
+  uint64_t lost;
+  if (not count_acked(sequence_number_acked, send_timestamp_acked, timestamp_ack_received,
+                      payload_length, lost)) {
+    // A duplicate or stale ack: no RTT or rate sample, and the window stays
+    return;
+  }
+  double rtt = rtt_sample(send_timestamp_acked, timestamp_ack_received);
+
+  // Calculate new RTprop estimate (min RTT over time window rt_sample_timeout);
+  // a sample that matches the estimate keeps it fresh
+  if (rt_estimate == 0 or rtt <= rt_estimate) {
+    rt_estimate_last_updated = timestamp_ack_received;
+  }
+  rt_estimate = rt_filter.update(rtt, timestamp_ack_received, rt_sample_timeout);
+
+  const RateSample & sample = rate_sampler.sample();
+  num_packets_delivered++;
+  update_round(sample.prior_delivered);
+
+  // Calculate new BtlBw estimate from the ack's rate sample (if it has one:
+  // not if its interval was shorter than the min RTT). A sample taken while
+  // the sender was app-limited only shows what it sent, so it counts only
+  // if it's no lower than the estimate.
+  if (sample.delivery_rate > 0
+      and (not sample.is_app_limited or sample.delivery_rate >= btlbw_estimate)) {
+    LOG( Trace, "num packets delivered {}: delivered {} in {} us (send {} us, ack {} us)",
+         num_packets_delivered, sample.delivered, sample.interval,
+         sample.send_elapsed, sample.ack_elapsed );
+    btlbw_estimate = btlbw_filter.update(sample.delivery_rate, round_count, btlbw_sample_rounds);
+  }
+
+  // Move through the BBR state machine
+  check_full_pipe();
+  if (state == STARTUP and filled_pipe) {
+    state = DRAIN;
+    pacing_gain = 1 / HIGH_GAIN;
+    cwnd_gain = HIGH_GAIN;
+  }
+  if (state == DRAIN and inflight * PACKET_BYTES <= bdp(1)) {
+    enter_probe_bw(timestamp_ack_received);
+  }
+  if (state == PROBE_BW) {
+    advance_cycle_phase(timestamp_ack_received, prior_inflight);
+  }
+  check_probe_rtt(timestamp_ack_received);
+
+  update_cwnd(payload_length);
+
+  LOG( Debug, "rt = {}, btlbw = {}", rt_estimate, btlbw_estimate );
+}
+
+bool BBRController::window_is_open()
+{
+  LOG( Trace, "inflight = {} cwnd = {}", inflight, cwnd / PACKET_BYTES );
+
+  return inflight * PACKET_BYTES < cwnd;
+}
+
+bool BBRController::should_send_packet()
+{
+  return now() >= next_send_time;
+}
+
+/* Fill in the estimates, gain and state of a trace event */
+void BBRController::trace_state( PacketEvent & event )
+{
+  event.rt_estimate = rt_estimate;
+  event.btlbw_estimate = btlbw_estimate;
+  event.inflight = inflight;
+  event.cwnd = cwnd / PACKET_BYTES;
+  event.pacing_gain = pacing_gain;
+  event.state = state;
+}
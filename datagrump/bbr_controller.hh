@@ -0,0 +1,141 @@
+#ifndef BBR_CONTROLLER_HH
+#define BBR_CONTROLLER_HH
+
+#include <cstdint>
+#include <random>
+
+#include "controller.hh"
+#include "windowed_filter.hh"
+
+/* BBR: paces at the bottleneck bandwidth it measures, keeping about
+   one bandwidth-delay product in flight */
+
+class BBRController final : public Controller
+{
+private:
+
+  enum bbr_state {STARTUP, DRAIN, PROBE_BW, PROBE_RTT};
+
+  /* Current state in the BBR FSM */
+  bbr_state state;
+
+  /* Max time (in microseconds) an rt sample is valid.
+   * Time windo for RTProp calculation*/
+  unsigned int rt_sample_timeout;
+  /* Min of the observed RTTs within time window rt_sample_timeout*/
+  WindowedMinFilter<double> rt_filter;
+  /* Current propagation delay (RTprop) estimate */
+  double rt_estimate;
+
+
+  uint64_t rt_estimate_last_updated; /* Time (in microseconds) when an RTT sample last matched the estimate */
+  unsigned int stale_update_threshold; /* Max time (in microseconds) an rt estimate can remain the same before we probe for a new estimate */
+
+  /* Round trips a delivery rate sample is valid */
+  unsigned int btlbw_sample_rounds;
+  /* Max of the observed delivery rates within the last btlbw_sample_rounds round trips */
+  WindowedMaxFilter<double> btlbw_filter;
+  /* Current bottleneck bandwidth estimate >= delivery rate (in bytes per microsecond) */
+  double btlbw_estimate;
+
+  /* Round trips counted by packet delivery: a round ends when a
+     packet sent after the previous round ended is acked */
+  uint64_t round_count;
+  uint64_t next_round_delivered;
+  bool round_start;
+
+  /* Startup ends once the bandwidth estimate stops growing (by 25%)
+     for three rounds in a row */
+  double full_bw;
+  unsigned int startup_rounds_without_increase;
+  bool filled_pipe;
+
+  /* PROBE_BW: position in the gain cycle, and when it began */
+  unsigned int cycle_index;
+  uint64_t cycle_stamp;
+  std::default_random_engine prng;
+
+  /* PROBE_RTT: when it may end (0 until inflight has drained) */
+  uint64_t probe_rtt_done_stamp;
+  bool probe_rtt_round_done;
+
+  /* Congestion window (in bytes) */
+  uint64_t cwnd;
+
+  unsigned int num_packets_delivered;
+
+  /* Multiplier of bdp to calculate allowed # inflight packets
+     (and what it settles at in PROBE_BW) */
+  double probe_bw_cwnd_gain;
+  double cwnd_gain;
+
+  double pacing_gain;
+
+  /* Earliest time (in microseconds) the next datagram may go out */
+  uint64_t next_send_time;
+
+  /* Bandwidth-delay product (in bytes) scaled by gain */
+  uint64_t bdp( const double gain ) const;
+
+  /* Pacing rate (in bytes per microsecond) */
+  double pacing_rate() const;
+
+  void update_round( const uint64_t packet_delivered );
+  void check_full_pipe();
+  void enter_probe_bw( const uint64_t now );
+  void advance_cycle_phase( const uint64_t now, const unsigned int prior_inflight );
+  void check_probe_rtt( const uint64_t now );
+  void update_cwnd( const uint64_t acked_bytes );
+
+public:
+  /* Name to pick this algorithm by */
+  static std::string name() { return "bbr"; }
+
+  /* Tunables, for experiments (times in microseconds) */
+  struct Parameters
+  {
+    unsigned int rt_sample_timeout = 10000000;
+    unsigned int stale_update_threshold = 10000000;
+    unsigned int btlbw_sample_rounds = 10;
+    double cwnd_gain = 2; /* in PROBE_BW */
+    unsigned int seed = 0; /* of the PROBE_BW cycle's random start (0 for a random seed) */
+  };
+
+  /* Default constructor */
+  BBRController();
+
+  /* With tunables other than the defaults */
+  explicit BBRController( const Parameters & parameters );
+
+  /* Get current window size, in datagrams */
+  unsigned int window_size() override;
+
+  /* A datagram was sent */
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t payload_length,
+			  const bool after_timeout ) override;
+
+  /* An ack was received */
+  void ack_received( const uint64_t sequence_number_acked,
+		     const uint64_t send_timestamp_acked,
+		     const uint64_t recv_timestamp_acked,
+		     const uint64_t timestamp_ack_received,
+		     const uint64_t payload_length,
+		     const uint64_t packet_delivered,
+		     const uint64_t packet_delivered_time ) override;
+
+  /* Returns true if inflight packets is < cwnd_gain * bdp */
+  bool window_is_open() override;
+
+  /* Returns true if time is >= next send time */
+  bool should_send_packet() override;
+
+  /* Earliest time (in microseconds) the next datagram may go out */
+  uint64_t next_send_time_us() const override { return next_send_time; }
+
+  /* Fill in the estimates, gain and state of a trace event */
+  void trace_state( PacketEvent & event ) override;
+};
+
+#endif /* BBR_CONTROLLER_HH */
@@ -0,0 +1,92 @@
+/* cost per call of each clock the sender could timestamp datagrams
+   with, and how far the TSC clock strays from CLOCK_MONOTONIC */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* calls per measurement */
+static const unsigned int CALLS = 10000000;
+
+/* time CALLS calls of clock, in nanoseconds per call */
+template <class ClockType>
+static void measure( const string & name, const ClockType & clock )
+{
+  uint64_t sum = 0; /* keeps the calls from being optimized away */
+
+  timespec start, end;
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &start ) );
+  for ( unsigned int i = 0; i < CALLS; i++ ) {
+    sum += clock();
+  }
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &end ) );
+
+  const double elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  cout << name << ": " << elapsed_ns / CALLS << " ns per call"
+       << (sum == 0 ? " " : "") << endl;
+}
+
+static uint64_t raw_clock_gettime( const clockid_t clock )
+{
+  timespec ts;
+  clock_gettime( clock, &ts );
+  return ts.tv_nsec;
+}
+
+static uint64_t raw_clock_gettime_ns()
+{
+  timespec ts;
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &ts ) );
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << endl;
+    return EXIT_FAILURE;
+  }
+
+  measure( "clock_gettime( CLOCK_MONOTONIC )", [] () { return raw_clock_gettime( CLOCK_MONOTONIC ); } );
+  measure( "clock_gettime( CLOCK_REALTIME )", [] () { return raw_clock_gettime( CLOCK_REALTIME ); } );
+  measure( "timestamp_us() by clock_gettime", [] () { return timestamp_us(); } );
+  measure( "timestamp_ms() by clock_gettime", [] () { return timestamp_ms(); } );
+
+  if ( not enable_fast_clock() ) {
+    cout << "no invariant TSC: fast clock unavailable" << endl;
+    return EXIT_SUCCESS;
+  }
+
+  measure( "timestamp_us() by TSC", [] () { return timestamp_us(); } );
+  measure( "timestamp_ms() by TSC", [] () { return timestamp_ms(); } );
+
+  /* follow the two clocks through a few recalibrations, counting only
+     how far the TSC clock falls outside a CLOCK_MONOTONIC bracket
+     (so being preempted mid-sample doesn't count as error) */
+  const uint64_t monotonic_start = raw_clock_gettime_ns();
+  const uint64_t fast_start = timestamp_ns();
+  uint64_t monotonic_after = monotonic_start;
+  int64_t worst_ns = 0;
+
+  while ( monotonic_after - monotonic_start < 3000000000ULL ) {
+    const int64_t before = raw_clock_gettime_ns() - monotonic_start;
+    const int64_t fast = timestamp_ns() - fast_start;
+    monotonic_after = raw_clock_gettime_ns();
+    const int64_t after = monotonic_after - monotonic_start;
+
+    worst_ns = max( worst_ns, max( before - fast, fast - after ) );
+  }
+
+  cout << "TSC clock vs. CLOCK_MONOTONIC over 3 s: worst divergence " << worst_ns << " ns" << endl;
+
+  return EXIT_SUCCESS;
+}
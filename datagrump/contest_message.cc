@@ -1,4 +1,5 @@
 #include <stdexcept>
+#include <cstring>
 
 #include "contest_message.hh"
 #include "timestamp.hh"
@@ -27,40 +28,69 @@ ContestMessage::Header::Header( const string & str )
     ack_recv_timestamp( get_header_field( 4, str ) ),
     ack_payload_length( get_header_field( 5, str ) ),
     delivered( get_header_field( 6, str ) ),
-    delivered_time( get_header_field( 7, str ) )
+    delivered_time( get_header_field( 7, str ) ),
+    flow_id( get_header_field( 8, str ) )
 {}
 
 /* Parse incoming message from wire */
 ContestMessage::ContestMessage( const string & str )
   : header( str ),
-    payload( str.begin() + sizeof( header ), str.end() )
+    payload( str.begin() + Header::SIZE, str.end() )
 {}
 
 /* Fill in the send_timestamp for an outgoing message */
 void ContestMessage::set_send_timestamp()
 {
-  header.send_timestamp = timestamp_ms();
+  header.set_send_timestamp();
 }
 
-/* helper to put a uint64_t field (in network byte order) */
-string put_header_field( const uint64_t n )
+void ContestMessage::Header::set_send_timestamp()
 {
-  const uint64_t network_order = htobe64( n );
-  return string( reinterpret_cast<const char *>( &network_order ),
-		 sizeof( network_order ) );
+  send_timestamp = timestamp_us();
+}
+
+/* helper to put the nth uint64_t field (in network byte order) */
+void put_header_field( const size_t n, const uint64_t value, char * buffer )
+{
+  const uint64_t network_order = htobe64( value );
+  memcpy( buffer + n * sizeof( uint64_t ), &network_order, sizeof( network_order ) );
+}
+
+/* helper to read the nth uint64_t field (in network byte order) */
+uint64_t read_header_field( const size_t n, const char * buffer )
+{
+  uint64_t network_order;
+  memcpy( &network_order, buffer + n * sizeof( uint64_t ), sizeof( network_order ) );
+  return be64toh( network_order );
+}
+
+/* Write wire representation of header into buffer */
+void ContestMessage::Header::serialize( char * buffer ) const
+{
+  put_header_field( 0, sequence_number, buffer );
+  put_header_field( 1, send_timestamp, buffer );
+  put_header_field( 2, ack_sequence_number, buffer );
+  put_header_field( 3, ack_send_timestamp, buffer );
+  put_header_field( 4, ack_recv_timestamp, buffer );
+  put_header_field( 5, ack_payload_length, buffer );
+  put_header_field( 6, delivered, buffer );
+  put_header_field( 7, delivered_time, buffer );
+  put_header_field( 8, flow_id, buffer );
+}
+
+/* Make a pooled buffer hold the wire representation of header */
+void ContestMessage::Header::serialize( PacketBuffer & buffer ) const
+{
+  buffer.set_length( SIZE );
+  serialize( buffer.data() );
 }
 
 /* Make wire representation of header */
 string ContestMessage::Header::to_string() const
 {
-  return put_header_field( sequence_number )
-    + put_header_field( send_timestamp )
-    + put_header_field( ack_sequence_number )
-    + put_header_field( ack_send_timestamp )
-    + put_header_field( ack_recv_timestamp )
-    + put_header_field( ack_payload_length )
-    + put_header_field( delivered )
-    + put_header_field( delivered_time );
+  string ret( SIZE, 0 );
+  serialize( &ret[ 0 ] );
+  return ret;
 }
 
 /* Make wire representation of message */
@@ -100,7 +130,8 @@ ContestMessage::ContestMessage( const uint64_t s_sequence_number,
 /* Header for new message */
 ContestMessage::Header::Header( const uint64_t s_sequence_number,
         const uint64_t delivered,
-        const uint64_t delivered_time)
+        const uint64_t delivered_time,
+        const uint64_t s_flow_id )
   : sequence_number( s_sequence_number ),
     send_timestamp( -1 ),
     ack_sequence_number( -1 ),
@@ -108,7 +139,8 @@ ContestMessage::Header::Header( const uint64_t s_sequence_number,
     ack_recv_timestamp( -1 ),
     ack_payload_length( -1 ),
     delivered( delivered ),
-    delivered_time ( delivered_time )
+    delivered_time ( delivered_time ),
+    flow_id( s_flow_id )
 {}
 
 /* Is this message an ack? */
@@ -116,3 +148,120 @@ bool ContestMessage::is_ack() const
 {
   return header.ack_sequence_number != uint64_t( -1 );
 }
+
+/* Transform a received datagram into an ack in place */
+void ContestMessage::transform_into_ack_in_place( char * datagram,
+						  const size_t length,
+						  const uint64_t sequence_number,
+						  const uint64_t recv_timestamp )
+{
+  const ContestMessageView received( datagram, length );
+
+  /* read what we're acking before overwriting it */
+  const uint64_t acked_sequence_number = received.sequence_number();
+  const uint64_t acked_send_timestamp = received.send_timestamp();
+
+  put_header_field( 0, sequence_number, datagram );
+  put_header_field( 1, timestamp_us(), datagram );
+  put_header_field( 2, acked_sequence_number, datagram );
+  put_header_field( 3, acked_send_timestamp, datagram );
+  put_header_field( 4, recv_timestamp, datagram );
+  put_header_field( 5, received.payload_length(), datagram );
+
+  /* delivered, delivered_time and flow_id are echoed unchanged */
+}
+
+/* View datagram without copying it */
+ContestMessageView::ContestMessageView( const char * data, const size_t length )
+  : data_( data ),
+    length_( length )
+{
+  if ( length_ < ContestMessage::Header::SIZE ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+}
+
+/* decode the nth header field (in network byte order) */
+uint64_t ContestMessageView::field( const size_t n ) const
+{
+  uint64_t network_order;
+  memcpy( &network_order, data_ + n * sizeof( uint64_t ), sizeof( network_order ) );
+  return be64toh( network_order );
+}
+
+/* Append wire representation of a coalesced ack: the cumulative ack, where
+   the holes given up on end, the number of ranges and of datagrams, then
+   each range and each datagram */
+void CoalescedAck::serialize( PacketBuffer & out ) const
+{
+  const size_t fields = 4 + 2 * ranges.size() + 6 * datagrams.size();
+  const size_t offset = out.length();
+  out.set_length( offset + fields * sizeof( uint64_t ) );
+  char * const buffer = out.data() + offset;
+
+  size_t n = 0;
+  put_header_field( n++, cumulative_ack, buffer );
+  put_header_field( n++, holes_below, buffer );
+  put_header_field( n++, ranges.size(), buffer );
+  put_header_field( n++, datagrams.size(), buffer );
+
+  for ( const auto & range : ranges ) {
+    put_header_field( n++, range.begin, buffer );
+    put_header_field( n++, range.end, buffer );
+  }
+
+  for ( const auto & datagram : datagrams ) {
+    put_header_field( n++, datagram.sequence_number, buffer );
+    put_header_field( n++, datagram.send_timestamp, buffer );
+    put_header_field( n++, datagram.recv_timestamp, buffer );
+    put_header_field( n++, datagram.payload_length, buffer );
+    put_header_field( n++, datagram.delivered, buffer );
+    put_header_field( n++, datagram.delivered_time, buffer );
+  }
+}
+
+/* Read an ack (either kind) */
+bool CoalescedAck::parse( const ContestMessageView & ack )
+{
+  ranges.clear();
+  datagrams.clear();
+
+  if ( not is_coalesced( ack ) ) {
+    cumulative_ack = 0;
+    holes_below = 0;
+    ranges.push_back( { ack.ack_sequence_number(), ack.ack_sequence_number() + 1 } );
+    datagrams.push_back( { ack.ack_sequence_number(), ack.ack_send_timestamp(),
+			   ack.ack_recv_timestamp(), ack.ack_payload_length(),
+			   ack.delivered(), ack.delivered_time() } );
+    return true;
+  }
+
+  const char * const buffer = ack.payload();
+  const size_t available = ack.payload_length() / sizeof( uint64_t );
+  if ( available < 4 ) {
+    return false;
+  }
+
+  cumulative_ack = read_header_field( 0, buffer );
+  holes_below = read_header_field( 1, buffer );
+  const uint64_t range_count = read_header_field( 2, buffer );
+  const uint64_t datagram_count = read_header_field( 3, buffer );
+
+  if ( range_count > MAX_RANGES or datagram_count > MAX_DATAGRAMS
+       or available < 4 + 2 * range_count + 6 * datagram_count ) {
+    return false;
+  }
+
+  size_t n = 4;
+  for ( uint64_t i = 0; i < range_count; i++, n += 2 ) {
+    ranges.push_back( { read_header_field( n, buffer ), read_header_field( n + 1, buffer ) } );
+  }
+
+  for ( uint64_t i = 0; i < datagram_count; i++, n += 6 ) {
+    datagrams.push_back( { read_header_field( n, buffer ), read_header_field( n + 1, buffer ),
+			   read_header_field( n + 2, buffer ), read_header_field( n + 3, buffer ),
+			   read_header_field( n + 4, buffer ), read_header_field( n + 5, buffer ) } );
+  }
+
+  return true;
+}
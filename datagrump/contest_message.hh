@@ -3,9 +3,14 @@
 
 #include <string>
 #include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "packet_pool.hh"
 
 struct ContestMessage
 {
+  /* (all times are in microseconds, by timestamp_us()) */
   struct Header {
     uint64_t sequence_number;
     uint64_t send_timestamp;
@@ -18,16 +23,32 @@ struct ContestMessage
     uint64_t delivered;
     uint64_t delivered_time;
 
+    /* Which of the sender's flows the message belongs to (echoed in its ack) */
+    uint64_t flow_id;
+
+    /* Size of the wire representation of the header */
+    static const size_t SIZE = 9 * sizeof( uint64_t );
+
     /* Header for new message */
     Header( const uint64_t s_sequence_number,
         const uint64_t delivered,
-        const uint64_t delivered_time );
+        const uint64_t delivered_time,
+        const uint64_t s_flow_id = 0 );
 
     /* Parse header from wire */
     Header( const std::string & str );
 
+    /* Fill in the send_timestamp for an outgoing message */
+    void set_send_timestamp();
+
     /* Make wire representation of header */
     std::string to_string() const;
+
+    /* Write wire representation of header into buffer (at least SIZE bytes) */
+    void serialize( char * buffer ) const;
+
+    /* Make a pooled buffer hold the wire representation of header */
+    void serialize( PacketBuffer & buffer ) const;
   } header;
 
   std::string payload;
@@ -51,8 +72,115 @@ struct ContestMessage
   void transform_into_ack( const uint64_t sequence_number,
 			   const uint64_t recv_timestamp );
 
+  /* Transform a received datagram into an ack in place and stamp it for sending.
+     Only the header is rewritten, so only the first Header::SIZE bytes
+     need to be sent back. */
+  static void transform_into_ack_in_place( char * datagram,
+					   const size_t length,
+					   const uint64_t sequence_number,
+					   const uint64_t recv_timestamp );
+
   /* Is this message an ack? */
   bool is_ack() const;
 };
 
+/* Read-only view of a ContestMessage on the wire.
+   Header fields are decoded on demand and nothing is copied,
+   so the underlying bytes must outlive the view. */
+class ContestMessageView
+{
+private:
+  const char * data_;
+  size_t length_;
+
+  /* decode the nth header field */
+  uint64_t field( const size_t n ) const;
+
+public:
+  /* View datagram (must be at least a header long) */
+  ContestMessageView( const char * data, const size_t length );
+
+  /* Is a datagram of length bytes long enough to view? (anything
+     shorter isn't a contest message, and should be dropped) */
+  static bool fits( const size_t length ) { return length >= ContestMessage::Header::SIZE; }
+  static bool fits( const PacketBuffer & buffer ) { return fits( buffer.length() ); }
+
+  /* View datagram in a pooled buffer */
+  explicit ContestMessageView( const PacketBuffer & buffer )
+    : ContestMessageView( buffer.data(), buffer.length() ) {}
+
+  /* header fields */
+  uint64_t sequence_number() const { return field( 0 ); }
+  uint64_t send_timestamp() const { return field( 1 ); }
+  uint64_t ack_sequence_number() const { return field( 2 ); }
+  uint64_t ack_send_timestamp() const { return field( 3 ); }
+  uint64_t ack_recv_timestamp() const { return field( 4 ); }
+  uint64_t ack_payload_length() const { return field( 5 ); }
+  uint64_t delivered() const { return field( 6 ); }
+  uint64_t delivered_time() const { return field( 7 ); }
+  uint64_t flow_id() const { return field( 8 ); }
+
+  /* payload (whatever follows the header) */
+  const char * payload() const { return data_ + ContestMessage::Header::SIZE; }
+  size_t payload_length() const { return length_ - ContestMessage::Header::SIZE; }
+
+  /* Is this message an ack? */
+  bool is_ack() const { return ack_sequence_number() != uint64_t( -1 ); }
+};
+
+/* One datagram acknowledged by an ack */
+struct AckedDatagram
+{
+  uint64_t sequence_number;
+  uint64_t send_timestamp; /* (by the sender's clock) */
+  uint64_t recv_timestamp; /* (by the receiver's clock) */
+  uint64_t payload_length;
+  uint64_t delivered;
+  uint64_t delivered_time;
+};
+
+/* What follows the header of a coalesced ack, which acknowledges
+   several datagrams at once. (The header's ack fields describe the
+   newest of them, so it still reads as an ack of that one.) */
+struct CoalescedAck
+{
+  /* Most ranges and datagrams one ack carries (so that it fits in a datagram) */
+  static const size_t MAX_RANGES = 4;
+  static const size_t MAX_DATAGRAMS = 16;
+
+  /* Sequence numbers [begin, end) */
+  struct Range
+  {
+    uint64_t begin, end;
+  };
+
+  /* Every sequence number below this has arrived, except any in a hole
+     the receiver has stopped tracking (lost datagrams are never sent
+     again, so holes never fill) */
+  uint64_t cumulative_ack = 0;
+
+  /* Every hole the receiver has stopped tracking lies below this, so
+     only from here up to cumulative_ack is everything known to have
+     arrived (0 if it has stopped tracking none) */
+  uint64_t holes_below = 0;
+
+  /* Blocks of sequence numbers that have arrived above cumulative_ack, lowest first */
+  std::vector<Range> ranges {};
+
+  /* Each datagram acknowledged, in the order they arrived */
+  std::vector<AckedDatagram> datagrams {};
+
+  /* Append wire representation to what out holds */
+  void serialize( PacketBuffer & out ) const;
+
+  /* Read an ack (reusing this object's storage). An ack without a
+     coalesced part acknowledges just the datagram in its header.
+     Returns false if the coalesced part is malformed (and the ack
+     should be dropped). */
+  bool parse( const ContestMessageView & ack );
+
+  /* Is there a coalesced part after this ack's header? */
+  static bool is_coalesced( const ContestMessageView & ack ) { return ack.payload_length() > 0; }
+};
+
 #endif /* CONTEST_MESSAGE_HH */
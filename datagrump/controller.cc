@@ -1,184 +1,215 @@
-#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
 
 #include "controller.hh"
-#include "timestamp.hh"
-#include <algorithm>
-#include "math.h"
+#include "bbr_controller.hh"
+#include "reno_controller.hh"
+#include "cubic_controller.hh"
+#include "vegas_controller.hh"
 
 using namespace std;
 
+/* Most timeouts in a row that still double the timeout (2^6 = 64 times) */
+static const unsigned int MAX_TIMEOUT_BACKOFF = 6;
+
+/* Longest retransmission timeout (in microseconds) */
+static const uint64_t MAX_TIMEOUT = 60000000;
+
 /* Default constructor */
-Controller::Controller( const bool debug )
-  : debug_( debug ), state(STARTUP), num_acks(0), rt_sample_timeout(10000), 
-      rt_filter(), rt_estimate(0),
-      rt_estimate_last_updated(0), stale_update_threshold(1000),
-      btlbw_filter(), btlbw_estimate(0), startup_rounds_without_increase(0),
-      cwnd(5), num_packets_delivered(0), inflight(0), delivered(0), delivered_time(0),
-      cwnd_gain(2 / log(2)), pacing_gain(2 / log(2)),
-      next_send_time(0)
+Controller::Controller()
+  : inflight( 0 ),
+    next_sequence_number( 0 ),
+    scoreboard(), lost_since_ack( 0 ), consecutive_timeouts( 0 ),
+    rate_sampler(),
+    srtt( 0 ), rttvar( 0 ), min_rtt( 0 ), ack_delay( 0 ),
+    clock_( nullptr )
 {}
 
-/* Get current window size, in datagrams */
-unsigned int Controller::window_size()
-{  
-  cerr << "inflight = " << (inflight/1424) << "cwnd = " << (cwnd/1424) << endl;
-  if ( debug_ ) {
-    cerr << "At time " << timestamp_ms()
-   << " window size is " << cwnd << endl;
+/* A datagram was sent: it is in flight */
+void Controller::count_sent( const uint64_t sequence_number,
+			     const uint64_t send_timestamp,
+			     const uint64_t payload_length,
+			     const bool after_timeout )
+{
+  /* nothing was acked for a whole timeout: give up on everything in flight */
+  if ( after_timeout ) {
+    scoreboard.mark_all_lost();
+    consecutive_timeouts++;
   }
 
-  return cwnd;
+  const DeliverySnapshot delivery = rate_sampler.sent( send_timestamp, scoreboard.in_flight() == 0 );
+  scoreboard.sent( sequence_number, send_timestamp, payload_length, delivery );
+  next_sequence_number = max( next_sequence_number, sequence_number + 1 );
+  inflight = scoreboard.in_flight();
 }
 
-/* A datagram was sent */
-void Controller::datagram_was_sent( const uint64_t sequence_number,
-            /* of the sent datagram */
-            const uint64_t send_timestamp,
-            /* in milliseconds */
-            const uint64_t payload_length,
-            /* in bytes */
-            const bool after_timeout
-            /* datagram was sent because of a timeout */ )
+/* An ack was received: update inflight, delivery and RTT, and look for losses */
+bool Controller::count_acked( const uint64_t sequence_number_acked,
+			      const uint64_t send_timestamp_acked,
+			      const uint64_t timestamp_ack_received,
+			      const uint64_t payload_length,
+			      uint64_t & lost )
 {
-  if ( debug_ ) {
-    cerr << "At time " << send_timestamp
-   << " sent datagram " << sequence_number << " (timeout = "  << after_timeout << ")\n";
+  /* (an ack of something acked before, or long forgotten, is no news) */
+  bool was_sacked = false;
+  const Scoreboard::Entry * const packet = scoreboard.acked( sequence_number_acked,
+							    timestamp_ack_received, was_sacked );
+  if ( packet ) {
+    consecutive_timeouts = 0;
+
+    const double rtt = rtt_sample( send_timestamp_acked, timestamp_ack_received );
+    if ( srtt == 0 ) {
+      srtt = rtt;
+      rttvar = rtt / 2;
+    } else {
+      rttvar = 0.75 * rttvar + 0.25 * fabs( srtt - rtt );
+      srtt = 0.875 * srtt + 0.125 * rtt;
+    }
+    min_rtt = min_rtt == 0 ? rtt : min( min_rtt, rtt );
+
+    /* (a datagram sacked was counted as delivered then) */
+    if ( was_sacked ) {
+      rate_sampler.acked_again( packet->delivery, packet->send_timestamp, min_rtt );
+    } else {
+      rate_sampler.acked( packet->delivery, packet->send_timestamp, payload_length,
+			  timestamp_ack_received, min_rtt );
+    }
+  } else {
+    rate_sampler.invalidate();
   }
 
-  // float b = 0.5;
-  // if (after_timeout) {
-  //   cerr << "TIMEOUT" << endl;
-  //   cwnd = cwnd * b;
-  // }
+  lost = lost_since_ack + scoreboard.detect_losses( timestamp_ack_received, min_rtt, srtt );
+  lost_since_ack = 0;
+  inflight = scoreboard.in_flight();
 
-  // cerr << "payload_length = " << payload_length << " btlbw_estimate= " << btlbw_estimate << endl;
-  inflight+=payload_length;
+  return packet != nullptr;
+}
 
-  //TODO: delete?
-  // next_send_time = send_timestamp + payload_length / (pacing_gain * btlbw_estimate);
-  next_send_time = send_timestamp;
-  if (debug_) {
-    cerr << "pacing_gain = " << pacing_gain << "time " << (payload_length / (pacing_gain * btlbw_estimate)) << endl;
-  }
+/* The reordering window of the oldest datagram in flight has passed */
+void Controller::detect_losses()
+{
+  lost_since_ack += scoreboard.detect_losses( now(), min_rtt, srtt );
+  inflight = scoreboard.in_flight();
 }
 
-/* An ack was received 
- * In BBR: Each ack provides new RTT and average delivery rate measurements 
- * that update the RTprop and BtlBw estimates.
- */
-void Controller::ack_received( const uint64_t sequence_number_acked,
-             /* what sequence number was acknowledged */
-             const uint64_t send_timestamp_acked,
-             /* when the acknowledged datagram was sent (sender's clock) */
-             const uint64_t recv_timestamp_acked,
-             /* when the acknowledged datagram was received (receiver's clock)*/
-             const uint64_t timestamp_ack_received, 
-             /* when the ack was received (by sender) */
-             const uint64_t payload_length,
-             /* payload length of message acked */
-             const uint64_t packet_delivered,
-             const uint64_t packet_delivered_time)
+/* A coalesced ack was received. Everything in its ranges, and below its
+   cumulative ack (from above any hole the receiver gave up on), has
+   arrived, including any datagrams whose own acks were lost, so these
+   come out of flight before any loss detection runs, and count as
+   delivered now (their own acks may never come).
+   Then hand each datagram to ack_received().
+   The receiver held it for ack_send_timestamp - recv_timestamp (both by
+   the receiver's clock), so that much comes off its RTT sample: otherwise
+   every datagram but the newest would give an RTT inflated by the ack
+   delay. The ack's arrival time stays as it is, though: back-dated, a
+   burst of acks would give delivery intervals far shorter than the
+   acks really took to come back, and rates far too high. */
+void Controller::acks_received( const CoalescedAck & ack,
+				const uint64_t ack_send_timestamp,
+				const uint64_t timestamp_ack_received )
 {
-  if ( debug_ ) {
-    cerr << "At time " << timestamp_ack_received
-   << " received ack for datagram " << sequence_number_acked
-   << " (send @ time " << send_timestamp_acked
-   << ", received @ time " << recv_timestamp_acked << " by receiver's clock)"
-   << ", payload length = " << payload_length
-   << endl;
+  const auto delivered = [&] ( const Scoreboard::Entry & packet ) {
+    rate_sampler.acked( packet.delivery, packet.send_timestamp, packet.payload_length,
+			timestamp_ack_received, min_rtt );
+  };
+
+  scoreboard.sacked( ack.holes_below, ack.cumulative_ack, delivered );
+  for ( const auto & range : ack.ranges ) {
+    scoreboard.sacked( range.begin, range.end, delivered );
   }
+  inflight = scoreboard.in_flight();
 
-  // cerr << "packet_delivered " << packet_delivered << " packet_delivered_time " << packet_delivered_time << endl;
+  uint64_t previous = 0;
+  for ( const auto & datagram : ack.datagrams ) {
+    previous = unheld_ack_time( datagram, ack_send_timestamp, timestamp_ack_received, previous );
+    ack_delay = timestamp_ack_received - previous;
 
-  inflight-=payload_length;
-  double rtt = timestamp_ack_received - send_timestamp_acked;
-
-  // Calculate new RTprop estimate (min RTT over time window rt_sample_timeout)
-  rt_filter.emplace_back(rtt, timestamp_ack_received);
-  remove_old_samples(rt_filter, timestamp_ack_received, rt_sample_timeout);
-  sample min_rtt_sample = *std::min_element(rt_filter.begin(), rt_filter.end());
-  if (min_rtt_sample.data_point != rt_estimate) {
-    rt_estimate = min_rtt_sample.data_point;
-    rt_estimate_last_updated = timestamp_ack_received;
-  }
-  // TODO deal with no update in 10 seconds, initial estimates
-
-  delivered += payload_length;
-  num_packets_delivered++;
-  delivered_time = timestamp_ack_received;
-  // Calculate new BtlBw estimate
-  double delivery_rate = ((delivered - packet_delivered) / (delivered_time - packet_delivered_time));
-  // cerr << "num packets delivered" << num_packets_delivered << endl;
-  // cerr << "delivered " << delivered << " packet_delivered " << packet_delivered << " delivered_time " << delivered_time << " packet_delivered_time " << packet_delivered_time << endl; 
-  // cerr << "delivered " << (delivered - packet_delivered) << " delivered_time " << (delivered_time - packet_delivered_time)<< endl;
-  btlbw_filter.emplace_back(delivery_rate, timestamp_ack_received);
-  remove_old_samples(btlbw_filter, timestamp_ack_received, btlbw_sample_timeout());
-  sample max_btlbw_sample = *std::max_element(btlbw_filter.begin(), btlbw_filter.end());
-  btlbw_estimate = max_btlbw_sample.data_point;
-
-  cerr << "rt = " << rt_estimate << ", btlbw = " << btlbw_estimate << endl;
-  if (rtt > 250) {
-    cwnd = cwnd * 0.8;
+    ack_received( datagram.sequence_number, datagram.send_timestamp, datagram.recv_timestamp,
+		  timestamp_ack_received, datagram.payload_length, datagram.delivered,
+		  datagram.delivered_time );
   }
 
-  float a = 0.5;
-  num_acks++;
-  if (num_acks >= cwnd/a) {
-    num_acks -= cwnd/a;
-    cwnd += 1;
-  }
+  ack_delay = 0;
 }
 
-/* How long to wait (in milliseconds) if there are no acks
-   before sending one more datagram */
-unsigned int Controller::timeout_ms()
+/* The arrival time of a coalesced ack, less how long the receiver held
+   the datagram (but never before it was sent, or before the one acked
+   before it) */
+uint64_t Controller::unheld_ack_time( const AckedDatagram & datagram,
+				      const uint64_t ack_send_timestamp,
+				      const uint64_t timestamp_ack_received,
+				      const uint64_t previous )
 {
-  return rt_estimate*1.5; 
+  const uint64_t held = ack_send_timestamp > datagram.recv_timestamp
+    ? ack_send_timestamp - datagram.recv_timestamp : 0;
+
+  const uint64_t when = timestamp_ack_received > held ? timestamp_ack_received - held : 0;
+  return min( max( { when, datagram.send_timestamp, previous } ), timestamp_ack_received );
 }
 
-bool Controller::window_is_open()
+/* How long to wait (in microseconds) if there are no acks
+   before sending one more datagram */
+uint64_t Controller::timeout_us()
 {
-  const uint64_t bdp = rt_estimate * btlbw_estimate;
-  unsigned int cwnd = bdp * cwnd_gain;
+  const uint64_t timeout = srtt == 0 ? 1000000 : max( srtt + 4 * rttvar, 200000.0 );
+  const unsigned int backoff = consecutive_timeouts < MAX_TIMEOUT_BACKOFF
+    ? consecutive_timeouts : MAX_TIMEOUT_BACKOFF;
 
-  cerr << "inflight = " << (inflight/1424) << "cwnd = " << (cwnd/1424) << endl;
+  return min( timeout << backoff, MAX_TIMEOUT );
+}
 
-  if (cwnd == 0) {
-    cwnd = 5; 
-  }
-  
-  if (inflight >= cwnd) {
-    return false;
-  }
-  
-  // if (timestamp_ms() < next_send_time) {
-  //   return false;
-  // }
-  return true;
+/* Fill in the controller's fields of a trace event */
+void Controller::trace_state( PacketEvent & event )
+{
+  event.rt_estimate = min_rtt;
+  event.btlbw_estimate = 0;
+  event.inflight = inflight;
+  event.cwnd = window_size();
+  event.pacing_gain = 0;
+  event.state = 0;
 }
 
+uint64_t Controller::get_delivered() {
+  return rate_sampler.delivered();
+}
 
-/* Max time (in milliseconds) a delivery rate sample is valid */
-unsigned int Controller::btlbw_sample_timeout() {
-  unsigned int num_rtts = 8;
-  return num_rtts * rt_estimate;
+uint64_t Controller::get_delivered_time() {
+  return rate_sampler.delivered_time() ? rate_sampler.delivered_time() : now();
 }
 
-/* Removes sample data points that have timed out from a filter */
-void Controller::remove_old_samples(std::vector<sample>& filter, uint64_t time_now, uint64_t timeout) {
-  filter.erase(std::remove_if(filter.begin(), filter.end(), 
-   [time_now, timeout](const sample& s) { 
-    return (time_now - s.time_seen) > timeout; 
-  }), filter.end());
+/* the registry of algorithms, by name */
+typedef function<Controller *()> ControllerFactory;
+
+static const vector<pair<string, ControllerFactory>> & registry()
+{
+  static const vector<pair<string, ControllerFactory>> algorithms = {
+    { BBRController::name(), [] () { return new BBRController(); } },
+    { RenoController::name(), [] () { return new RenoController(); } },
+    { CubicController::name(), [] () { return new CubicController(); } },
+    { VegasController::name(), [] () { return new VegasController(); } },
+  };
+
+  return algorithms;
 }
 
-uint64_t Controller::get_delivered() {
-  return delivered;
+unique_ptr<Controller> Controller::make( const string & name )
+{
+  for ( const auto & algorithm : registry() ) {
+    if ( algorithm.first == name ) {
+      return unique_ptr<Controller>( algorithm.second() );
+    }
+  }
+
+  throw runtime_error( "unknown congestion control algorithm: " + name );
 }
 
-uint64_t Controller::get_delivered_time() {
-  if (delivered_time == 0) {
-    delivered_time = timestamp_ms();
+vector<string> Controller::names()
+{
+  vector<string> ret;
+  for ( const auto & algorithm : registry() ) {
+    ret.push_back( algorithm.first );
   }
-  return delivered_time;
+  return ret;
 }
@@ -2,115 +2,185 @@
 #define CONTROLLER_HH
 
 #include <cstdint>
-#include <vector> 
+#include <memory>
+#include <string>
+#include <vector>
 
-/* Congestion controller interface */
+#include "contest_message.hh"
+#include "packet_trace.hh"
+#include "rate_sampler.hh"
+#include "scoreboard.hh"
+#include "timestamp.hh"
+
+/* Congestion controller interface: each algorithm (BBR, Reno, ...)
+   derives from this class, and the sender picks one by name */
 
 class Controller
 {
-private:
-
-  enum bbr_state {STARTUP, DRAIN, PROBE_BW, PROBE_RTT};
-
-  /* Stores data point of network behavior at a specific time.
-   * EG, rtt of packet or delivery rate. */
-  typedef struct sample {
-    double data_point;
-    uint64_t time_seen;
-
-    sample(double data_point, uint64_t time_seen): data_point(data_point), time_seen(time_seen) {}
-
-    bool operator <(const sample& rhs) {
-      return time_seen < rhs.time_seen;
-    }
-  } sample;
-
-  bool debug_; /* Enables debugging output */
-
-  /* Current state in the BBR FSM */
-  bbr_state state;
-
-  unsigned int num_acks;
-  /* Max time (in milliseconds) an rt sample is valid.
-   * Time windo for RTProp calculation*/
-  unsigned int rt_sample_timeout; 
-  /* All observed RTTs within time window rt_sample_timeout*/
-  std::vector<sample> rt_filter; 
-  /* Current propagation delay (RTprop) estimate */
-  double rt_estimate; 
-
-
-  uint64_t rt_estimate_last_updated; /* Time (in milliseconds) since estimate was updated */
-  unsigned int stale_update_threshold; /* Max time (in milliseconds) an rt estimate can remain the same before we probe for a new estimate */
-
-  /* Max time (in milliseconds) a delivery rate sample is valid */
-  unsigned int btlbw_sample_timeout(); 
-  /* Observed delivery rates within time window btl_bw_sample_timeout() */
-  std::vector<sample> btlbw_filter; 
-  /* Current bottleneck bandwidth estimate >= delivery rate */
-  double btlbw_estimate; 
-  
-
-  unsigned int startup_rounds_without_increase;
-
-  unsigned int cwnd;
-
-  unsigned int num_packets_delivered;
-
-  /* Number of inflight packets */
+protected:
+  /* Number of inflight packets (sent, and neither acked nor taken as lost) */
   unsigned int inflight;
 
-  uint64_t delivered;
-
-  uint64_t delivered_time;
-
-  /* Multiplier of bdp to calculate allowed # inflight packets */
-  double cwnd_gain;
-
-  double pacing_gain;
-
-  uint64_t next_send_time;
-
-  /* Removes samples that have timed out from a filter */
-  static void remove_old_samples(std::vector<sample>& filter, uint64_t time_now, uint64_t timeout); 
+  /* Sequence number after the last one sent */
+  uint64_t next_sequence_number;
+
+  /* Every datagram in flight, for loss detection */
+  Scoreboard scoreboard;
+
+  /* Datagrams taken as lost since the last ack (by detect_losses()) */
+  uint64_t lost_since_ack;
+
+  /* Retransmission timeouts in a row (each doubles the next timeout) */
+  unsigned int consecutive_timeouts;
+
+  /* Bytes delivered so far, when the latest were acked (in microseconds),
+     and the delivery rate sample of the latest ack */
+  RateSampler rate_sampler;
+
+  /* Smoothed RTT, its mean deviation, and the minimum RTT
+     (in microseconds, 0 until there is a sample) */
+  double srtt;
+  double rttvar;
+  double min_rtt;
+
+  /* How long the receiver held the datagram being acked (in microseconds:
+     set by acks_received() for each datagram of a coalesced ack, and 0
+     otherwise). It comes off RTT samples, but not off the time the ack
+     arrived, so delivery rates still see when the acks really came. */
+  uint64_t ack_delay;
+
+  /* The RTT sample of a datagram sent at send_timestamp_acked and acked at
+     timestamp_ack_received (less the receiver's ack delay) */
+  double rtt_sample( const uint64_t send_timestamp_acked,
+		     const uint64_t timestamp_ack_received ) const
+  {
+    return timestamp_ack_received - ack_delay - send_timestamp_acked;
+  }
+
+  /* The clock the controller reads (in microseconds): timestamp_us(),
+     unless a simulation has set a virtual one */
+  const uint64_t * clock_;
+  uint64_t now() const { return clock_ ? *clock_ : timestamp_us(); }
+
+  /* Bookkeeping every algorithm needs: call from datagram_was_sent()
+     and ack_received(). A datagram sent after a timeout means that
+     everything in flight is lost. count_acked() sets lost to how many
+     packets have been taken as lost since the last ack (including by
+     this one), and returns whether the ack is news: only then does it
+     take the ack's RTT and rate samples (see rate_sampler.sample()), and
+     only then should the window grow (a duplicate or stale ack, or one
+     of a datagram long forgotten, says nothing new about the path). */
+  void count_sent( const uint64_t sequence_number,
+		   const uint64_t send_timestamp,
+		   const uint64_t payload_length,
+		   const bool after_timeout );
+  bool count_acked( const uint64_t sequence_number_acked,
+		    const uint64_t send_timestamp_acked,
+		    const uint64_t timestamp_ack_received,
+		    const uint64_t payload_length,
+		    uint64_t & lost );
+
+  Controller();
 
 public:
   /* Public interface for the congestion controller */
 
-  /* Default constructor */
-  Controller( const bool debug );
+  virtual ~Controller() {}
 
   /* Get current window size, in datagrams */
-  unsigned int window_size();
+  virtual unsigned int window_size() = 0;
 
   /* A datagram was sent */
-  void datagram_was_sent( const uint64_t sequence_number,
-			  const uint64_t send_timestamp,
-        const uint64_t payload_length,
-			  const bool after_timeout );
+  virtual void datagram_was_sent( const uint64_t sequence_number,
+				  const uint64_t send_timestamp,
+				  const uint64_t payload_length,
+				  const bool after_timeout ) = 0;
 
   /* An ack was received */
-  void ack_received( const uint64_t sequence_number_acked,
-		     const uint64_t send_timestamp_acked,
-		     const uint64_t recv_timestamp_acked,
-		     const uint64_t timestamp_ack_received,
-         const uint64_t payload_length,
-         const uint64_t packet_delivered,
-         const uint64_t packet_delivered_time);
-
-  /* How long to wait (in milliseconds) if there are no acks
-     before sending one more datagram */
-  unsigned int timeout_ms();
-
-  /* Returns true if inflight packets is < cwnd_gain * bdp */
-  bool window_is_open();
-
-  /* Returns true if time is >= next send time */
-  bool should_send_packet();
+  virtual void ack_received( const uint64_t sequence_number_acked,
+			     const uint64_t send_timestamp_acked,
+			     const uint64_t recv_timestamp_acked,
+			     const uint64_t timestamp_ack_received,
+			     const uint64_t payload_length,
+			     const uint64_t packet_delivered,
+			     const uint64_t packet_delivered_time ) = 0;
+
+  /* A coalesced ack of several datagrams (in the order they arrived)
+     was received: by default, whatever its cumulative ack and SACK
+     ranges show has arrived is sacked first (so that a lost ack
+     doesn't make its datagrams look lost), then each datagram goes to
+     ack_received() in turn, with ack_delay set to how long the
+     receiver held it */
+  virtual void acks_received( const CoalescedAck & ack,
+			      const uint64_t ack_send_timestamp,
+			      const uint64_t timestamp_ack_received );
+
+  /* When a datagram in a coalesced ack would have been acked, had the
+     receiver not held it (no earlier than previous, the time given
+     the datagram before it in the ack) */
+  static uint64_t unheld_ack_time( const AckedDatagram & datagram,
+				   const uint64_t ack_send_timestamp,
+				   const uint64_t timestamp_ack_received,
+				   const uint64_t previous );
+
+  /* How long to wait (in microseconds) if there are no acks
+     before sending one more datagram (by default, the RFC 6298
+     retransmission timeout, but at least 200 ms as in Linux,
+     doubled for each timeout in a row) */
+  virtual uint64_t timeout_us();
+
+  /* The sender has nothing to send, though the window and the pacing
+     rate would allow it (so the next delivery rate samples don't show
+     what the path can do) */
+  void application_limited() { rate_sampler.app_limited( scoreboard.bytes_in_flight() ); }
+
+  /* When detect_losses() should next be called (in microseconds,
+     0 if no datagram is waiting out its reordering window) */
+  uint64_t loss_time() const { return scoreboard.loss_time(); }
+
+  /* Take as lost the datagrams whose reordering window has passed
+     (the algorithm hears about them with the next ack) */
+  void detect_losses();
+
+  /* Keep the sequence numbers of lost datagrams for take_lost()
+     (to retransmit them, or to trace them), and of those sacked
+     for take_sacked() (to forget their data) */
+  void keep_lost( const bool keep ) { scoreboard.keep_lost( keep ); }
+  bool take_lost( uint64_t & sequence_number ) { return scoreboard.take_lost( sequence_number ); }
+  bool take_sacked( uint64_t & sequence_number ) { return scoreboard.take_sacked( sequence_number ); }
+
+  /* Returns true if another packet fits in the window */
+  virtual bool window_is_open() = 0;
+
+  /* Returns true if time is >= next send time (by default,
+     algorithms don't pace, so it always is) */
+  virtual bool should_send_packet() { return true; }
+
+  /* Earliest time (in microseconds) the next datagram may go out */
+  virtual uint64_t next_send_time_us() const { return 0; }
+
+  /* Fill in the controller's fields of a trace event (by default,
+     the window and the minimum RTT) */
+  virtual void trace_state( PacketEvent & event );
+
+  /* Read the time from virtual_now instead of the real clock
+     (nullptr for the real clock again) */
+  void set_clock( const uint64_t * const virtual_now ) { clock_ = virtual_now; }
+
+  /* Datagrams sent, and neither acked nor taken as lost */
+  unsigned int datagrams_in_flight() const { return inflight; }
 
   uint64_t get_delivered();
 
   uint64_t get_delivered_time();
+
+  /* Registry of algorithms: make one by name ("bbr", "reno", "cubic", "vegas") */
+  static std::unique_ptr<Controller> make( const std::string & name );
+  static std::vector<std::string> names();
+
+  /* forbid copying controllers or assigning them */
+  Controller( const Controller & other ) = delete;
+  const Controller & operator=( const Controller & other ) = delete;
 };
 
 #endif
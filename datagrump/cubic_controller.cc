@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cubic_controller.hh"
+#include "log.hh"
+
+using namespace std;
+
+/* Initial and smallest windows (in datagrams) */
+static const double INITIAL_CWND = 10;
+static const double MIN_CWND = 2;
+
+/* RFC 8312's constants: the scaling of the curve, and the multiplicative decrease */
+static const double C = 0.4;
+static const double BETA = 0.7;
+
+CubicController::CubicController()
+  : Controller(), cwnd( INITIAL_CWND ), ssthresh( 1e9 ),
+    w_max( 0 ), k( 0 ), epoch_start( 0 ), recovery_end( 0 )
+{}
+
+/* Get current window size, in datagrams */
+unsigned int CubicController::window_size()
+{
+  return cwnd;
+}
+
+/* multiplicative decrease, starting a new curve */
+void CubicController::reduce()
+{
+  /* fast convergence: if the last curve topped out lower than the one
+     before, release bandwidth to newer flows */
+  w_max = cwnd < w_max ? cwnd * (1 + BETA) / 2 : cwnd;
+
+  cwnd = max( cwnd * BETA, MIN_CWND );
+  ssthresh = cwnd;
+  epoch_start = 0;
+  recovery_end = next_sequence_number;
+}
+
+/* A datagram was sent */
+void CubicController::datagram_was_sent( const uint64_t sequence_number,
+					 const uint64_t send_timestamp,
+					 const uint64_t payload_length,
+					 const bool after_timeout )
+{
+  LOG( Debug, "At time {} sent datagram {} (timeout = {})",
+       send_timestamp, sequence_number, after_timeout );
+
+  count_sent( sequence_number, send_timestamp, payload_length, after_timeout );
+
+  /* a timeout means the whole window was lost: start over from one datagram */
+  if ( after_timeout ) {
+    reduce();
+    cwnd = 1;
+  }
+}
+
+/* An ack was received */
+void CubicController::ack_received( const uint64_t sequence_number_acked,
+				    const uint64_t send_timestamp_acked,
+				    const uint64_t,
+				    const uint64_t timestamp_ack_received,
+				    const uint64_t payload_length,
+				    const uint64_t,
+				    const uint64_t )
+{
+  uint64_t lost;
+  const bool news = count_acked( sequence_number_acked, send_timestamp_acked,
+				 timestamp_ack_received, payload_length, lost );
+
+  if ( lost and sequence_number_acked >= recovery_end ) {
+    reduce();
+  } else if ( not news ) {
+    /* (a duplicate or stale ack doesn't grow the window) */
+  } else if ( cwnd < ssthresh ) {
+    /* slow start: one more datagram per ack */
+    cwnd += 1;
+  } else {
+    if ( epoch_start == 0 ) {
+      epoch_start = timestamp_ack_received;
+      w_max = max( w_max, cwnd );
+      k = cbrt( (w_max - cwnd) / C );
+    }
+
+    /* where the curve will be one RTT from now (in seconds since the epoch) */
+    const double t = (timestamp_ack_received - epoch_start + min_rtt) / 1e6;
+    const double target = w_max + C * pow( t - k, 3 );
+
+    /* the window Reno would have by now, growing at the same average rate */
+    const double reno = w_max * BETA + 3 * (1 - BETA) / (1 + BETA) * (t * 1e6 / srtt);
+
+    if ( reno > target and reno > cwnd ) {
+      cwnd += (reno - cwnd) / cwnd;
+    } else if ( target > cwnd ) {
+      cwnd += (target - cwnd) / cwnd;
+    } else {
+      cwnd += 0.01 / cwnd;
+    }
+  }
+
+  LOG( Debug, "At time {} window is {} (w_max {}, {} lost)",
+       timestamp_ack_received, cwnd, w_max, lost );
+}
+
+bool CubicController::window_is_open()
+{
+  return inflight < window_size();
+}
@@ -0,0 +1,47 @@
+#ifndef CUBIC_CONTROLLER_HH
+#define CUBIC_CONTROLLER_HH
+
+#include "controller.hh"
+
+/* CUBIC (RFC 8312): after a loss, the window grows along a cubic
+   curve in time since the loss, flattening out around the window at
+   which the loss happened, but no slower than Reno would */
+
+class CubicController final : public Controller
+{
+private:
+  double cwnd; /* in datagrams */
+  double ssthresh; /* slow start until cwnd reaches this */
+
+  double w_max; /* window just before the last reduction */
+  double k; /* seconds from the start of the epoch until the curve reaches w_max */
+  uint64_t epoch_start; /* when growth along the current curve began (0 if not yet) */
+  uint64_t recovery_end; /* no further cuts until this sequence number is acked */
+
+  void reduce();
+
+public:
+  /* Name to pick this algorithm by */
+  static std::string name() { return "cubic"; }
+
+  CubicController();
+
+  unsigned int window_size() override;
+
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t payload_length,
+			  const bool after_timeout ) override;
+
+  void ack_received( const uint64_t sequence_number_acked,
+		     const uint64_t send_timestamp_acked,
+		     const uint64_t recv_timestamp_acked,
+		     const uint64_t timestamp_ack_received,
+		     const uint64_t payload_length,
+		     const uint64_t packet_delivered,
+		     const uint64_t packet_delivered_time ) override;
+
+  bool window_is_open() override;
+};
+
+#endif /* CUBIC_CONTROLLER_HH */
@@ -0,0 +1,118 @@
+/* per-ack cost of driving each congestion controller through the
+   Controller interface (virtual calls, as the runtime-selected sender
+   does) against through its final class (direct calls that link-time
+   optimization can inline, as a --with-static-controller sender does) */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "controller.hh"
+#include "bbr_controller.hh"
+#include "reno_controller.hh"
+#include "cubic_controller.hh"
+#include "vegas_controller.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* datagrams in flight, time between acks (in microseconds),
+   and the payload of each datagram */
+static const uint64_t PIPE_DEPTH = 1000;
+static const uint64_t ACK_SPACING = 20;
+static const uint64_t PAYLOAD_LENGTH = 1424;
+
+static const size_t ACKS = 1000000;
+static const unsigned int TRIALS = 5;
+
+/* what the sender stamps on a datagram */
+struct Sent
+{
+  uint64_t send_timestamp, delivered, delivered_time;
+};
+
+/* feed controller a steady stream of acks, each for the datagram sent
+   PIPE_DEPTH datagrams earlier, sending one more after each ack
+   (times are simulated, so the controller sees a 20 ms RTT) */
+template <class ControllerType>
+static double measure( ControllerType & controller )
+{
+  vector<Sent> sent( PIPE_DEPTH );
+  uint64_t now = 0;
+  uint64_t open = 0; /* keeps the window checks from being optimized away */
+
+  auto send = [&] ( const uint64_t sequence_number ) {
+    sent[ sequence_number % PIPE_DEPTH ] = { now, controller.get_delivered(),
+					     controller.get_delivered_time() };
+    controller.datagram_was_sent( sequence_number, now, PAYLOAD_LENGTH, false );
+  };
+
+  for ( uint64_t i = 0; i < PIPE_DEPTH; i++ ) {
+    send( i );
+  }
+
+  const uint64_t start = timestamp_ns();
+  for ( uint64_t i = PIPE_DEPTH; i < PIPE_DEPTH + ACKS; i++ ) {
+    now += ACK_SPACING;
+
+    const uint64_t acked = i - PIPE_DEPTH;
+    const Sent & datagram = sent[ acked % PIPE_DEPTH ];
+    controller.ack_received( acked, datagram.send_timestamp,
+			     datagram.send_timestamp + PIPE_DEPTH * ACK_SPACING / 2,
+			     now, PAYLOAD_LENGTH,
+			     datagram.delivered, datagram.delivered_time );
+
+    open += controller.window_is_open() and controller.should_send_packet();
+    send( i );
+  }
+  const uint64_t elapsed = timestamp_ns() - start;
+
+  return double( elapsed ) / ACKS + (open == 0 ? 1e-9 : 0);
+}
+
+/* best of a few trials, each with a new controller */
+template <class Factory>
+static double best_of( Factory make )
+{
+  double best = 0;
+  for ( unsigned int trial = 0; trial < TRIALS; trial++ ) {
+    auto controller = make();
+    const double ns = measure( *controller );
+    best = (trial == 0 or ns < best) ? ns : best;
+  }
+  return best;
+}
+
+template <class ControllerType>
+static void compare()
+{
+  const double dynamic_ns = best_of( [] () {
+      return Controller::make( ControllerType::name() ); } );
+  const double static_ns = best_of( [] () {
+      return unique_ptr<ControllerType>( new ControllerType() ); } );
+
+  cout << ControllerType::name() << "\t\t" << dynamic_ns
+       << "\t\t\t" << static_ns << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "algorithm\tdynamic ns/ack\t\tstatic ns/ack" << endl;
+
+  compare<BBRController>();
+  compare<RenoController>();
+  compare<CubicController>();
+  compare<VegasController>();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include "emulated_link.hh"
+
+using namespace std;
+
+void EmulatedLinkBase::load_trace( const string & filename, Config & config )
+{
+  ifstream trace( filename );
+  if ( not trace ) {
+    throw runtime_error( "can't read trace " + filename );
+  }
+
+  config.opportunities.clear();
+  uint64_t ms;
+  while ( trace >> ms ) {
+    if ( not config.opportunities.empty() and 1000 * ms < config.opportunities.back() ) {
+      throw runtime_error( filename + ": trace times must not decrease" );
+    }
+    config.opportunities.push_back( 1000 * ms );
+  }
+
+  if ( not trace.eof() ) {
+    throw runtime_error( filename + ": not a trace (expected a time in ms on each line)" );
+  }
+
+  if ( config.opportunities.empty() or config.opportunities.back() == 0 ) {
+    throw runtime_error( filename + ": trace must end after time 0" );
+  }
+
+  config.period = config.opportunities.back();
+}
+
+void EmulatedLinkBase::constant_rate( const double mbps, Config & config )
+{
+  /* a second's worth of evenly spaced opportunities */
+  const uint64_t count = max( 1.0, mbps * 1e6 / 8 / MTU );
+
+  config.opportunities.clear();
+  for ( uint64_t i = 1; i <= count; i++ ) {
+    config.opportunities.push_back( i * 1000000 / count );
+  }
+  config.period = 1000000;
+}
+
+/* nearest-rank percentile (in milliseconds) of times in microseconds */
+static double percentile_ms( vector<uint64_t> values, const double p )
+{
+  if ( values.empty() ) {
+    return 0;
+  }
+
+  sort( values.begin(), values.end() );
+  const size_t rank = max( size_t( 1 ), size_t( p / 100 * values.size() + 0.999999 ) );
+  return values[ rank - 1 ] / 1000.0;
+}
+
+/* as mm-throughput-graph does: throughput against the capacity the trace
+   offered, and delay percentiles. The signal delay is sampled every
+   millisecond: how long ago the newest datagram through the link by
+   then had arrived (so it grows while the link sits idle). */
+EmulatedLinkBase::Summary EmulatedLinkBase::summarize( const Statistics & statistics,
+						       const uint64_t delay,
+						       const uint64_t start, const uint64_t end )
+{
+  Summary summary;
+  const double duration = end > start ? end - start : 1;
+
+  summary.capacity = 8 * statistics.capacity_bytes / duration;
+  summary.throughput = 8 * statistics.delivered_bytes / duration;
+  summary.queueing_delay = percentile_ms( statistics.queueing_delays, 95 );
+
+  const auto & departures = statistics.departure_times;
+  const auto & queueing_delays = statistics.queueing_delays;
+  vector<uint64_t> signal_delays;
+  if ( not departures.empty() ) {
+    size_t next = 0;
+    uint64_t newest_arrival = 0;
+    for ( uint64_t t = departures.front(); t < end; t += 1000 ) {
+      while ( next < departures.size() and departures[ next ] <= t ) {
+	newest_arrival = departures[ next ] - queueing_delays[ next ];
+	next++;
+      }
+      signal_delays.push_back( t - newest_arrival );
+    }
+  }
+
+  summary.signal_delay = percentile_ms( move( signal_delays ), 95 );
+  summary.one_way_delay = summary.signal_delay + delay / 1000.0;
+
+  return summary;
+}
@@ -0,0 +1,351 @@
+#ifndef EMULATED_LINK_HH
+#define EMULATED_LINK_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "util.hh"
+
+/* What every emulated link shares, whatever it carries: its
+   configuration, how to load a trace, and what it measured */
+class EmulatedLinkBase
+{
+public:
+  /* bytes one delivery opportunity can carry */
+  static const unsigned int MTU = 1504;
+
+  /* bytes of IPv4 and UDP header around each datagram's payload */
+  static const unsigned int HEADER_OVERHEAD = 28;
+
+  /* the downlink's rate (in Mbit/s), unless given: fast enough never to hold up an ack */
+  static const unsigned int DEFAULT_DOWNLINK_MBPS = 1000;
+
+  struct Config
+  {
+    std::vector<uint64_t> opportunities {}; /* one period of the trace, from 0 */
+    uint64_t period = 0; /* the trace repeats after this long */
+    uint64_t delay = 0; /* one-way propagation delay */
+    double loss = 0; /* probability each datagram is lost */
+    uint64_t queue_packets = 0; /* drop-tail limits (0 for unlimited) */
+    uint64_t queue_bytes = 0;
+  };
+
+  /* load a mahimahi trace: one line per delivery opportunity, each a
+     time in milliseconds (the trace repeats after the last one) */
+  static void load_trace( const std::string & filename, Config & config );
+
+  /* or a constant rate, in megabits per second */
+  static void constant_rate( const double mbps, Config & config );
+
+  struct Statistics
+  {
+    uint64_t arrived = 0, lost = 0, dropped = 0, delivered = 0; /* datagrams */
+    uint64_t delivered_bytes = 0, capacity_bytes = 0;
+    std::vector<uint64_t> queueing_delays {}; /* of each delivered datagram */
+    std::vector<uint64_t> departure_times {}; /* (in the same order) */
+  };
+
+  /* what mm-throughput-graph reports of a link's log, between start and end */
+  struct Summary
+  {
+    double capacity = 0, throughput = 0; /* in Mbit/s */
+    double queueing_delay = 0; /* 95th percentile per-packet, in ms */
+    double signal_delay = 0; /* 95th percentile, in ms */
+    double one_way_delay = 0; /* signal delay plus propagation delay, in ms */
+
+    /* throughput over delay (in Mbit/s per second of one-way delay,
+       so that a link without a queue doesn't score infinity) */
+    double power() const { return one_way_delay > 0 ? throughput / (one_way_delay / 1000) : 0; }
+  };
+
+  static Summary summarize( const Statistics & statistics, const uint64_t delay,
+			    const uint64_t start, const uint64_t end );
+};
+
+/* the link's size of each thing it carries (as a datagram's UDP payload) */
+inline uint64_t payload_size( const std::string & payload ) { return payload.size(); }
+
+/* One direction of an emulated link, after mahimahi's mm-loss, mm-link
+   and mm-delay in that order. Each arriving datagram may be lost at
+   random. Otherwise it waits in a drop-tail queue for the trace's
+   delivery opportunities (each one can carry MTU bytes, and a datagram
+   may use up several). It then spends a fixed propagation delay on the
+   wire. All times are in microseconds, on the same clock as
+   timestamp_us() (or, in a simulation, on its virtual clock).
+
+   Payload is what the link carries: the datagram itself, or (in a
+   simulation) just what's needed to stand in for one, as long as
+   payload_size( payload ) gives its size. */
+template <class Payload>
+class BasicEmulatedLink : public EmulatedLinkBase
+{
+private:
+  struct Packet
+  {
+    uint64_t arrival_time;
+    Payload payload;
+  };
+
+  struct InFlight
+  {
+    uint64_t release_time;
+    Payload payload;
+  };
+
+  Config config_;
+  std::default_random_engine prng_;
+  std::bernoulli_distribution loss_;
+
+  uint64_t base_time_; /* when the trace started */
+  uint64_t now_; /* how far the link has run */
+  uint64_t trace_periods_; /* how many times it has repeated */
+  size_t next_opportunity_; /* index into config_.opportunities */
+
+  std::deque<Packet> queue_;
+  uint64_t queue_bytes_;
+  unsigned int head_bytes_left_; /* of the datagram at the head of the queue */
+
+  std::deque<InFlight> wire_;
+
+  Statistics statistics_;
+
+  /* mahimahi-style log of arrivals, opportunities, departures and drops */
+  FileDescriptor * log_;
+  std::string log_buffer_;
+
+  void log_event( const uint64_t time, const char type, const uint64_t bytes,
+		  const uint64_t delay = uint64_t( -1 ) );
+
+  uint64_t next_opportunity_time() const
+  {
+    return base_time_ + trace_periods_ * config_.period + config_.opportunities[ next_opportunity_ ];
+  }
+
+  /* serve the queue at one delivery opportunity */
+  void deliver( const uint64_t time );
+
+public:
+  BasicEmulatedLink( const Config & config, const uint64_t start_time,
+		     const unsigned int seed, FileDescriptor * const log = nullptr,
+		     const std::string & log_description = "" );
+  ~BasicEmulatedLink();
+
+  /* run the link up to now (call before arrive() with the same time) */
+  void advance( const uint64_t now );
+
+  /* a datagram entered the link at arrival_time */
+  void arrive( const uint64_t arrival_time, Payload && payload );
+
+  /* datagrams that have crossed the link by now, in order */
+  bool ready( const uint64_t now ) const
+  {
+    return not wire_.empty() and wire_.front().release_time <= now;
+  }
+
+  Payload take()
+  {
+    Payload payload = std::move( wire_.front().payload );
+    wire_.pop_front();
+    return payload;
+  }
+
+  /* earliest time at which the link will have something to do
+     (uint64_t( -1 ) if it's idle) */
+  uint64_t next_event() const;
+
+  const Statistics & statistics() const { return statistics_; }
+
+  /* write out the buffered log */
+  void flush_log();
+
+  /* forbid copying or assigning */
+  BasicEmulatedLink( const BasicEmulatedLink & other ) = delete;
+  const BasicEmulatedLink & operator=( const BasicEmulatedLink & other ) = delete;
+};
+
+/* the link in front of real sockets, carrying whole datagrams */
+typedef BasicEmulatedLink<std::string> EmulatedLink;
+
+template <class Payload>
+BasicEmulatedLink<Payload>::BasicEmulatedLink( const Config & config, const uint64_t start_time,
+					       const unsigned int seed, FileDescriptor * const log,
+					       const std::string & log_description )
+  : config_( config ),
+    prng_( seed ),
+    loss_( config.loss ),
+    base_time_( start_time ),
+    now_( start_time ),
+    trace_periods_( 0 ),
+    next_opportunity_( 0 ),
+    queue_(),
+    queue_bytes_( 0 ),
+    head_bytes_left_( 0 ),
+    wire_(),
+    statistics_(),
+    log_( log ),
+    log_buffer_()
+{
+  if ( config_.opportunities.empty() or config_.period == 0 ) {
+    throw std::runtime_error( "EmulatedLink: empty trace" );
+  }
+
+  if ( log_ ) {
+    log_buffer_ = "# datagrump link-emulator " + log_description + "\n"
+      + "# queue: droptail [packets=" + std::to_string( config_.queue_packets )
+      + ", bytes=" + std::to_string( config_.queue_bytes ) + "] (0 is unlimited)\n"
+      + "# delay: " + std::to_string( config_.delay / 1000 ) + " ms, loss: "
+      + std::to_string( config_.loss ) + "\n"
+      + "# base timestamp: 0\n";
+  }
+}
+
+template <class Payload>
+BasicEmulatedLink<Payload>::~BasicEmulatedLink()
+{
+  try {
+    flush_log();
+  } catch ( const std::exception & e ) { /* don't throw from destructor */
+    print_exception( e );
+  }
+}
+
+/* one line per event, as mm-link writes them: "time + bytes" (arrival),
+   "time # bytes" (opportunity), "time - bytes delay" (departure),
+   "time d bytes" (drop), with times in milliseconds */
+template <class Payload>
+void BasicEmulatedLink<Payload>::log_event( const uint64_t time, const char type,
+					    const uint64_t bytes, const uint64_t delay )
+{
+  if ( not log_ ) {
+    return;
+  }
+
+  log_buffer_ += std::to_string( (time - base_time_) / 1000 );
+  log_buffer_ += ' ';
+  log_buffer_ += type;
+  log_buffer_ += ' ';
+  log_buffer_ += std::to_string( bytes );
+  if ( delay != uint64_t( -1 ) ) {
+    log_buffer_ += ' ';
+    log_buffer_ += std::to_string( delay / 1000 );
+  }
+  log_buffer_ += '\n';
+
+  if ( log_buffer_.size() >= 1 << 16 ) {
+    flush_log();
+  }
+}
+
+template <class Payload>
+void BasicEmulatedLink<Payload>::flush_log()
+{
+  if ( log_ and not log_buffer_.empty() ) {
+    log_->write( log_buffer_ );
+    log_buffer_.clear();
+  }
+}
+
+/* serve the queue at one delivery opportunity: it carries up to MTU
+   bytes, and a datagram too big for what's left carries over to the next */
+template <class Payload>
+void BasicEmulatedLink<Payload>::deliver( const uint64_t time )
+{
+  unsigned int bytes_left = MTU;
+  statistics_.capacity_bytes += MTU;
+  log_event( time, '#', MTU );
+
+  while ( bytes_left > 0 and not queue_.empty() ) {
+    if ( head_bytes_left_ > bytes_left ) {
+      head_bytes_left_ -= bytes_left;
+      break;
+    }
+
+    bytes_left -= head_bytes_left_;
+
+    Packet & packet = queue_.front();
+    const uint64_t size = payload_size( packet.payload ) + HEADER_OVERHEAD;
+    const uint64_t queueing_delay = time - packet.arrival_time;
+
+    log_event( time, '-', size, queueing_delay );
+    statistics_.delivered++;
+    statistics_.delivered_bytes += size;
+    statistics_.queueing_delays.push_back( queueing_delay );
+    statistics_.departure_times.push_back( time );
+
+    queue_bytes_ -= size;
+    wire_.push_back( { time + config_.delay, std::move( packet.payload ) } );
+    queue_.pop_front();
+
+    head_bytes_left_ = queue_.empty() ? 0 : payload_size( queue_.front().payload ) + HEADER_OVERHEAD;
+  }
+}
+
+template <class Payload>
+void BasicEmulatedLink<Payload>::advance( const uint64_t now )
+{
+  now_ = std::max( now_, now );
+
+  /* every opportunity up to now (even idle ones, which count toward capacity) */
+  while ( next_opportunity_time() <= now ) {
+    deliver( next_opportunity_time() );
+
+    next_opportunity_++;
+    if ( next_opportunity_ == config_.opportunities.size() ) {
+      next_opportunity_ = 0;
+      trace_periods_++;
+    }
+  }
+}
+
+template <class Payload>
+void BasicEmulatedLink<Payload>::arrive( const uint64_t arrival_time, Payload && payload )
+{
+  /* (a datagram stamped before the link's clock arrives now) */
+  const uint64_t now = std::max( arrival_time, now_ );
+  const uint64_t size = payload_size( payload ) + HEADER_OVERHEAD;
+  statistics_.arrived++;
+
+  if ( config_.loss > 0 and loss_( prng_ ) ) {
+    statistics_.lost++;
+    return;
+  }
+
+  if ( (config_.queue_packets and queue_.size() >= config_.queue_packets)
+       or (config_.queue_bytes and queue_bytes_ + size > config_.queue_bytes) ) {
+    statistics_.dropped++;
+    log_event( now, 'd', size );
+    return;
+  }
+
+  log_event( now, '+', size );
+
+  if ( queue_.empty() ) {
+    head_bytes_left_ = size;
+  }
+  queue_.push_back( { now, std::move( payload ) } );
+  queue_bytes_ += size;
+}
+
+template <class Payload>
+uint64_t BasicEmulatedLink<Payload>::next_event() const
+{
+  uint64_t next = uint64_t( -1 );
+
+  if ( not wire_.empty() ) {
+    next = wire_.front().release_time;
+  }
+
+  if ( not queue_.empty() ) {
+    next = std::min( next, next_opportunity_time() );
+  }
+
+  return next;
+}
+
+#endif /* EMULATED_LINK_HH */
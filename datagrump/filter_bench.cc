@@ -0,0 +1,95 @@
+/* per-ack cost of keeping a windowed min RTT, as the window grows:
+   the vector the controller used to keep (erase the expired samples,
+   then scan for the min) against WindowedMinFilter */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "timestamp.hh"
+#include "windowed_filter.hh"
+
+using namespace std;
+
+/* a sample as the controller used to store it */
+struct Sample
+{
+  double value;
+  uint64_t time;
+};
+
+/* the old way: O(samples in the window) per ack */
+class VectorMinFilter
+{
+private:
+  vector<Sample> samples_ {};
+
+public:
+  double update( const double value, const uint64_t time, const uint64_t window )
+  {
+    samples_.push_back( { value, time } );
+    samples_.erase( remove_if( samples_.begin(), samples_.end(),
+			       [&] ( const Sample & s ) { return time - s.time > window; } ),
+		    samples_.end() );
+    return min_element( samples_.begin(), samples_.end(),
+			[] ( const Sample & a, const Sample & b ) { return a.value < b.value; } )->value;
+  }
+};
+
+/* feed acks one time unit apart through filter, in nanoseconds per ack */
+template <class FilterType>
+static double measure( FilterType & filter, const vector<double> & rtts,
+		       const uint64_t window, const size_t acks )
+{
+  double sum = 0; /* keeps the updates from being optimized away */
+
+  const uint64_t start = timestamp_ns();
+  for ( size_t i = 0; i < acks; i++ ) {
+    sum += filter.update( rtts[ i % rtts.size() ], i, window );
+  }
+  const uint64_t elapsed = timestamp_ns() - start;
+
+  return double( elapsed ) / acks + (sum == 0 ? 1e-9 : 0);
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << endl;
+    return EXIT_FAILURE;
+  }
+
+  /* RTTs of 20 ms plus jitter, in microseconds */
+  default_random_engine prng( 1 );
+  exponential_distribution<double> jitter( 1.0 / 2000 );
+  vector<double> rtts( 1 << 16 );
+  for ( auto & rtt : rtts ) {
+    rtt = 20000 + jitter( prng );
+  }
+
+  cout << "samples in window\tvector ns/ack\tWindowedMinFilter ns/ack" << endl;
+
+  for ( uint64_t window = 100; window <= 1000000; window *= 10 ) {
+    WindowedMinFilter<double> new_filter;
+    const double new_ns = measure( new_filter, rtts, window, max( 4 * window, uint64_t( 1000000 ) ) );
+
+    /* give the vector two windows' worth of acks (the second at full size),
+       unless that would take too long */
+    cout << window << "\t\t\t";
+    if ( window <= 10000 ) {
+      VectorMinFilter old_filter;
+      cout << measure( old_filter, rtts, window, 2 * window );
+    } else {
+      cout << "(skipped)";
+    }
+    cout << "\t\t" << new_ns << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
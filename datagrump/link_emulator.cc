@@ -0,0 +1,241 @@
+/* trace-driven link emulator, standing in for mahimahi's mm-delay and
+   mm-link: datagrums sent to PORT cross an emulated uplink to the
+   receiver, and its acks cross an emulated downlink back */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "emulated_link.hh"
+#include "log.hh"
+#include "poller.hh"
+#include "socket.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* most datagrams to receive with one system call */
+static const size_t RECV_BATCH_SIZE = 64;
+
+/* send every datagram that has crossed link, with one system call */
+static void forward( EmulatedLink & link, const uint64_t now,
+		     UDPSocket & socket, const Address & destination )
+{
+  vector<string> payloads;
+  while ( link.ready( now ) ) {
+    payloads.push_back( link.take() );
+  }
+
+  if ( payloads.empty() ) {
+    return;
+  }
+
+  vector<UDPSocket::gathered_datagram> datagrams;
+  for ( const auto & payload : payloads ) {
+    datagrams.push_back( { payload.data(), payload.size(), nullptr, 0, &destination } );
+  }
+
+  socket.send_batch( datagrams );
+}
+
+static void print_summary( const EmulatedLink & uplink, const uint64_t delay,
+			   const uint64_t start, const uint64_t end )
+{
+  const auto & stats = uplink.statistics();
+  const auto summary = EmulatedLink::summarize( stats, delay, start, end );
+
+  cerr << "Uplink over " << (end - start) / 1e6 << " s:" << endl
+       << "  Average capacity: " << summary.capacity << " Mbits/s" << endl
+       << "  Average throughput: " << summary.throughput << " Mbits/s ("
+       << 100.0 * stats.delivered_bytes / max( stats.capacity_bytes, uint64_t( 1 ) )
+       << "% utilization)" << endl
+       << "  95th percentile per-packet queueing delay: " << summary.queueing_delay << " ms" << endl
+       << "  95th percentile signal delay: " << summary.signal_delay << " ms" << endl
+       << "  95th percentile one-way delay: " << summary.one_way_delay << " ms" << endl
+       << "  Power: " << summary.power() << " Mbits/s per second of delay" << endl
+       << "  Datagrams: " << stats.arrived << " arrived, " << stats.lost << " lost at random, "
+       << stats.dropped << " dropped by the queue, " << stats.delivered << " delivered" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  try {
+    EmulatedLink::Config uplink_config, downlink_config;
+    EmulatedLink::constant_rate( EmulatedLink::DEFAULT_DOWNLINK_MBPS, downlink_config );
+
+    string uplink_log_filename;
+    uint64_t duration = 0; /* in microseconds (0 to run until interrupted) */
+    bool once = false;
+    bool usage_ok = argc >= 4;
+
+    for ( int i = 4; usage_ok and i < argc; i++ ) {
+      const string arg( argv[ i ] );
+      const size_t equals = arg.find( '=' );
+      const string name = arg.substr( 0, equals );
+      const string value = equals == string::npos ? "" : arg.substr( equals + 1 );
+
+      if ( name == "--uplink" ) {
+	EmulatedLink::load_trace( value, uplink_config );
+      } else if ( name == "--uplink-rate" ) {
+	EmulatedLink::constant_rate( stod( value ), uplink_config );
+      } else if ( name == "--downlink" ) {
+	EmulatedLink::load_trace( value, downlink_config );
+      } else if ( name == "--downlink-rate" ) {
+	EmulatedLink::constant_rate( stod( value ), downlink_config );
+      } else if ( name == "--delay" ) {
+	uplink_config.delay = downlink_config.delay = 1000 * stod( value );
+      } else if ( name == "--loss" ) {
+	uplink_config.loss = stod( value );
+      } else if ( name == "--downlink-loss" ) {
+	downlink_config.loss = stod( value );
+      } else if ( name == "--queue-packets" ) {
+	uplink_config.queue_packets = stoull( value );
+      } else if ( name == "--queue-bytes" ) {
+	uplink_config.queue_bytes = stoull( value );
+      } else if ( name == "--uplink-log" ) {
+	uplink_log_filename = value;
+      } else if ( name == "--duration" ) {
+	duration = 1e6 * stod( value );
+      } else if ( arg == "--once" ) {
+	once = true;
+      } else {
+	usage_ok = false;
+      }
+    }
+
+    if ( uplink_config.opportunities.empty() ) {
+      usage_ok = false;
+    }
+
+    if ( not usage_ok ) {
+      cerr << "Usage: " << argv[ 0 ] << " PORT RECEIVER_HOST RECEIVER_PORT"
+	   << " --uplink=TRACE|--uplink-rate=MBPS [--downlink=TRACE|--downlink-rate=MBPS]"
+	   << " [--delay=MS] [--loss=RATE] [--downlink-loss=RATE]"
+	   << " [--queue-packets=N] [--queue-bytes=N] [--uplink-log=FILE]"
+	   << " [--duration=SECONDS] [--once]" << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* with --once, stop when the uplink trace runs out */
+    if ( once and (duration == 0 or duration > uplink_config.period) ) {
+      duration = uplink_config.period;
+    }
+
+    /* the sender's side, and the receiver's side */
+    UDPSocket sender_socket, receiver_socket;
+    sender_socket.set_timestamps();
+    receiver_socket.set_timestamps();
+    sender_socket.bind( Address( "0", argv[ 1 ] ) );
+    const Address receiver_address( argv[ 2 ], argv[ 3 ] );
+    Address sender_address;
+    bool sender_known = false;
+
+    unique_ptr<FileDescriptor> uplink_log;
+    if ( not uplink_log_filename.empty() ) {
+      uplink_log.reset( new FileDescriptor( SystemCall( "open " + uplink_log_filename,
+							open( uplink_log_filename.c_str(),
+							      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+							      0644 ) ) ) );
+    }
+
+    /* stop (and report) on SIGINT or SIGTERM */
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGINT );
+    sigaddset( &signals, SIGTERM );
+    SystemCall( "sigprocmask", sigprocmask( SIG_BLOCK, &signals, nullptr ) );
+    FileDescriptor signal_fd( SystemCall( "signalfd", signalfd( -1, &signals, SFD_CLOEXEC ) ) );
+
+    const uint64_t start = timestamp_us();
+    EmulatedLink uplink( uplink_config, start, 1, uplink_log.get(),
+			 "uplink to " + receiver_address.to_string() );
+    EmulatedLink downlink( downlink_config, start, 2 );
+
+    LOG( Info, "Emulating a link from port {} to {}", argv[ 1 ], receiver_address.to_string() );
+
+    Poller poller;
+
+    poller.add_action( Action( sender_socket, Direction::In, [&] () {
+	  for ( auto & recd : sender_socket.recv_batch( RECV_BATCH_SIZE ) ) {
+	    sender_address = recd.source_address;
+	    sender_known = true;
+	    uplink.advance( recd.timestamp );
+	    uplink.arrive( recd.timestamp, move( recd.payload ) );
+	  }
+	  return ResultType::Continue;
+	} ) );
+
+    poller.add_action( Action( receiver_socket, Direction::In, [&] () {
+	  for ( auto & recd : receiver_socket.recv_batch( RECV_BATCH_SIZE ) ) {
+	    downlink.advance( recd.timestamp );
+	    downlink.arrive( recd.timestamp, move( recd.payload ) );
+	  }
+	  return ResultType::Continue;
+	} ) );
+
+    poller.add_action( Action( signal_fd, Direction::In, [&] () {
+	  return ResultType::Exit;
+	} ) );
+
+    if ( duration ) {
+      poller.add_timer( start + duration, [&] () { return ResultType::Exit; } );
+    }
+
+    /* wakes the poller for the links' next delivery or release */
+    bool wakeup_armed = false;
+    uint64_t wakeup_time = 0;
+    Poller::TimerId wakeup_timer = 0;
+
+    while ( true ) {
+      const uint64_t now = timestamp_us();
+      uplink.advance( now );
+      downlink.advance( now );
+
+      forward( uplink, now, receiver_socket, receiver_address );
+      if ( sender_known ) {
+	forward( downlink, now, sender_socket, sender_address );
+      }
+
+      const uint64_t next = min( uplink.next_event(), downlink.next_event() );
+      if ( next != uint64_t( -1 ) ) {
+	if ( not wakeup_armed ) {
+	  wakeup_timer = poller.add_timer( next, [&] () {
+	      wakeup_armed = false;
+	      return ResultType::Continue;
+	    } );
+	  wakeup_armed = true;
+	  wakeup_time = next;
+	} else if ( next < wakeup_time ) {
+	  poller.rearm_timer( wakeup_timer, next );
+	  wakeup_time = next;
+	}
+      }
+
+      if ( poller.poll( -1 ).result == PollResult::Exit ) {
+	break;
+      }
+    }
+
+    const uint64_t end = timestamp_us();
+    uplink.advance( end );
+    print_summary( uplink, uplink_config.delay, start, end );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/* cost per LOG statement at the call site, with numbers, with a short
+   string, and with several strings too long for one record (which are
+   truncated to what fits) -- then a flush, which must write them all */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_descriptor.hh"
+#include "log.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* statements per measurement */
+static const unsigned int CALLS = 1000000;
+
+/* time CALLS statements, in nanoseconds per statement */
+template <class StatementType>
+static void measure( const string & name, const StatementType & statement )
+{
+  timespec start, end;
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &start ) );
+  for ( unsigned int i = 0; i < CALLS; i++ ) {
+    statement( i );
+  }
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &end ) );
+
+  const double elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  cout << name << ": " << elapsed_ns / CALLS << " ns per statement" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << endl;
+    return EXIT_FAILURE;
+  }
+
+  const string long_a( 45, 'a' ), long_b( 20, 'b' ), long_c( 30, 'c' );
+
+  /* one record with more string than fits, written out for a look */
+  LOG( Warning, "truncated: {} {} {} {}", long_a, long_b, long_c, 42 );
+  Log::flush();
+
+  /* the rest go to /dev/null, so that the drain thread's writes cost little */
+  FileDescriptor null( SystemCall( "open /dev/null", open( "/dev/null", O_WRONLY ) ) );
+  FileDescriptor saved_stderr( SystemCall( "dup", dup( STDERR_FILENO ) ) );
+  SystemCall( "dup2", dup2( null.fd_num(), STDERR_FILENO ) );
+
+  measure( "numbers", [] ( const unsigned int i ) {
+      LOG( Warning, "datagram {} sent at {} ({} in flight)", i, 1.5 * i, 7 );
+    } );
+  measure( "short string", [] ( const unsigned int i ) {
+      LOG( Warning, "{} {}", "sent", i );
+    } );
+  measure( "long strings", [&] ( const unsigned int i ) {
+      LOG( Warning, "{} {} {} {} {}", long_a, long_b, long_c, long_a, i );
+    } );
+
+  Log::flush();
+
+  SystemCall( "dup2", dup2( saved_stderr.fd_num(), STDERR_FILENO ) );
+  cout << Log::dropped() << " records dropped (ring full)" << endl;
+
+  return EXIT_SUCCESS;
+}
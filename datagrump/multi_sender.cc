@@ -0,0 +1,501 @@
+/* UDP sender of many concurrent flows from one process: each flow has
+   its own congestion controller, all of them share one event loop (and
+   one or a few sockets), and each ack finds its flow by the flow id in
+   its header */
+
+#include <signal.h>
+#include <sys/signalfd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "socket.hh"
+#include "contest_message.hh"
+#include "controller.hh"
+#include "bbr_controller.hh"
+#include "reno_controller.hh"
+#include "cubic_controller.hh"
+#include "vegas_controller.hh"
+#include "log.hh"
+#include "poller.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* most acks to receive with one system call */
+static const size_t RECV_BATCH_SIZE = 64;
+
+/* packet buffers for the acks (a batch, with room to spare) */
+static const size_t PACKET_POOL_SIZE = 2 * RECV_BATCH_SIZE;
+
+/* most datagrams to send with one system call */
+static const size_t SEND_BATCH_SIZE = 64;
+
+/* Many flows of one algorithm (ControllerType, a final class, so the
+   controllers are stored by value, side by side, and called directly).
+   The sender's own per-flow state is kept as a structure of arrays,
+   so that scheduling touches only the fields it needs. The controllers
+   themselves stay whole objects, though: a flow's window, pacing time,
+   in-flight count and RTTs are read and written together, one flow at
+   a time, so kept in the one object they share cache lines, where in
+   parallel arrays each would cost a line of its own. (Arrays pay off
+   for scans over many flows, and nothing here scans them.)
+
+   Nothing scans the flows: a flow that may be able to send waits in
+   its socket's ready queue, and each turn sends one datagram from the
+   flow at the front. A flow whose window is closed leaves the queue
+   (when it comes to the front) until an ack reopens it; one held back
+   by its pacing rate leaves it until its pacing timer fires. */
+template <class ControllerType>
+class MultiFlowSender
+{
+private:
+  /* flow i goes through socket i % sockets_.size() */
+  std::vector<std::unique_ptr<UDPSocket>> sockets_;
+
+  /* per-flow state (indexed by flow id) */
+  std::vector<ControllerType> controllers_;
+  std::vector<uint64_t> sequence_numbers_; /* next outgoing sequence number */
+  std::vector<uint64_t> acked_bytes_;
+  std::vector<Poller::TimerId> loss_detection_timers_;
+  std::vector<uint8_t> queued_; /* in its socket's ready queue */
+  std::vector<uint8_t> pacing_armed_; /* waiting for its pacing timer */
+
+  /* for each socket, the flows that may be able to send, in turn */
+  std::vector<std::deque<uint32_t>> ready_;
+
+  /* datagrams staged to go out with the next flush(),
+     with their headers serialized in place in header_buffers_ */
+  std::vector<char> header_buffers_;
+  std::vector<UDPSocket::gathered_datagram> outgoing_;
+
+  /* the acks received last, in buffers from the pool
+     (kept to reuse their storage) */
+  PacketPool pool_;
+  std::vector<UDPSocket::received_packet> acks_;
+
+  /* the last ack of several datagrams (kept to reuse its storage) */
+  CoalescedAck coalesced_ack_;
+
+  /* datagrams dropped for not being well-formed acks */
+  uint64_t malformed_;
+
+  Poller poller_;
+
+  size_t socket_of( const uint32_t flow ) const { return flow % sockets_.size(); }
+
+  void make_ready( const uint32_t flow );
+  void arm_pacing_timer( const uint32_t flow );
+  void stage_datagram( const uint32_t flow, const bool after_timeout );
+  void flush( const size_t socket );
+  bool can_send( const uint32_t flow );
+  bool has_ready( const size_t socket );
+  void send_ready( const size_t socket );
+  void drop_malformed( const char * const what );
+  void got_ack( const uint64_t timestamp, const ContestMessageView & ack );
+  uint64_t loss_detection_deadline( const uint32_t flow );
+
+public:
+  MultiFlowSender( const char * const host, const char * const port,
+		   const uint32_t flows, const size_t sockets,
+		   const Poller::Backend engine );
+
+  /* run until duration (in microseconds, 0 for no limit) is up or a
+     signal arrives, then report each flow's throughput */
+  int loop( const uint64_t duration );
+};
+
+template <class ControllerType>
+MultiFlowSender<ControllerType>::MultiFlowSender( const char * const host,
+						  const char * const port,
+						  const uint32_t flows,
+						  const size_t sockets,
+						  const Poller::Backend engine )
+  : sockets_(),
+    controllers_( flows ),
+    sequence_numbers_( flows ),
+    acked_bytes_( flows ),
+    loss_detection_timers_( flows ),
+    queued_( flows ),
+    pacing_armed_( flows ),
+    ready_( sockets ),
+    header_buffers_( SEND_BATCH_SIZE * ContestMessage::Header::SIZE ),
+    outgoing_(),
+    pool_( PACKET_POOL_SIZE ),
+    acks_(),
+    coalesced_ack_(),
+    malformed_( 0 ),
+    poller_( engine )
+{
+  const Address peer( host, port );
+
+  for ( size_t i = 0; i < sockets; i++ ) {
+    sockets_.emplace_back( new UDPSocket() );
+    sockets_.back()->set_timestamps();
+    sockets_.back()->connect( peer );
+
+    if ( poller_.backend() == Poller::Backend::IoUring and not sockets_.back()->enable_io_uring() ) {
+      throw runtime_error( "io_uring not supported for sockets" );
+    }
+  }
+
+  LOG( Info, "Sending {} flows to {} over {} sockets", flows, peer.to_string(), sockets );
+}
+
+/* the flow may be able to send: queue it for a turn */
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::make_ready( const uint32_t flow )
+{
+  if ( not queued_[ flow ] ) {
+    queued_[ flow ] = true;
+    ready_[ socket_of( flow ) ].push_back( flow );
+  }
+}
+
+/* the window is open but the pacing rate holds the flow back:
+   queue it again once the next datagram may go out */
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::arm_pacing_timer( const uint32_t flow )
+{
+  if ( pacing_armed_[ flow ] ) {
+    return;
+  }
+
+  poller_.add_timer( controllers_[ flow ].next_send_time_us(), [this, flow] () {
+      pacing_armed_[ flow ] = false;
+      make_ready( flow );
+      return ResultType::Continue;
+    } );
+  pacing_armed_[ flow ] = true;
+}
+
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::stage_datagram( const uint32_t flow, const bool after_timeout )
+{
+  /* All messages use the same dummy payload (shared, never copied) */
+  static const string dummy_payload( 1424, 'x' );
+
+  ControllerType & controller = controllers_[ flow ];
+
+  ContestMessage::Header header( sequence_numbers_[ flow ]++, controller.get_delivered(),
+				 controller.get_delivered_time(), flow );
+  header.set_send_timestamp();
+
+  char * const header_buffer = &header_buffers_[ outgoing_.size() * ContestMessage::Header::SIZE ];
+  header.serialize( header_buffer );
+  outgoing_.push_back( { header_buffer, ContestMessage::Header::SIZE,
+			 dummy_payload.data(), dummy_payload.size(), nullptr } );
+
+  controller.datagram_was_sent( header.sequence_number, header.send_timestamp,
+				dummy_payload.size(), after_timeout );
+}
+
+/* send every staged datagram with one system call */
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::flush( const size_t socket )
+{
+  if ( outgoing_.empty() ) {
+    return;
+  }
+
+  sockets_[ socket ]->send_batch( outgoing_ );
+  outgoing_.clear();
+}
+
+/* can the flow send now? if not, it leaves its socket's ready queue
+   until an ack opens its window or its pacing timer fires */
+template <class ControllerType>
+bool MultiFlowSender<ControllerType>::can_send( const uint32_t flow )
+{
+  ControllerType & controller = controllers_[ flow ];
+
+  if ( not controller.window_is_open() ) {
+    queued_[ flow ] = false;
+    return false;
+  }
+
+  if ( not controller.should_send_packet() ) {
+    queued_[ flow ] = false;
+    arm_pacing_timer( flow );
+    return false;
+  }
+
+  return true;
+}
+
+/* drop the flows that can't send from the front of the socket's ready
+   queue (so that a turn always sends something), and say if any is left */
+template <class ControllerType>
+bool MultiFlowSender<ControllerType>::has_ready( const size_t socket )
+{
+  auto & ready = ready_[ socket ];
+
+  while ( not ready.empty() and not can_send( ready.front() ) ) {
+    ready.pop_front();
+  }
+
+  return not ready.empty();
+}
+
+/* give the flows in the socket's ready queue a datagram each, in turn,
+   until the batch is full (each turn is O(1), however many flows there are) */
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::send_ready( const size_t socket )
+{
+  auto & ready = ready_[ socket ];
+
+  while ( has_ready( socket ) and outgoing_.size() < SEND_BATCH_SIZE ) {
+    const uint32_t flow = ready.front();
+    ready.pop_front();
+    stage_datagram( flow, false );
+    ready.push_back( flow );
+  }
+
+  flush( socket );
+}
+
+/* when the flow's oldest datagram in flight waits out its reordering
+   window, or else a retransmission timeout from now */
+template <class ControllerType>
+uint64_t MultiFlowSender<ControllerType>::loss_detection_deadline( const uint32_t flow )
+{
+  const uint64_t timeout = timestamp_us() + controllers_[ flow ].timeout_us();
+  const uint64_t loss_time = controllers_[ flow ].loss_time();
+  return loss_time ? min( loss_time, timeout ) : timeout;
+}
+
+/* a stray datagram (not from the receiver) is no reason to stop */
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::drop_malformed( const char * const what )
+{
+  malformed_++;
+  LOG( Warning, "dropped a {} ({} so far)", what, malformed_ );
+}
+
+template <class ControllerType>
+void MultiFlowSender<ControllerType>::got_ack( const uint64_t timestamp,
+					       const ContestMessageView & ack )
+{
+  if ( not ack.is_ack() ) {
+    drop_malformed( "datagram other than an ack" );
+    return;
+  }
+
+  if ( ack.flow_id() >= controllers_.size() ) {
+    LOG( Warning, "ack for unknown flow {}", ack.flow_id() );
+    return;
+  }
+
+  const uint32_t flow = ack.flow_id();
+  ControllerType & controller = controllers_[ flow ];
+
+  if ( CoalescedAck::is_coalesced( ack ) ) {
+    if ( not coalesced_ack_.parse( ack ) ) {
+      drop_malformed( "malformed coalesced ack" );
+      return;
+    }
+    controller.acks_received( coalesced_ack_, ack.send_timestamp(), timestamp );
+    for ( const auto & datagram : coalesced_ack_.datagrams ) {
+      acked_bytes_[ flow ] += datagram.payload_length;
+    }
+  } else {
+    controller.ack_received( ack.ack_sequence_number(), ack.ack_send_timestamp(),
+			     ack.ack_recv_timestamp(), timestamp, ack.ack_payload_length(),
+			     ack.delivered(), ack.delivered_time() );
+    acked_bytes_[ flow ] += ack.ack_payload_length();
+  }
+
+  poller_.rearm_timer( loss_detection_timers_[ flow ], loss_detection_deadline( flow ) );
+  make_ready( flow );
+}
+
+template <class ControllerType>
+int MultiFlowSender<ControllerType>::loop( const uint64_t duration )
+{
+  const uint32_t flows = controllers_.size();
+
+  for ( size_t s = 0; s < sockets_.size(); s++ ) {
+    UDPSocket & socket = *sockets_[ s ];
+
+    /* first rule: give the ready flows their turns */
+    poller_.add_action( Action( socket, Direction::Out, [this, s] () {
+	  send_ready( s );
+	  return ResultType::Continue;
+	},
+	[this, s] () { return has_ready( s ); } ) );
+
+    /* second rule: hand each ack to its flow */
+    poller_.add_action( Action( socket.receive_event_fd(), Direction::In, [this, &socket] () {
+	  socket.recv_batch( RECV_BATCH_SIZE, pool_, acks_ );
+	  for ( const auto & recd : acks_ ) {
+	    if ( not ContestMessageView::fits( recd.buffer ) ) {
+	      drop_malformed( "datagram too short for a header" );
+	      continue;
+	    }
+	    got_ack( recd.timestamp, ContestMessageView( recd.buffer ) );
+	  }
+	  return ResultType::Continue;
+	} ) );
+  }
+
+  /* third rule: a flow's datagram is lost when its reordering window
+     passes; if the flow hears no ack for a while, everything it has
+     in flight is, and it sends one datagram */
+  for ( uint32_t flow = 0; flow < flows; flow++ ) {
+    loss_detection_timers_[ flow ] = poller_.add_timer( loss_detection_deadline( flow ), [this, flow] () {
+	ControllerType & controller = controllers_[ flow ];
+	const uint64_t loss_time = controller.loss_time();
+	if ( loss_time and loss_time <= timestamp_us() ) {
+	  controller.detect_losses();
+	} else {
+	  const size_t socket = socket_of( flow );
+	  flush( socket );
+	  stage_datagram( flow, true );
+	  flush( socket );
+	}
+	make_ready( flow );
+	poller_.rearm_timer( loss_detection_timers_[ flow ], loss_detection_deadline( flow ) );
+	return ResultType::Continue;
+      } );
+    make_ready( flow );
+  }
+
+  /* stop (and report) when time is up, or on SIGINT or SIGTERM */
+  sigset_t signals;
+  sigemptyset( &signals );
+  sigaddset( &signals, SIGINT );
+  sigaddset( &signals, SIGTERM );
+  SystemCall( "sigprocmask", sigprocmask( SIG_BLOCK, &signals, nullptr ) );
+  FileDescriptor signal_fd( SystemCall( "signalfd", signalfd( -1, &signals, SFD_CLOEXEC ) ) );
+  poller_.add_action( Action( signal_fd, Direction::In, [] () { return ResultType::Exit; } ) );
+
+  const uint64_t start = timestamp_us();
+  if ( duration ) {
+    poller_.add_timer( start + duration, [] () { return ResultType::Exit; } );
+  }
+
+  while ( poller_.poll( -1 ).result != PollResult::Exit ) {}
+
+  /* each flow's throughput, and how fairly they shared (Jain's index) */
+  const double elapsed = timestamp_us() - start;
+  vector<double> throughputs;
+  double sum = 0, sum_of_squares = 0;
+  for ( const uint64_t bytes : acked_bytes_ ) {
+    throughputs.push_back( 8 * bytes / elapsed );
+    sum += throughputs.back();
+    sum_of_squares += throughputs.back() * throughputs.back();
+  }
+  sort( throughputs.begin(), throughputs.end() );
+
+  cerr << flows << " flows over " << elapsed / 1e6 << " s: total " << sum << " Mbit/s, per flow"
+       << " min " << throughputs.front()
+       << ", median " << throughputs[ throughputs.size() / 2 ]
+       << ", max " << throughputs.back() << " Mbit/s,"
+       << " Jain's fairness index " << (sum_of_squares > 0 ? sum * sum / (flows * sum_of_squares) : 0)
+       << endl;
+
+  return EXIT_SUCCESS;
+}
+
+template <class ControllerType>
+static int run( const char * const host, const char * const port, const uint32_t flows,
+		const size_t sockets, const Poller::Backend engine, const uint64_t duration )
+{
+  MultiFlowSender<ControllerType> sender( host, port, flows, sockets, engine );
+  return sender.loop( duration );
+}
+
+int main( int argc, char *argv[] )
+{
+   /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  Poller::Backend engine = Poller::Backend::Epoll;
+  string algorithm = Controller::names().front();
+  uint32_t flows = 1;
+  size_t sockets = 1;
+  uint64_t duration = 0;
+  bool usage_ok = argc >= 3;
+
+  for ( int i = 3; usage_ok and i < argc; i++ ) {
+    const string arg( argv[ i ] );
+    if ( arg.compare( 0, 8, "--flows=" ) == 0 ) {
+      flows = strtoul( arg.c_str() + 8, nullptr, 10 );
+      usage_ok = flows >= 1;
+    } else if ( arg.compare( 0, 10, "--sockets=" ) == 0 ) {
+      sockets = strtoul( arg.c_str() + 10, nullptr, 10 );
+      usage_ok = sockets >= 1;
+    } else if ( arg.compare( 0, 11, "--duration=" ) == 0 ) {
+      /* (a positive number of seconds, and nothing else) */
+      try {
+	size_t length;
+	const double seconds = stod( arg.substr( 11 ), &length );
+	usage_ok = length == arg.size() - 11
+	  and seconds > 0 and seconds < numeric_limits<uint64_t>::max() / 1e6;
+	duration = usage_ok ? 1e6 * seconds : 0;
+	usage_ok = usage_ok and duration > 0;
+      } catch ( const exception & ) {
+	usage_ok = false;
+      }
+    } else if ( arg.compare( 0, 12, "--log-level=" ) == 0 ) {
+      try {
+	Log::set_level( Log::level_from_name( arg.substr( 12 ) ) );
+      } catch ( const exception & e ) {
+	print_exception( e );
+	usage_ok = false;
+      }
+    } else if ( arg.compare( 0, 5, "--cc=" ) == 0 ) {
+      algorithm = arg.substr( 5 );
+      const auto names = Controller::names();
+      usage_ok = find( names.begin(), names.end(), algorithm ) != names.end();
+    } else if ( arg.compare( 0, 9, "--engine=" ) == 0 ) {
+      try {
+	engine = Poller::backend_from_name( arg.substr( 9 ) );
+      } catch ( const exception & e ) {
+	print_exception( e );
+	usage_ok = false;
+      }
+    } else {
+      usage_ok = false;
+    }
+  }
+
+  if ( not usage_ok ) {
+    string algorithms;
+    for ( const auto & name : Controller::names() ) {
+      algorithms += (algorithms.empty() ? "" : "|") + name;
+    }
+    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [--flows=N] [--sockets=N]"
+	 << " [--cc=" << algorithms << "] [--engine=poll|epoll|io_uring]"
+	 << " [--duration=SECONDS] [--log-level=error|warning|info|debug|trace]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  sockets = min( sockets, size_t( flows ) );
+
+  try {
+    if ( algorithm == BBRController::name() ) {
+      return run<BBRController>( argv[ 1 ], argv[ 2 ], flows, sockets, engine, duration );
+    } else if ( algorithm == RenoController::name() ) {
+      return run<RenoController>( argv[ 1 ], argv[ 2 ], flows, sockets, engine, duration );
+    } else if ( algorithm == CubicController::name() ) {
+      return run<CubicController>( argv[ 1 ], argv[ 2 ], flows, sockets, engine, duration );
+    } else {
+      return run<VegasController>( argv[ 1 ], argv[ 2 ], flows, sockets, engine, duration );
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+}
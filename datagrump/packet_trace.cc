@@ -0,0 +1,117 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "packet_trace.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const char MAGIC[ 8 ] = "DGTRACE";
+
+PacketTraceWriter::PacketTraceWriter( const string & filename, const uint64_t capacity,
+				      const string & algorithm )
+  : fd_( SystemCall( "open " + filename,
+		     open( filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 ) ) ),
+    length_( sizeof( PacketTraceHeader ) + capacity * sizeof( PacketEvent ) ),
+    header_( nullptr ),
+    events_( nullptr ),
+    dropped_( 0 )
+{
+  /* reserve the blocks now, so appending never waits on the filesystem
+     (where fallocate isn't supported, the file is just sparse) */
+  SystemCall( "ftruncate", ftruncate( fd_.fd_num(), length_ ) );
+  const int error = posix_fallocate( fd_.fd_num(), 0, length_ );
+  if ( error and error != EOPNOTSUPP and error != EINVAL ) {
+    throw unix_error( "posix_fallocate", error );
+  }
+
+  void * const memory = mmap( nullptr, length_, PROT_READ | PROT_WRITE,
+			      MAP_SHARED, fd_.fd_num(), 0 );
+  if ( memory == MAP_FAILED ) {
+    throw unix_error( "mmap " + filename );
+  }
+
+  /* take the write fault on every page now rather than on the first
+     event that lands in it (which would cost more than the event) */
+  memset( memory, 0, length_ );
+
+  header_ = static_cast<PacketTraceHeader *>( memory );
+  events_ = reinterpret_cast<PacketEvent *>( header_ + 1 );
+
+  memcpy( header_->magic, MAGIC, sizeof( MAGIC ) );
+  header_->version = PacketTraceHeader::VERSION;
+  header_->event_size = sizeof( PacketEvent );
+  header_->capacity = capacity;
+  header_->count = 0;
+  memset( header_->algorithm, 0, sizeof( header_->algorithm ) );
+  algorithm.copy( header_->algorithm, sizeof( header_->algorithm ) - 1 );
+}
+
+PacketTraceWriter::~PacketTraceWriter()
+{
+  const uint64_t used = sizeof( PacketTraceHeader ) + header_->count * sizeof( PacketEvent );
+
+  try {
+    SystemCall( "munmap", munmap( header_, length_ ) );
+
+    /* give back the space that wasn't used */
+    SystemCall( "ftruncate", ftruncate( fd_.fd_num(), used ) );
+  } catch ( const exception & e ) { /* don't throw from destructor */
+    print_exception( e );
+  }
+}
+
+PacketTraceReader::PacketTraceReader( const string & filename )
+  : fd_( SystemCall( "open " + filename, open( filename.c_str(), O_RDONLY | O_CLOEXEC ) ) ),
+    length_( 0 ),
+    header_( nullptr ),
+    events_( nullptr )
+{
+  struct stat st;
+  SystemCall( "fstat", fstat( fd_.fd_num(), &st ) );
+  length_ = st.st_size;
+
+  if ( length_ < sizeof( PacketTraceHeader ) ) {
+    throw runtime_error( filename + ": too short to be a packet trace" );
+  }
+
+  const void * const memory = mmap( nullptr, length_, PROT_READ, MAP_PRIVATE, fd_.fd_num(), 0 );
+  if ( memory == MAP_FAILED ) {
+    throw unix_error( "mmap " + filename );
+  }
+
+  header_ = static_cast<const PacketTraceHeader *>( memory );
+  events_ = reinterpret_cast<const PacketEvent *>( header_ + 1 );
+
+  if ( memcmp( header_->magic, MAGIC, sizeof( MAGIC ) )
+       or header_->version != PacketTraceHeader::VERSION
+       or header_->event_size != sizeof( PacketEvent ) ) {
+    munmap( const_cast<PacketTraceHeader *>( header_ ), length_ );
+    throw runtime_error( filename + ": not a packet trace (or from another version)" );
+  }
+
+  if ( header_->count > (length_ - sizeof( PacketTraceHeader )) / sizeof( PacketEvent ) ) {
+    munmap( const_cast<PacketTraceHeader *>( header_ ), length_ );
+    throw runtime_error( filename + ": truncated packet trace" );
+  }
+}
+
+PacketTraceReader::~PacketTraceReader()
+{
+  try {
+    SystemCall( "munmap", munmap( const_cast<PacketTraceHeader *>( header_ ), length_ ) );
+  } catch ( const exception & e ) { /* don't throw from destructor */
+    print_exception( e );
+  }
+}
+
+string PacketTraceReader::algorithm() const
+{
+  return string( header_->algorithm, strnlen( header_->algorithm, sizeof( header_->algorithm ) ) );
+}
@@ -0,0 +1,112 @@
+#ifndef PACKET_TRACE_HH
+#define PACKET_TRACE_HH
+
+#include <cstdint>
+#include <string>
+
+#include "file_descriptor.hh"
+
+/* Binary per-packet trace: a PacketTraceHeader followed by fixed-size
+   PacketEvent records, in host byte order. The sender appends to a
+   file that is preallocated and memory-mapped, so an event is a
+   64-byte store and no system call; the header's count is updated
+   with every event, so the file is readable even if the sender was
+   killed. */
+
+struct PacketEvent
+{
+  enum Type : uint8_t { Sent, Retransmitted, Acked, Lost };
+
+  uint64_t time; /* when it happened (sender's clock, in microseconds) */
+  uint64_t sequence_number;
+  uint64_t send_timestamp; /* sender's clock, in microseconds */
+  uint64_t recv_timestamp; /* receiver's clock, in microseconds (acks only) */
+
+  /* the controller's state after the event */
+  double rt_estimate; /* propagation delay, in microseconds */
+  double btlbw_estimate; /* bottleneck bandwidth, in bytes per microsecond (0 if none) */
+  uint32_t inflight; /* in datagrams */
+  uint32_t cwnd; /* in datagrams */
+  float pacing_gain; /* 0 if the algorithm doesn't pace */
+
+  uint16_t payload_length; /* in bytes */
+  uint8_t type;
+  uint8_t state; /* algorithm-specific (BBR: startup, drain, probe bw, probe rtt) */
+};
+
+static_assert( sizeof( PacketEvent ) == 64, "PacketEvent should fill a cache line" );
+
+struct PacketTraceHeader
+{
+  static const uint32_t VERSION = 1;
+
+  char magic[ 8 ]; /* "DGTRACE" */
+  uint32_t version;
+  uint32_t event_size;
+  uint64_t capacity; /* events the file has room for */
+  uint64_t count; /* events written */
+  char algorithm[ 32 ]; /* congestion controller, NUL-terminated */
+};
+
+static_assert( sizeof( PacketTraceHeader ) == 64, "PacketTraceHeader should fill a cache line" );
+
+/* appends events to a new trace file */
+class PacketTraceWriter
+{
+private:
+  FileDescriptor fd_;
+  size_t length_; /* of the mapping */
+  PacketTraceHeader * header_;
+  PacketEvent * events_;
+  uint64_t dropped_; /* events that didn't fit */
+
+public:
+  /* create (or truncate) filename with room for capacity events */
+  PacketTraceWriter( const std::string & filename, const uint64_t capacity,
+		     const std::string & algorithm );
+  ~PacketTraceWriter();
+
+  /* add an event (or count it as dropped, if the file is full) */
+  void append( const PacketEvent & event )
+  {
+    if ( header_->count < header_->capacity ) {
+      events_[ header_->count ] = event;
+      header_->count++;
+    } else {
+      dropped_++;
+    }
+  }
+
+  uint64_t count() const { return header_->count; }
+  uint64_t dropped() const { return dropped_; }
+
+  /* forbid copying or assigning */
+  PacketTraceWriter( const PacketTraceWriter & other ) = delete;
+  const PacketTraceWriter & operator=( const PacketTraceWriter & other ) = delete;
+};
+
+/* reads the events back from a trace file */
+class PacketTraceReader
+{
+private:
+  FileDescriptor fd_;
+  size_t length_;
+  const PacketTraceHeader * header_;
+  const PacketEvent * events_;
+
+public:
+  PacketTraceReader( const std::string & filename );
+  ~PacketTraceReader();
+
+  std::string algorithm() const;
+
+  const PacketEvent * begin() const { return events_; }
+  const PacketEvent * end() const { return events_ + header_->count; }
+  uint64_t size() const { return header_->count; }
+
+  /* forbid copying or assigning */
+  PacketTraceReader( const PacketTraceReader & other ) = delete;
+  const PacketTraceReader & operator=( const PacketTraceReader & other ) = delete;
+};
+
+#endif /* PACKET_TRACE_HH */
@@ -0,0 +1,229 @@
+/* count the heap allocations per datagram on loopback, with the
+   datagrams and acks in strings (parsed and built as ContestMessages)
+   and then in buffers from a PacketPool (viewed and rewritten in place):
+   a sender sends a window of contest-sized datagrams to a receiver
+   that acks each one, and waits for the acks, round after round */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "socket.hh"
+#include "packet_pool.hh"
+#include "contest_message.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* every operator new in the program, counted (one thread, so no atomics) */
+static uint64_t heap_allocations = 0;
+
+void * operator new( size_t size )
+{
+  heap_allocations++;
+  void * const block = malloc( size ? size : 1 );
+  if ( not block ) {
+    throw bad_alloc();
+  }
+  return block;
+}
+
+void operator delete( void * block ) noexcept
+{
+  free( block );
+}
+
+/* datagrams per round (few enough that none overflows the receive buffer) */
+static const size_t WINDOW = 32;
+
+/* rounds before counting, for every vector and pool to reach its size */
+static const unsigned int WARMUP_ROUNDS = 1000;
+
+/* CPU time (user + system) used so far by this process, in nanoseconds */
+static uint64_t cpu_ns()
+{
+  rusage usage;
+  SystemCall( "getrusage", getrusage( RUSAGE_SELF, &usage ) );
+  return ( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1000000000ULL
+    + ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1000ULL;
+}
+
+/* one round each way, with strings */
+class StringRound
+{
+private:
+  UDPSocket & sender_;
+  UDPSocket & receiver_;
+  const string payload_;
+  uint64_t sequence_number_;
+  vector<string> outgoing_;
+  vector<string> acks_;
+
+public:
+  StringRound( UDPSocket & sender, UDPSocket & receiver )
+    : sender_( sender ), receiver_( receiver ), payload_( 1424, 'x' ),
+      sequence_number_( 0 ), outgoing_(), acks_()
+  {}
+
+  void operator()()
+  {
+    outgoing_.clear();
+    for ( size_t i = 0; i < WINDOW; i++ ) {
+      ContestMessage message( sequence_number_++, 0, 0, payload_ );
+      message.set_send_timestamp();
+      outgoing_.push_back( message.to_string() );
+    }
+    sender_.send_batch( outgoing_ );
+
+    for ( size_t received = 0; received < WINDOW; ) {
+      acks_.clear();
+      for ( const auto & recd : receiver_.recv_batch( WINDOW ) ) {
+	ContestMessage message( recd.payload );
+	message.transform_into_ack( received++, recd.timestamp );
+	message.set_send_timestamp();
+	acks_.push_back( message.to_string() );
+      }
+      receiver_.send_batch( acks_ );
+    }
+
+    for ( size_t acked = 0; acked < WINDOW; ) {
+      for ( const auto & recd : sender_.recv_batch( WINDOW ) ) {
+	if ( not ContestMessage( recd.payload ).is_ack() ) {
+	  throw runtime_error( "sender got something other than an ack" );
+	}
+	acked++;
+      }
+    }
+  }
+};
+
+/* one round each way, with pooled buffers */
+class PooledRound
+{
+private:
+  UDPSocket & sender_;
+  UDPSocket & receiver_;
+  const string payload_;
+  uint64_t sequence_number_;
+
+  PacketPool sender_pool_, receiver_pool_;
+  vector<PacketBuffer> headers_;
+  vector<UDPSocket::gathered_datagram> outgoing_;
+  vector<UDPSocket::received_packet> received_;
+  vector<UDPSocket::gathered_datagram> acks_;
+
+public:
+  PooledRound( UDPSocket & sender, UDPSocket & receiver )
+    : sender_( sender ), receiver_( receiver ), payload_( 1424, 'x' ),
+      sequence_number_( 0 ),
+      sender_pool_( 4 * WINDOW ), receiver_pool_( 2 * WINDOW ),
+      headers_(), outgoing_(), received_(), acks_()
+  {}
+
+  void operator()()
+  {
+    headers_.clear();
+    outgoing_.clear();
+    for ( size_t i = 0; i < WINDOW; i++ ) {
+      ContestMessage::Header header( sequence_number_++, 0, 0 );
+      header.set_send_timestamp();
+      headers_.push_back( sender_pool_.acquire() );
+      header.serialize( headers_.back() );
+      outgoing_.push_back( { headers_.back().data(), headers_.back().length(),
+			     payload_.data(), payload_.size(), nullptr } );
+    }
+    sender_.send_batch( outgoing_ );
+
+    for ( size_t received = 0; received < WINDOW; ) {
+      receiver_.recv_batch( WINDOW, receiver_pool_, received_ );
+      acks_.clear();
+      for ( auto & recd : received_ ) {
+	ContestMessage::transform_into_ack_in_place( recd.buffer.data(), recd.buffer.length(),
+						     received++, recd.timestamp );
+	acks_.push_back( { recd.buffer.data(), ContestMessage::Header::SIZE,
+			   nullptr, 0, &recd.source_address } );
+      }
+      receiver_.send_batch( acks_ );
+    }
+
+    for ( size_t acked = 0; acked < WINDOW; ) {
+      sender_.recv_batch( WINDOW, sender_pool_, received_ );
+      for ( const auto & recd : received_ ) {
+	if ( not ContestMessageView( recd.buffer ).is_ack() ) {
+	  throw runtime_error( "sender got something other than an ack" );
+	}
+	acked++;
+      }
+    }
+  }
+
+  const PacketPool::Stats & sender_stats() const { return sender_pool_.stats(); }
+  const PacketPool::Stats & receiver_stats() const { return receiver_pool_.stats(); }
+};
+
+static void print_stats( const string & name, const PacketPool::Stats & stats )
+{
+  cout << "  " << name << " pool: " << stats.acquired << " acquired, "
+       << stats.overflows << " from the heap, at most " << stats.high_water << " out at once"
+       << endl;
+}
+
+template <class Round>
+static void run( const string & name, Round & round, const unsigned int rounds )
+{
+  for ( unsigned int i = 0; i < WARMUP_ROUNDS; i++ ) {
+    round();
+  }
+
+  const uint64_t start_allocations = heap_allocations;
+  const uint64_t start_cpu = cpu_ns();
+
+  for ( unsigned int i = 0; i < rounds; i++ ) {
+    round();
+  }
+
+  const uint64_t allocations = heap_allocations - start_allocations;
+  const uint64_t cpu = cpu_ns() - start_cpu;
+  const uint64_t datagrams = uint64_t( rounds ) * WINDOW;
+
+  cout << name << ": " << allocations << " heap allocations for " << datagrams << " datagrams ("
+       << double( allocations ) / datagrams << " per datagram), "
+       << cpu / datagrams << " ns CPU per datagram (send + ack + receive ack)" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc > 2 ) {
+    cerr << "Usage: " << argv[ 0 ] << " [ROUNDS]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int rounds = argc == 2 ? atoi( argv[ 1 ] ) : 20000;
+
+  UDPSocket sender, receiver;
+  receiver.set_timestamps();
+  sender.set_timestamps();
+  receiver.bind( Address( "::1", 0 ) );
+  sender.bind( Address( "::1", 0 ) );
+  sender.connect( receiver.local_address() );
+  receiver.connect( sender.local_address() );
+
+  StringRound strings( sender, receiver );
+  run( "strings", strings, rounds );
+
+  PooledRound pooled( sender, receiver );
+  run( "pooled", pooled, rounds );
+  print_stats( "sender", pooled.sender_stats() );
+  print_stats( "receiver", pooled.receiver_stats() );
+
+  return EXIT_SUCCESS;
+}
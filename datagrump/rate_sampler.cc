@@ -0,0 +1,69 @@
+#include "rate_sampler.hh"
+
+using namespace std;
+
+RateSampler::RateSampler()
+  : delivered_( 0 ), delivered_time_( 0 ), first_sent_time_( 0 ),
+    app_limited_until_( 0 ),
+    sample_()
+{}
+
+DeliverySnapshot RateSampler::sent( const uint64_t send_timestamp, const bool nothing_in_flight )
+{
+  /* (the time idle before this doesn't count in any interval) */
+  if ( nothing_in_flight ) {
+    first_sent_time_ = send_timestamp;
+    delivered_time_ = send_timestamp;
+  }
+
+  return { delivered_, delivered_time_, first_sent_time_, app_limited_until_ > 0 };
+}
+
+void RateSampler::app_limited( const uint64_t bytes_in_flight )
+{
+  /* (at least 1, to mean "app-limited" even with nothing delivered or in flight) */
+  app_limited_until_ = delivered_ + bytes_in_flight > 0 ? delivered_ + bytes_in_flight : 1;
+}
+
+const RateSample & RateSampler::acked( const DeliverySnapshot & packet,
+				       const uint64_t send_timestamp,
+				       const uint64_t payload_length,
+				       const uint64_t timestamp_ack_received,
+				       const double min_rtt )
+{
+  delivered_ += payload_length;
+  delivered_time_ = timestamp_ack_received;
+
+  /* once what was in flight when the sender ran dry is delivered,
+     the datagrams sent since then are what's in flight */
+  if ( app_limited_until_ and delivered_ > app_limited_until_ ) {
+    app_limited_until_ = 0;
+  }
+
+  /* the next send interval starts where this datagram's ends
+     (unless a later one has been acked already) */
+  if ( send_timestamp > first_sent_time_ ) {
+    first_sent_time_ = send_timestamp;
+  }
+
+  return take_sample( packet, send_timestamp, min_rtt );
+}
+
+const RateSample & RateSampler::take_sample( const DeliverySnapshot & packet,
+					     const uint64_t send_timestamp,
+					     const double min_rtt )
+{
+  sample_.prior_delivered = packet.delivered;
+  sample_.delivered = delivered_ - packet.delivered;
+  sample_.is_app_limited = packet.is_app_limited;
+  sample_.send_elapsed = send_timestamp - packet.first_sent_time;
+  sample_.ack_elapsed = delivered_time_ > packet.delivered_time
+    ? delivered_time_ - packet.delivered_time : 0;
+  sample_.interval = sample_.send_elapsed > sample_.ack_elapsed
+    ? sample_.send_elapsed : sample_.ack_elapsed;
+
+  sample_.delivery_rate = (sample_.interval > 0 and sample_.interval >= min_rtt)
+    ? double( sample_.delivered ) / sample_.interval : 0;
+
+  return sample_;
+}
@@ -0,0 +1,95 @@
+#ifndef RATE_SAMPLER_HH
+#define RATE_SAMPLER_HH
+
+#include <cstdint>
+
+/* Delivery-rate estimation, as in draft-cheng-iccrg-delivery-rate-estimation:
+   each datagram carries a snapshot of how much had been delivered when
+   it was sent, and its ack gives a sample of the delivery rate since then,
+   over the longer of the send and ack intervals (so that neither a burst
+   of sends nor a burst of acks makes the rate look higher than the path's) */
+
+/* The connection's delivery state when a datagram was sent */
+struct DeliverySnapshot
+{
+  uint64_t delivered; /* bytes delivered before it was sent */
+  uint64_t delivered_time; /* when the last of them was acked (in microseconds) */
+  uint64_t first_sent_time; /* when the first datagram of its send interval went out */
+  bool is_app_limited; /* sent while the sender had nothing more to send */
+};
+
+/* One ack's sample of the delivery rate */
+struct RateSample
+{
+  uint64_t prior_delivered; /* delivered when the datagram acked was sent */
+  uint64_t delivered; /* bytes delivered since */
+  uint64_t send_elapsed; /* from the first datagram of its interval to it (in microseconds) */
+  uint64_t ack_elapsed; /* from prior delivered_time to now */
+  uint64_t interval; /* the longer of the two */
+  bool is_app_limited;
+
+  /* in bytes per microsecond (0 if the sample isn't valid: the interval
+     was shorter than the min RTT, so the datagrams acked may have been
+     compressed in time by the network or by ack aggregation) */
+  double delivery_rate;
+};
+
+class RateSampler
+{
+private:
+  uint64_t delivered_; /* bytes delivered so far */
+  uint64_t delivered_time_; /* when the latest were acked */
+  uint64_t first_sent_time_; /* send time of the datagram whose ack was the latest */
+
+  /* While the sender is app-limited, the bytes that will have been
+     delivered when the last datagram sent before it ran dry is acked
+     (0 when it isn't) */
+  uint64_t app_limited_until_;
+
+  RateSample sample_;
+
+  /* the sample of a datagram sent with this snapshot, by what has been delivered now */
+  const RateSample & take_sample( const DeliverySnapshot & packet,
+				  const uint64_t send_timestamp,
+				  const double min_rtt );
+
+public:
+  RateSampler();
+
+  /* A datagram is being sent: its snapshot (with nothing in flight,
+     a new send interval begins now) */
+  DeliverySnapshot sent( const uint64_t send_timestamp, const bool nothing_in_flight );
+
+  /* The sender has nothing to send, though the window and the pacing
+     rate would allow it: datagrams sent until everything now in flight
+     is delivered will give samples tagged app-limited */
+  void app_limited( const uint64_t bytes_in_flight );
+
+  /* A datagram sent with this snapshot was delivered: the sample from
+     its ack (given the connection's min RTT, in microseconds) */
+  const RateSample & acked( const DeliverySnapshot & packet,
+			    const uint64_t send_timestamp,
+			    const uint64_t payload_length,
+			    const uint64_t timestamp_ack_received,
+			    const double min_rtt );
+
+  /* Its own ack came for a datagram already counted as delivered
+     (it was sacked): the sample from that, without counting it again */
+  const RateSample & acked_again( const DeliverySnapshot & packet,
+				  const uint64_t send_timestamp,
+				  const double min_rtt )
+  {
+    return take_sample( packet, send_timestamp, min_rtt );
+  }
+
+  /* An ack gave no sample (it was of a datagram acked before) */
+  void invalidate() { sample_ = RateSample(); }
+
+  /* The latest sample */
+  const RateSample & sample() const { return sample_; }
+
+  uint64_t delivered() const { return delivered_; }
+  uint64_t delivered_time() const { return delivered_time_; }
+};
+
+#endif /* RATE_SAMPLER_HH */
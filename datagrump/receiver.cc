@@ -1,13 +1,27 @@
-/* simple UDP receiver that acknowledges every datagram */
+/* simple UDP receiver that acknowledges every datagram
+   (one by one, or several at a time with delayed, cumulative acks),
+   on one thread or on several sharing the port */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "socket.hh"
 #include "contest_message.hh"
+#include "log.hh"
+#include "receiver_loop.hh"
+#include "util.hh"
 
 using namespace std;
 
+/* longest an arriving datagram waits for its ack, when acks
+   are coalesced and no delay is given (in microseconds) */
+static const uint64_t DEFAULT_ACK_DELAY = 1000;
+
 int main( int argc, char *argv[] )
 {
    /* check the command-line arguments */
@@ -15,37 +29,137 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 2 ) {
-    cerr << "Usage: " << argv[ 0 ] << " PORT" << endl;
+  bool use_io_uring = false;
+  bool gro = false;
+  unsigned int workers = 1;
+  bool steer_by_cpu = false;
+  unsigned int ack_every = 0; /* (0 until given) */
+  uint64_t ack_delay = 0;
+  bool usage_ok = argc >= 2;
+
+  for ( int i = 2; usage_ok and i < argc; i++ ) {
+    const string arg( argv[ i ] );
+    if ( arg == "--engine=io_uring" ) {
+      use_io_uring = true;
+    } else if ( arg == "--gro" ) {
+      gro = true;
+    } else if ( arg.compare( 0, 10, "--workers=" ) == 0 ) {
+      workers = strtoul( arg.c_str() + 10, nullptr, 10 );
+      usage_ok = workers >= 1;
+    } else if ( arg == "--steer-by-cpu" ) {
+      steer_by_cpu = true;
+    } else if ( arg.compare( 0, 12, "--ack-every=" ) == 0 ) {
+      ack_every = strtoul( arg.c_str() + 12, nullptr, 10 );
+      usage_ok = ack_every >= 1 and ack_every <= CoalescedAck::MAX_DATAGRAMS;
+    } else if ( arg.compare( 0, 12, "--ack-delay=" ) == 0 ) {
+      ack_delay = strtoull( arg.c_str() + 12, nullptr, 10 );
+      usage_ok = ack_delay > 0;
+    } else {
+      usage_ok = false;
+    }
+  }
+
+  if ( not usage_ok ) {
+    cerr << "Usage: " << argv[ 0 ] << " PORT [--engine=io_uring | --gro] [--workers=N [--steer-by-cpu]]"
+	 << " [--ack-every=N (1-" << CoalescedAck::MAX_DATAGRAMS << ")] [--ack-delay=MICROSECONDS]" << endl;
     return EXIT_FAILURE;
   }
 
-  /* create UDP socket for incoming datagrams */
-  UDPSocket socket;
+  /* with only a delay, ack as many datagrams as fit; with only
+     a count, wait no longer than the default delay */
+  const bool coalesce = ack_every > 1 or ack_delay > 0;
+  if ( ack_every == 0 ) {
+    ack_every = coalesce ? CoalescedAck::MAX_DATAGRAMS : 1;
+  }
+  if ( coalesce and ack_delay == 0 ) {
+    ack_delay = DEFAULT_ACK_DELAY;
+  }
+
+  /* one socket per worker, all bound to the port (the kernel spreads
+     senders among them, by address or, with --steer-by-cpu, by the
+     CPU that received the datagram) */
+  vector<unique_ptr<UDPSocket>> sockets;
+  for ( unsigned int i = 0; i < workers; i++ ) {
+    sockets.emplace_back( new UDPSocket() );
+    UDPSocket & socket = *sockets.back();
+
+    /* turn on timestamps on receipt */
+    socket.set_timestamps();
+
+    if ( workers > 1 ) {
+      socket.set_reuseport();
+    }
+
+    /* "bind" the socket to the user-specified local port number */
+    socket.bind( Address( "::0", argv[ 1 ] ) );
+
+    /* optionally receive and send through io_uring */
+    if ( use_io_uring and not socket.enable_io_uring() ) {
+      LOG( Warning, "io_uring not supported, using system calls" );
+      use_io_uring = false;
+    }
+
+    /* optionally take runs of datagrams from the kernel as one
+       (io_uring's receive buffers are too small for them) */
+    if ( gro and not socket.enable_gro() ) {
+      LOG( Warning, "UDP receive offload not supported{}, receiving datagrams one by one",
+	   use_io_uring ? " with io_uring" : "" );
+      gro = false;
+    }
+  }
+
+  if ( steer_by_cpu and workers > 1 ) {
+    sockets.front()->steer_by_cpu( workers );
+  }
 
-  /* turn on timestamps on receipt */
-  socket.set_timestamps();
+  LOG( Info, "Listening on {}", sockets.front()->local_address().to_string() );
+  if ( coalesce ) {
+    LOG( Info, "Acking every {} datagrams or after {} us", ack_every, ack_delay );
+  }
 
-  /* "bind" the socket to the user-specified local port number */
-  socket.bind( Address( "::0", argv[ 1 ] ) );
+  const Poller::Backend engine = use_io_uring ? Poller::Backend::IoUring : Poller::Backend::Poll;
+  const auto serve = [&] ( UDPSocket & socket ) {
+    if ( coalesce ) {
+      ack_coalesced( socket, engine, ack_every, ack_delay );
+    } else {
+      ack_every_datagram( socket );
+    }
+  };
 
-  cerr << "Listening on " << socket.local_address().to_string() << endl;
+  if ( workers == 1 ) {
+    serve( *sockets.front() );
+    return EXIT_SUCCESS;
+  }
 
-  uint64_t sequence_number = 0;
+  /* each worker on its own CPU (of those we may use), with its own
+     socket and its own senders' ack state */
+  const vector<unsigned int> cpus = allowed_cpus();
+  LOG( Info, "{} workers on {} CPUs", workers, cpus.size() );
 
-  /* Loop and acknowledge every incoming datagram back to its source */
-  while ( true ) {
-    const UDPSocket::received_datagram recd = socket.recv();
-    ContestMessage message = recd.payload;
+  vector<thread> threads;
+  for ( unsigned int i = 0; i < workers; i++ ) {
+    threads.emplace_back( [&, i] () {
+	try {
+	  const unsigned int cpu = cpus.at( i % cpus.size() );
 
-    /* assemble the acknowledgment */
-    message.transform_into_ack( sequence_number++, recd.timestamp );
+	  /* (a worker that can't be pinned still works, just less well) */
+	  try {
+	    pin_thread_to_cpu( cpu );
+	  } catch ( const unix_error & e ) {
+	    LOG( Warning, "worker {} not pinned to CPU {}: {}", i, cpu, e.what() );
+	  }
 
-    /* timestamp the ack just before sending */
-    message.set_send_timestamp();
+	  sockets[ i ]->set_incoming_cpu( cpu );
+	  serve( *sockets[ i ] );
+	} catch ( const exception & e ) {
+	  print_exception( e );
+	  exit( EXIT_FAILURE );
+	}
+      } );
+  }
 
-    /* send the ack */
-    socket.sendto( recd.source_address, message.to_string() );
+  for ( auto & thread : threads ) {
+    thread.join();
   }
 
   return EXIT_SUCCESS;
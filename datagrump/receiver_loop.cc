@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "receiver_loop.hh"
+#include "contest_message.hh"
+#include "ack_coalescer.hh"
+#include "timestamp.hh"
+#include "log.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* most datagrams to receive with one system call */
+static const size_t RECV_BATCH_SIZE = 64;
+
+/* packet buffers for each socket: a batch received, and as many acks
+   again waiting to go out, with room to spare */
+static const size_t PACKET_POOL_SIZE = 4 * RECV_BATCH_SIZE;
+
+/* flow ids come from the wire, so anyone can make up more: most flows
+   (and senders of each) to keep acks for, how long a flow goes unheard
+   before it may be forgotten to make room (in microseconds), and how
+   often to look for such flows when there is no room */
+static const size_t MAX_FLOWS = 4096;
+static const size_t MAX_PEERS_PER_FLOW = 16;
+static const uint64_t FLOW_IDLE_TIME = 10000000;
+static const uint64_t FLOW_SWEEP_INTERVAL = 1000000;
+
+/* Is this a contest message? A stray datagram too short for a header
+   is dropped and counted in malformed, rather than acked (or viewed) */
+static bool well_formed( const UDPSocket::received_packet & recd, uint64_t & malformed )
+{
+  if ( ContestMessageView::fits( recd.buffer ) ) {
+    return true;
+  }
+
+  malformed++;
+  LOG( Warning, "dropped a datagram too short for a header from {} ({} so far)",
+       recd.source_address.to_string(), malformed );
+  return false;
+}
+
+/* Loop and acknowledge every incoming datagram back to its source */
+void ack_every_datagram( UDPSocket & socket )
+{
+  uint64_t sequence_number = 0;
+  uint64_t malformed = 0;
+
+  /* the current batch, received into buffers from the pool, and
+     its acks, each pointing into its received datagram */
+  PacketPool pool( PACKET_POOL_SIZE );
+  vector<UDPSocket::received_packet> batch;
+  vector<UDPSocket::gathered_datagram> acks;
+
+  while ( true ) {
+    socket.recv_batch( RECV_BATCH_SIZE, pool, batch );
+    acks.clear();
+
+    for ( auto & recd : batch ) {
+      if ( not well_formed( recd, malformed ) ) {
+	continue;
+      }
+
+      char * const datagram = recd.buffer.data();
+
+      /* turn the datagram into its own acknowledgment (rewriting only the header) */
+      ContestMessage::transform_into_ack_in_place( datagram, recd.buffer.length(),
+						   sequence_number++, recd.timestamp );
+
+      /* send back just the header */
+      acks.push_back( { datagram, ContestMessage::Header::SIZE,
+			nullptr, 0, &recd.source_address } );
+    }
+
+    socket.send_batch( acks );
+  }
+}
+
+/* Loop and acknowledge incoming datagrams several at a time: every
+   ack_every datagrams, ack_delay after the first one waiting, or at
+   once if one arrives out of order */
+void ack_coalesced( UDPSocket & socket, const Poller::Backend engine,
+		    const unsigned int ack_every, const uint64_t ack_delay )
+{
+  uint64_t sequence_number = 0;
+  uint64_t malformed = 0;
+
+  /* each flow's acks, by flow id and then by sender (a deque, so that
+     peers stay put as more arrive), each with its delayed-ack timer,
+     and when the flow was last heard from */
+  struct Peer
+  {
+    Address address;
+    AckCoalescer coalescer;
+    Poller::TimerId timer;
+    bool timer_armed;
+    uint64_t timer_deadline;
+  };
+  struct Flow
+  {
+    deque<Peer> peers;
+    uint64_t last_heard;
+  };
+  unordered_map<uint64_t, Flow> flows;
+  uint64_t next_sweep = 0;
+
+  /* datagrams of flows (or senders) dropped for want of room */
+  uint64_t unknown_dropped = 0;
+
+  /* datagrams received, and acks ready to go out with the next
+     send_batch(), in buffers from the pool */
+  PacketPool pool( PACKET_POOL_SIZE );
+  vector<UDPSocket::received_packet> batch;
+  vector<PacketBuffer> payloads;
+  vector<const Address *> destinations;
+  vector<UDPSocket::gathered_datagram> acks;
+
+  const auto queue_ack = [&] ( Peer & peer ) {
+    payloads.push_back( peer.coalescer.make_ack( sequence_number++, pool ) );
+    destinations.push_back( &peer.address );
+  };
+
+  const auto flush = [&] () {
+    acks.clear();
+    for ( size_t i = 0; i < payloads.size(); i++ ) {
+      acks.push_back( { payloads[ i ].data(), payloads[ i ].length(), nullptr, 0, destinations[ i ] } );
+    }
+    if ( not acks.empty() ) {
+      socket.send_batch( acks );
+    }
+    payloads.clear();
+    destinations.clear();
+  };
+
+  Poller poller( engine );
+
+  /* forget the flows not heard from lately (and their timers) */
+  const auto sweep = [&] ( const uint64_t now ) {
+    for ( auto flow = flows.begin(); flow != flows.end(); ) {
+      if ( now - flow->second.last_heard < FLOW_IDLE_TIME ) {
+	++flow;
+	continue;
+      }
+
+      for ( const auto & peer : flow->second.peers ) {
+	if ( peer.timer_armed ) {
+	  poller.cancel_timer( peer.timer );
+	}
+      }
+      flow = flows.erase( flow );
+    }
+  };
+
+  /* find the flow, making room for a new one if need be (nullptr if there is none) */
+  const auto find_flow = [&] ( const uint64_t flow_id, const uint64_t now ) -> Flow * {
+    auto flow = flows.find( flow_id );
+    if ( flow == flows.end() ) {
+      if ( flows.size() >= MAX_FLOWS and now >= next_sweep ) {
+	sweep( now );
+	next_sweep = now + FLOW_SWEEP_INTERVAL;
+      }
+      if ( flows.size() >= MAX_FLOWS ) {
+	return nullptr;
+      }
+      flow = flows.emplace( flow_id, Flow { deque<Peer>(), now } ).first;
+    }
+
+    flow->second.last_heard = now;
+    return &flow->second;
+  };
+
+  const auto drop_unknown = [&] ( const UDPSocket::received_packet & recd ) {
+    unknown_dropped++;
+    LOG( Warning, "no room for a flow from {}: dropped ({} so far)",
+	 recd.source_address.to_string(), unknown_dropped );
+  };
+
+  poller.add_action( Action( socket.receive_event_fd(), Direction::In, [&] () {
+	socket.recv_batch( RECV_BATCH_SIZE, pool, batch );
+	const uint64_t now = timestamp_us();
+	for ( const auto & recd : batch ) {
+	  if ( not well_formed( recd, malformed ) ) {
+	    continue;
+	  }
+
+	  const ContestMessageView datagram( recd.buffer );
+
+	  Flow * const flow = find_flow( datagram.flow_id(), now );
+	  if ( not flow ) {
+	    drop_unknown( recd );
+	    continue;
+	  }
+
+	  auto & peers = flow->peers;
+	  auto peer = find_if( peers.begin(), peers.end(), [&] ( const Peer & p ) {
+	      return p.address == recd.source_address;
+	    } );
+	  if ( peer == peers.end() ) {
+	    if ( peers.size() >= MAX_PEERS_PER_FLOW ) {
+	      drop_unknown( recd );
+	      continue;
+	    }
+	    peers.push_back( { recd.source_address, AckCoalescer( ack_every, ack_delay ), 0, false, 0 } );
+	    peer = peers.end() - 1;
+	  }
+
+	  if ( peer->coalescer.received( datagram, recd.timestamp ) ) {
+	    queue_ack( *peer );
+	  } else if ( not peer->timer_armed ) {
+	    /* ack whatever is waiting by its deadline at the latest */
+	    Peer * const waiting = &*peer;
+	    waiting->timer = poller.add_timer( waiting->coalescer.deadline(), [&, waiting] () {
+		waiting->timer_armed = false;
+		if ( waiting->coalescer.pending() ) {
+		  queue_ack( *waiting );
+		  flush();
+		}
+		return ResultType::Continue;
+	      } );
+	    waiting->timer_armed = true;
+	    waiting->timer_deadline = waiting->coalescer.deadline();
+	  } else if ( peer->timer_deadline != peer->coalescer.deadline() ) {
+	    poller.rearm_timer( peer->timer, peer->coalescer.deadline() );
+	    peer->timer_deadline = peer->coalescer.deadline();
+	  }
+	}
+	flush();
+	return ResultType::Continue;
+      } ) );
+
+  while ( true ) {
+    poller.poll( -1 );
+  }
+}
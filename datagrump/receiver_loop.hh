@@ -0,0 +1,20 @@
+#ifndef RECEIVER_LOOP_HH
+#define RECEIVER_LOOP_HH
+
+#include <cstdint>
+
+#include "poller.hh"
+#include "socket.hh"
+
+/* The receiver's work, on one socket (forever) */
+
+/* Acknowledge every incoming datagram back to its source */
+void ack_every_datagram( UDPSocket & socket );
+
+/* Acknowledge incoming datagrams several at a time: every ack_every
+   datagrams, ack_delay (in microseconds) after the first one waiting,
+   or at once if one arrives out of order */
+void ack_coalesced( UDPSocket & socket, const Poller::Backend engine,
+		    const unsigned int ack_every, const uint64_t ack_delay );
+
+#endif /* RECEIVER_LOOP_HH */
@@ -0,0 +1,76 @@
+#include <algorithm>
+
+#include "reno_controller.hh"
+#include "log.hh"
+
+using namespace std;
+
+/* Initial and smallest windows (in datagrams) */
+static const double INITIAL_CWND = 10;
+static const double MIN_CWND = 2;
+
+RenoController::RenoController()
+  : Controller(), cwnd( INITIAL_CWND ), ssthresh( 1e9 ), recovery_end( 0 )
+{}
+
+/* Get current window size, in datagrams */
+unsigned int RenoController::window_size()
+{
+  return cwnd;
+}
+
+/* A datagram was sent */
+void RenoController::datagram_was_sent( const uint64_t sequence_number,
+					const uint64_t send_timestamp,
+					const uint64_t payload_length,
+					const bool after_timeout )
+{
+  LOG( Debug, "At time {} sent datagram {} (timeout = {})",
+       send_timestamp, sequence_number, after_timeout );
+
+  count_sent( sequence_number, send_timestamp, payload_length, after_timeout );
+
+  /* a timeout means the whole window was lost: start over from one datagram */
+  if ( after_timeout ) {
+    ssthresh = max( cwnd / 2, MIN_CWND );
+    cwnd = 1;
+    recovery_end = next_sequence_number;
+  }
+}
+
+/* An ack was received */
+void RenoController::ack_received( const uint64_t sequence_number_acked,
+				   const uint64_t send_timestamp_acked,
+				   const uint64_t,
+				   const uint64_t timestamp_ack_received,
+				   const uint64_t payload_length,
+				   const uint64_t,
+				   const uint64_t )
+{
+  uint64_t lost;
+  const bool news = count_acked( sequence_number_acked, send_timestamp_acked,
+				 timestamp_ack_received, payload_length, lost );
+
+  if ( lost and sequence_number_acked >= recovery_end ) {
+    /* multiplicative decrease, once per window */
+    ssthresh = max( cwnd / 2, MIN_CWND );
+    cwnd = ssthresh;
+    recovery_end = next_sequence_number;
+  } else if ( not news ) {
+    /* (a duplicate or stale ack doesn't grow the window) */
+  } else if ( cwnd < ssthresh ) {
+    /* slow start: one more datagram per ack */
+    cwnd += 1;
+  } else {
+    /* additive increase: one more datagram per window */
+    cwnd += 1 / cwnd;
+  }
+
+  LOG( Debug, "At time {} window is {} (ssthresh {}, {} lost)",
+       timestamp_ack_received, cwnd, ssthresh, lost );
+}
+
+bool RenoController::window_is_open()
+{
+  return inflight < window_size();
+}
@@ -0,0 +1,42 @@
+#ifndef RENO_CONTROLLER_HH
+#define RENO_CONTROLLER_HH
+
+#include "controller.hh"
+
+/* Reno (AIMD): slow start, then one more datagram per RTT, halving
+   the window once per window of data in which a loss shows up */
+
+class RenoController final : public Controller
+{
+private:
+  double cwnd; /* in datagrams */
+  double ssthresh; /* slow start until cwnd reaches this */
+
+  /* no further cuts until the datagrams in flight at the last cut are acked */
+  uint64_t recovery_end;
+
+public:
+  /* Name to pick this algorithm by */
+  static std::string name() { return "reno"; }
+
+  RenoController();
+
+  unsigned int window_size() override;
+
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t payload_length,
+			  const bool after_timeout ) override;
+
+  void ack_received( const uint64_t sequence_number_acked,
+		     const uint64_t send_timestamp_acked,
+		     const uint64_t recv_timestamp_acked,
+		     const uint64_t timestamp_ack_received,
+		     const uint64_t payload_length,
+		     const uint64_t packet_delivered,
+		     const uint64_t packet_delivered_time ) override;
+
+  bool window_is_open() override;
+};
+
+#endif /* RENO_CONTROLLER_HH */
@@ -0,0 +1,190 @@
+/* load test of the multi-worker receiver on loopback: for 1, 2, ...
+   workers sharing a port with SO_REUSEPORT (each pinned to a CPU, and
+   running the receiver's own loop), a fixed set of sender threads
+   keeps windows of contest-sized datagrams in flight, and the
+   datagrams acked per second show how the receiver scales */
+
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "contest_message.hh"
+#include "receiver_loop.hh"
+#include "socket.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* datagrams each sender keeps in flight */
+static const size_t WINDOW = 64;
+
+/* how long a sender waits for acks before taking its window as lost (in ms) */
+static const int LOSS_TIMEOUT = 10;
+
+/* send windows to the receiver until told to stop, counting acks */
+static void send_load( const Address & receiver, const unsigned int cpu,
+		       const atomic<bool> & running, atomic<uint64_t> & total_acked )
+{
+  pin_thread_to_cpu( cpu );
+
+  UDPSocket socket;
+  socket.connect( receiver );
+
+  const string payload( 1424, 'x' );
+  vector<char> headers( WINDOW * ContestMessage::Header::SIZE );
+  vector<UDPSocket::gathered_datagram> outgoing;
+
+  uint64_t sequence_number = 0, in_flight = 0, acked = 0;
+
+  while ( running ) {
+    outgoing.clear();
+    while ( in_flight + outgoing.size() < WINDOW ) {
+      ContestMessage::Header header( sequence_number++, 0, 0 );
+      header.set_send_timestamp();
+      char * const buffer = &headers[ outgoing.size() * ContestMessage::Header::SIZE ];
+      header.serialize( buffer );
+      outgoing.push_back( { buffer, ContestMessage::Header::SIZE,
+			    payload.data(), payload.size(), nullptr } );
+    }
+    if ( not outgoing.empty() ) {
+      socket.send_batch( outgoing );
+      in_flight += outgoing.size();
+    }
+
+    pollfd waiting { socket.fd_num(), POLLIN, 0 };
+    if ( SystemCall( "poll", poll( &waiting, 1, LOSS_TIMEOUT ) ) == 0 ) {
+      in_flight = 0;
+      continue;
+    }
+
+    const size_t count = socket.recv_batch( WINDOW ).size();
+    in_flight -= min( in_flight, uint64_t( count ) );
+    acked += count;
+  }
+
+  total_acked += acked;
+}
+
+/* datagrams acked per second by a receiver with this many workers */
+static double run( const unsigned int workers, const unsigned int senders,
+		   const bool steer_by_cpu, const uint64_t duration_ms,
+		   vector<unique_ptr<UDPSocket>> & sockets )
+{
+  const vector<unsigned int> cpus = allowed_cpus();
+
+  /* the receiver's sockets, bound in order (to a fresh port) */
+  const size_t first = sockets.size();
+  for ( unsigned int i = 0; i < workers; i++ ) {
+    sockets.emplace_back( new UDPSocket() );
+    sockets.back()->set_reuseport();
+    sockets.back()->set_timestamps();
+    sockets.back()->bind( i == 0 ? Address( "::1", 0 ) : sockets[ first ]->local_address() );
+  }
+  if ( steer_by_cpu ) {
+    sockets[ first ]->steer_by_cpu( workers );
+  }
+
+  /* (the workers run forever, as the receiver's do) */
+  for ( unsigned int i = 0; i < workers; i++ ) {
+    UDPSocket * const socket = sockets[ first + i ].get();
+    thread( [socket, i, cpus] () {
+	try {
+	  pin_thread_to_cpu( cpus.at( i % cpus.size() ) );
+	  socket->set_incoming_cpu( cpus.at( i % cpus.size() ) );
+	  ack_every_datagram( *socket );
+	} catch ( const exception & e ) {
+	  print_exception( e );
+	  exit( EXIT_FAILURE );
+	}
+      } ).detach();
+  }
+
+  atomic<bool> running( true );
+  atomic<uint64_t> acked( 0 );
+  const Address receiver = sockets[ first ]->local_address();
+
+  vector<thread> threads;
+  for ( unsigned int i = 0; i < senders; i++ ) {
+    threads.emplace_back( send_load, receiver, cpus.at( i % cpus.size() ), ref( running ), ref( acked ) );
+  }
+
+  const uint64_t start = timestamp_ms();
+  this_thread::sleep_for( chrono::milliseconds( duration_ms ) );
+  running = false;
+  for ( auto & thread : threads ) {
+    thread.join();
+  }
+
+  return acked * 1000.0 / (timestamp_ms() - start);
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  unsigned int max_workers = allowed_cpus().size();
+  unsigned int senders = 2 * max_workers;
+  uint64_t duration_ms = 2000;
+  bool steer_by_cpu = false;
+  bool usage_ok = true;
+
+  for ( int i = 1; usage_ok and i < argc; i++ ) {
+    const string arg( argv[ i ] );
+    if ( arg.compare( 0, 10, "--workers=" ) == 0 ) {
+      max_workers = strtoul( arg.c_str() + 10, nullptr, 10 );
+      usage_ok = max_workers >= 1;
+    } else if ( arg.compare( 0, 10, "--senders=" ) == 0 ) {
+      senders = strtoul( arg.c_str() + 10, nullptr, 10 );
+      usage_ok = senders >= 1;
+    } else if ( arg.compare( 0, 11, "--duration=" ) == 0 ) {
+      duration_ms = strtoull( arg.c_str() + 11, nullptr, 10 );
+      usage_ok = duration_ms >= 1;
+    } else if ( arg == "--steer-by-cpu" ) {
+      steer_by_cpu = true;
+    } else {
+      usage_ok = false;
+    }
+  }
+
+  if ( not usage_ok ) {
+    cerr << "Usage: " << argv[ 0 ] << " [--workers=MAX] [--senders=N]"
+	 << " [--duration=MS] [--steer-by-cpu]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    cout << "# " << allowed_cpus().size() << " CPUs, " << senders << " senders"
+	 << (steer_by_cpu ? ", steered by CPU" : "") << endl;
+    cout << "workers\tdatagrams/s\tscaling" << endl;
+
+    /* the sockets of every run outlive the workers using them */
+    vector<unique_ptr<UDPSocket>> sockets;
+    double base = 0;
+    for ( unsigned int workers = 1; workers <= max_workers; workers++ ) {
+      const double rate = run( workers, senders, steer_by_cpu, duration_ms, sockets );
+      if ( workers == 1 ) {
+	base = rate;
+      }
+      cout << workers << "\t" << fixed << setprecision( 0 ) << rate << "\t"
+	   << setprecision( 2 ) << (base > 0 ? rate / base : 0) << "x" << endl;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  /* leave without waiting for the workers, which never finish */
+  cout.flush();
+  quick_exit( EXIT_SUCCESS );
+}
@@ -0,0 +1,137 @@
+/* the receiver gives up on the oldest hole once it tracks too many:
+   the sender must then not take the datagrams in those holes as having
+   arrived, but as lost (so that they are sent again). Half of the first
+   100 datagrams never arrive (50 holes), the rest all do, and only the
+   last ack gets back to the sender. What it does sack counts as
+   delivered (once, though some are acked as well). */
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+
+#include "ack_coalescer.hh"
+#include "controller.hh"
+#include "contest_message.hh"
+
+using namespace std;
+
+static const uint64_t DATAGRAMS = 200;
+static const uint64_t HOLES_BEFORE = 100; /* (every odd sequence number below this) */
+static const uint64_t PAYLOAD_LENGTH = 1424;
+
+static bool arrives( const uint64_t sequence_number )
+{
+  return sequence_number >= HOLES_BEFORE or sequence_number % 2 == 0;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << endl;
+    return EXIT_FAILURE;
+  }
+
+  uint64_t now = 1000000;
+  unique_ptr<Controller> controller = Controller::make( "reno" );
+  controller->set_clock( &now );
+  controller->keep_lost( true );
+
+  /* the sender sends them all, 10 us apart */
+  for ( uint64_t sequence_number = 0; sequence_number < DATAGRAMS; sequence_number++ ) {
+    controller->datagram_was_sent( sequence_number, now, PAYLOAD_LENGTH, false );
+    now += 10;
+  }
+
+  /* the receiver gets what arrives, and makes its acks (all lost but the last) */
+  PacketPool pool( 4 );
+  AckCoalescer coalescer( 16, 1000 );
+  PacketBuffer last_ack;
+  uint64_t ack_sequence_number = 0;
+
+  for ( uint64_t sequence_number = 0; sequence_number < DATAGRAMS; sequence_number++ ) {
+    if ( not arrives( sequence_number ) ) {
+      continue;
+    }
+
+    ContestMessage::Header header( sequence_number, 0, 0 );
+    header.send_timestamp = 1000000 + 10 * sequence_number;
+    PacketBuffer datagram = pool.acquire();
+    header.serialize( datagram );
+    datagram.set_length( ContestMessage::Header::SIZE + PAYLOAD_LENGTH );
+
+    if ( coalescer.received( ContestMessageView( datagram ), now ) ) {
+      last_ack = coalescer.make_ack( ack_sequence_number++, pool );
+    }
+  }
+
+  if ( coalescer.pending() ) {
+    last_ack = coalescer.make_ack( ack_sequence_number++, pool );
+  }
+
+  CoalescedAck ack;
+  if ( not ack.parse( ContestMessageView( last_ack ) ) ) {
+    cerr << "FAIL: the last ack is malformed" << endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( ack.holes_below == 0 ) {
+    cerr << "FAIL: the receiver gave up on no holes" << endl;
+    return EXIT_FAILURE;
+  }
+
+  now += 100;
+  controller->acks_received( ack, now, now );
+
+  /* nothing that never arrived may be sacked */
+  set<uint64_t> delivered;
+  for ( const auto & datagram : ack.datagrams ) {
+    delivered.insert( datagram.sequence_number );
+  }
+
+  unsigned int sacked = 0;
+  uint64_t sequence_number;
+  while ( controller->take_sacked( sequence_number ) ) {
+    sacked++;
+    delivered.insert( sequence_number );
+    if ( not arrives( sequence_number ) ) {
+      cerr << "FAIL: datagram " << sequence_number << " sacked, but it never arrived" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if ( sacked == 0 ) {
+    cerr << "FAIL: nothing sacked" << endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( controller->get_delivered() != delivered.size() * PAYLOAD_LENGTH ) {
+    cerr << "FAIL: " << controller->get_delivered() << " bytes counted as delivered, not "
+	 << delivered.size() * PAYLOAD_LENGTH << endl;
+    return EXIT_FAILURE;
+  }
+
+  /* and every one of them is lost once its reordering window is over */
+  now += 10000000;
+  controller->detect_losses();
+
+  set<uint64_t> lost;
+  while ( controller->take_lost( sequence_number ) ) {
+    lost.insert( sequence_number );
+  }
+
+  for ( sequence_number = 0; sequence_number < DATAGRAMS; sequence_number++ ) {
+    if ( not arrives( sequence_number ) and not lost.count( sequence_number ) ) {
+      cerr << "FAIL: datagram " << sequence_number << " never arrived, but is not lost" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  cout << "holes given up on below " << ack.holes_below << ", cumulative ack " << ack.cumulative_ack
+       << ": " << sacked << " sacked, " << lost.size() << " lost" << endl;
+
+  return EXIT_SUCCESS;
+}
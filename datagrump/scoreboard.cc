@@ -0,0 +1,172 @@
+#include <algorithm>
+
+#include "scoreboard.hh"
+
+using namespace std;
+
+/* Most the reordering window grows to (in min RTTs / 4) */
+static const unsigned int MAX_REORDERING_WINDOW_QUARTERS = 16;
+
+Scoreboard::Scoreboard()
+  : ring_( INITIAL_CAPACITY ),
+    head_( 0 ), first_in_flight_( 0 ), next_( 0 ),
+    in_flight_( 0 ), bytes_in_flight_( 0 ),
+    rack_sequence_number_( 0 ), rack_rtt_( 0 ),
+    reordering_seen_( false ), reordering_window_quarters_( 1 ),
+    loss_time_( 0 ),
+    keep_lost_( false ), lost_(), sacked_()
+{}
+
+/* double the ring, keeping each entry at its sequence number */
+void Scoreboard::grow()
+{
+  vector<Entry> bigger( 2 * ring_.size() );
+  for ( uint64_t sequence_number = head_; sequence_number < next_; sequence_number++ ) {
+    bigger[ sequence_number & (bigger.size() - 1) ] = at( sequence_number );
+  }
+  ring_.swap( bigger );
+}
+
+void Scoreboard::sent( const uint64_t sequence_number, const uint64_t send_timestamp,
+		       const uint64_t payload_length, const DeliverySnapshot & delivery )
+{
+  if ( sequence_number < next_ ) {
+    return;
+  }
+
+  /* (any sequence numbers skipped were never in flight) */
+  for ( ; next_ <= sequence_number; next_++ ) {
+    if ( next_ - head_ >= ring_.size() ) {
+      /* make room by forgetting what's no longer in flight, or else grow */
+      head_ = first_in_flight_;
+      if ( next_ - head_ >= ring_.size() ) {
+	grow();
+      }
+    }
+    at( next_ ) = { next_, 0, 0, {}, Entry::Empty };
+  }
+
+  at( sequence_number ) = { sequence_number, send_timestamp, payload_length, delivery, Entry::InFlight };
+  in_flight_++;
+  bytes_in_flight_ += payload_length;
+}
+
+void Scoreboard::mark_lost( Entry & entry )
+{
+  entry.state = Entry::Lost;
+  in_flight_--;
+  bytes_in_flight_ -= entry.payload_length;
+
+  if ( keep_lost_ ) {
+    lost_.push_back( entry.sequence_number );
+  }
+}
+
+void Scoreboard::advance_first_in_flight()
+{
+  while ( first_in_flight_ < next_ and at( first_in_flight_ ).state != Entry::InFlight ) {
+    first_in_flight_++;
+  }
+}
+
+const Scoreboard::Entry * Scoreboard::acked( const uint64_t sequence_number,
+					     const uint64_t timestamp_ack_received,
+					     bool & was_sacked )
+{
+  if ( sequence_number < head_ or sequence_number >= next_ ) {
+    return nullptr;
+  }
+
+  Entry & entry = at( sequence_number );
+  was_sacked = entry.state == Entry::Sacked;
+  if ( entry.state == Entry::InFlight ) {
+    in_flight_--;
+    bytes_in_flight_ -= entry.payload_length;
+  } else if ( entry.state == Entry::Lost ) {
+    /* it was only late: be slower to give up on the next ones */
+    reordering_window_quarters_ = min( reordering_window_quarters_ + 1,
+				       MAX_REORDERING_WINDOW_QUARTERS );
+  } else if ( entry.state != Entry::Sacked ) {
+    return nullptr;
+  }
+  entry.state = Entry::Acked;
+
+  /* an ack of something older than the newest acked means reordering */
+  if ( sequence_number < rack_sequence_number_ ) {
+    reordering_seen_ = true;
+  } else {
+    rack_sequence_number_ = sequence_number;
+    rack_rtt_ = timestamp_ack_received > entry.send_timestamp
+      ? timestamp_ack_received - entry.send_timestamp : 0;
+  }
+
+  advance_first_in_flight();
+  return &entry;
+}
+
+uint64_t Scoreboard::detect_losses( const uint64_t now, const double min_rtt, const double srtt )
+{
+  const uint64_t reordering_window = reordering_seen_
+    ? min( reordering_window_quarters_ * min_rtt / 4, srtt ) : 0;
+
+  uint64_t lost = 0;
+  loss_time_ = 0;
+
+  for ( uint64_t sequence_number = first_in_flight_; sequence_number < rack_sequence_number_; sequence_number++ ) {
+    Entry & entry = at( sequence_number );
+    if ( entry.state != Entry::InFlight ) {
+      continue;
+    }
+
+    const uint64_t deadline = entry.send_timestamp + rack_rtt_ + reordering_window;
+    if ( now < deadline ) {
+      /* (everything after it was sent later, so is due later) */
+      loss_time_ = deadline;
+      break;
+    }
+
+    mark_lost( entry );
+    lost++;
+  }
+
+  advance_first_in_flight();
+  return lost;
+}
+
+uint64_t Scoreboard::mark_all_lost()
+{
+  const uint64_t lost = in_flight_;
+
+  for ( uint64_t sequence_number = first_in_flight_; sequence_number < next_; sequence_number++ ) {
+    Entry & entry = at( sequence_number );
+    if ( entry.state == Entry::InFlight ) {
+      mark_lost( entry );
+    }
+  }
+
+  loss_time_ = 0;
+  advance_first_in_flight();
+  return lost;
+}
+
+bool Scoreboard::take_lost( uint64_t & sequence_number )
+{
+  if ( lost_.empty() ) {
+    return false;
+  }
+
+  sequence_number = lost_.front();
+  lost_.pop_front();
+  return true;
+}
+
+bool Scoreboard::take_sacked( uint64_t & sequence_number )
+{
+  if ( sacked_.empty() ) {
+    return false;
+  }
+
+  sequence_number = sacked_.front();
+  sacked_.pop_front();
+  return true;
+}
@@ -0,0 +1,154 @@
+#ifndef SCOREBOARD_HH
+#define SCOREBOARD_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "rate_sampler.hh"
+
+/* The sender's record of the datagrams it has sent and not yet seen
+   acked or given up on, in a ring buffer indexed by sequence number.
+
+   Losses are detected by time, as in RACK (RFC 8985): once a datagram
+   sent later has been acked, an earlier one still unacked is lost when
+   it has been out for the later one's RTT plus a reordering window.
+   (Every transmission has a new sequence number, so sequence order is
+   send order, and the oldest datagrams are always checked first.)
+
+   A coalesced ack's cumulative ack and SACK ranges also say which
+   datagrams have arrived, even those whose own acks were lost: these
+   are sacked, so loss detection leaves them be, and they count as
+   delivered right away. The ack of their own (if it comes) still gives
+   the RTT sample. */
+class Scoreboard
+{
+public:
+  struct Entry
+  {
+    enum State : uint8_t { Empty, InFlight, Sacked, Acked, Lost };
+
+    uint64_t sequence_number;
+    uint64_t send_timestamp; /* in microseconds */
+    uint64_t payload_length; /* in bytes */
+    DeliverySnapshot delivery; /* when it was sent, for its rate sample */
+    State state;
+  };
+
+private:
+  /* Room for the first datagrams (it doubles when full) */
+  static const size_t INITIAL_CAPACITY = 256;
+
+  /* Entries by sequence number modulo the (power-of-two) size */
+  std::vector<Entry> ring_;
+
+  /* The oldest sequence number remembered (a datagram acked late,
+     after it was taken as lost, is recognized until the ring needs
+     its room), the oldest that may be in flight, and the one after
+     the newest sent */
+  uint64_t head_;
+  uint64_t first_in_flight_;
+  uint64_t next_;
+
+  unsigned int in_flight_;
+  uint64_t bytes_in_flight_;
+
+  /* RACK: the newest datagram acked (by sequence number, so also the
+     most recently sent), and its RTT */
+  uint64_t rack_sequence_number_;
+  uint64_t rack_rtt_;
+
+  /* Has an ack arrived out of order? (until then, the reordering window
+     is 0), and how many min RTTs / 4 it is (grows with each datagram
+     taken as lost that turns out to have arrived) */
+  bool reordering_seen_;
+  unsigned int reordering_window_quarters_;
+
+  /* When the oldest datagram still in its reordering window
+     will be lost (0 if there is none) */
+  uint64_t loss_time_;
+
+  /* Sequence numbers taken as lost, and sacked, until the sender takes them */
+  bool keep_lost_;
+  std::deque<uint64_t> lost_;
+  std::deque<uint64_t> sacked_;
+
+  Entry & at( const uint64_t sequence_number ) { return ring_[ sequence_number & (ring_.size() - 1) ]; }
+
+  void grow();
+  void mark_lost( Entry & entry );
+  void advance_first_in_flight();
+
+public:
+  Scoreboard();
+
+  /* A datagram was sent (with a higher sequence number than any before) */
+  void sent( const uint64_t sequence_number, const uint64_t send_timestamp,
+	     const uint64_t payload_length, const DeliverySnapshot & delivery );
+
+  /* A datagram was acked: returns its entry if this is news (nullptr if
+     it was acked before, or has been forgotten), with was_sacked set if
+     it had been sacked (so was counted as delivered then) */
+  const Entry * acked( const uint64_t sequence_number, const uint64_t timestamp_ack_received,
+		       bool & was_sacked );
+
+  /* The receiver has every datagram in [begin, end): each one still in
+     flight is sacked, and handed to delivered( entry ) (one already
+     taken as lost stays lost until its own ack comes, since its data
+     may already have been sent again). Returns how many were sacked. */
+  template <class Delivered>
+  uint64_t sacked( const uint64_t begin, const uint64_t end, Delivered && delivered );
+
+  /* Take as lost every datagram whose reordering window has passed
+     (given the connection's min and smoothed RTTs); returns how many */
+  uint64_t detect_losses( const uint64_t now, const double min_rtt, const double srtt );
+
+  /* Take everything in flight as lost (after a retransmission timeout);
+     returns how many */
+  uint64_t mark_all_lost();
+
+  unsigned int in_flight() const { return in_flight_; }
+  uint64_t bytes_in_flight() const { return bytes_in_flight_; }
+  uint64_t loss_time() const { return loss_time_; }
+
+  /* Keep the sequence numbers of lost and sacked datagrams
+     for take_lost() and take_sacked() */
+  void keep_lost( const bool keep ) { keep_lost_ = keep; }
+
+  /* The oldest lost (or sacked) sequence number not yet taken, if any */
+  bool take_lost( uint64_t & sequence_number );
+  bool take_sacked( uint64_t & sequence_number );
+};
+
+template <class Delivered>
+uint64_t Scoreboard::sacked( const uint64_t begin, const uint64_t end, Delivered && delivered )
+{
+  uint64_t sacked = 0;
+
+  /* (nothing before first_in_flight_ is in flight) */
+  const uint64_t last = std::min( end, next_ );
+  for ( uint64_t sequence_number = std::max( begin, first_in_flight_ );
+	sequence_number < last; sequence_number++ ) {
+    Entry & entry = at( sequence_number );
+    if ( entry.state != Entry::InFlight ) {
+      continue;
+    }
+
+    entry.state = Entry::Sacked;
+    in_flight_--;
+    bytes_in_flight_ -= entry.payload_length;
+    sacked++;
+
+    if ( keep_lost_ ) {
+      sacked_.push_back( sequence_number );
+    }
+
+    delivered( entry );
+  }
+
+  advance_first_in_flight();
+  return sacked;
+}
+
+#endif /* SCOREBOARD_HH */
@@ -1,37 +1,142 @@
 /* UDP sender for congestion-control contest */
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "socket.hh"
 #include "contest_message.hh"
 #include "controller.hh"
+#include "application_input.hh"
+#include "log.hh"
+#include "packet_trace.hh"
+#include "bbr_controller.hh"
+#include "reno_controller.hh"
+#include "cubic_controller.hh"
+#include "vegas_controller.hh"
 #include "poller.hh"
+#include "timestamp.hh"
+#include "util.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
-/* simple sender class to handle the accounting */
+/* most acks to receive with one system call */
+static const size_t RECV_BATCH_SIZE = 64;
+
+/* packet buffers for the acks (a batch, with room to spare) */
+static const size_t PACKET_POOL_SIZE = 2 * RECV_BATCH_SIZE;
+
+/* most datagrams to send with one system call */
+static const size_t SEND_BATCH_SIZE = 64;
+
+/* most payload in one datagram (what the dummy payload has) */
+static const size_t MAX_PAYLOAD = 1424;
+
+/* most application data to read ahead of sending it */
+static const size_t APP_BUFFER_SIZE = 1 << 20;
+
+/* default room in a packet trace (64 MB) */
+static const uint64_t DEFAULT_TRACE_EVENTS = 1 << 20;
+
+#ifdef STATIC_CONTROLLER
+/* one algorithm, chosen when configuring the build: its class is final,
+   so calls into it are direct (and inline, with link-time optimization) */
+typedef STATIC_CONTROLLER SenderController;
+
+static unique_ptr<SenderController> make_controller( const string & )
+{
+  return unique_ptr<SenderController>( new SenderController() );
+}
+
+static vector<string> controller_names()
+{
+  return { SenderController::name() };
+}
+#else
+/* any algorithm, chosen at run time through the Controller interface */
+typedef Controller SenderController;
+
+static unique_ptr<SenderController> make_controller( const string & name )
+{
+  return Controller::make( name );
+}
+
+static vector<string> controller_names()
+{
+  return Controller::names();
+}
+#endif
+
+/* simple sender class to handle the accounting
+   (ControllerType is the Controller interface, or one final algorithm) */
+template <class ControllerType>
 class DatagrumpSender
 {
 private:
   UDPSocket socket_;
-  Controller controller_; /* your class */
+  Poller::Backend engine_; /* how to wait for and do I/O */
+  std::unique_ptr<ControllerType> controller_; /* your class */
 
   uint64_t sequence_number_; /* next outgoing sequence number */
 
-  /* if network does not reorder or lose datagrams,
-     this is the sequence number that the sender
-     next expects will be acknowledged by the receiver */
-  uint64_t next_ack_expected_;
+  /* resend the data of each lost datagram (as a new datagram,
+     with its own sequence number), before anything new */
+  bool retransmit_;
+  std::deque<uint64_t> retransmit_queue_; /* lost sequence numbers */
+
+  /* the application's data, read from standard input and sent as it
+     comes (in datagrams of up to MAX_PAYLOAD bytes) instead of the dummy
+     payload, forever; the bytes before app_offset_ are staged to go out */
+  std::unique_ptr<ApplicationInput> app_input_;
+  std::string app_buffer_;
+  size_t app_offset_;
+
+  /* to retransmit application data, each datagram's until it's acked */
+  std::unordered_map<uint64_t, std::string> unacked_data_;
+
+  /* datagrams staged to go out with the next flush(),
+     with their headers serialized in place in header_buffers_ */
+  std::vector<char> header_buffers_;
+  std::vector<UDPSocket::gathered_datagram> outgoing_;
+
+  /* per-packet event trace (if enabled) */
+  std::unique_ptr<PacketTraceWriter> trace_;
+
+  /* the acks received last, in buffers from the pool
+     (kept to reuse their storage) */
+  PacketPool pool_;
+  std::vector<UDPSocket::received_packet> acks_;
+
+  /* the last ack of several datagrams (kept to reuse its storage) */
+  CoalescedAck coalesced_ack_;
 
+  /* datagrams dropped for not being well-formed acks */
+  uint64_t malformed_;
+
+  void record_event( const uint8_t type, const uint64_t time,
+		     const uint64_t sequence_number, const uint64_t send_timestamp,
+		     const uint64_t recv_timestamp, const uint64_t payload_length );
+  void take_losses( const uint64_t time );
+  bool has_data();
+  void stage_datagram( const bool after_timeout );
+  void flush();
   void send_datagram( const bool after_timeout );
-  void got_ack( const uint64_t timestamp, const ContestMessage & msg );
+  void drop_malformed( const char * const what );
+  void got_ack( const uint64_t timestamp, const ContestMessageView & msg );
   bool window_is_open();
 
 public:
   DatagrumpSender( const char * const host, const char * const port,
-		   const bool debug );
+		   const Poller::Backend engine, const bool gso, const string & algorithm,
+		   const bool retransmit, const bool app_input,
+		   const string & trace_filename, const uint64_t trace_events );
   int loop();
 };
 
@@ -42,29 +147,103 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  bool debug = false;
-  if ( argc == 4 and string( argv[ 3 ] ) == "debug" ) {
-    debug = true;
-  } else if ( argc == 3 ) {
-    /* do nothing */
-  } else {
-    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [debug]" << endl;
+  Poller::Backend engine = Poller::Backend::Poll;
+  bool gso = false;
+  string algorithm = controller_names().front();
+  bool retransmit = false;
+  bool app_input = false;
+  string trace_filename;
+  uint64_t trace_events = DEFAULT_TRACE_EVENTS;
+  bool usage_ok = argc >= 3;
+
+  for ( int i = 3; usage_ok and i < argc; i++ ) {
+    const string arg( argv[ i ] );
+    if ( arg == "debug" ) {
+      Log::set_level( Log::Level::Debug );
+    } else if ( arg.compare( 0, 12, "--log-level=" ) == 0 ) {
+      try {
+	Log::set_level( Log::level_from_name( arg.substr( 12 ) ) );
+      } catch ( const exception & e ) {
+	print_exception( e );
+	usage_ok = false;
+      }
+    } else if ( arg == "--fast-clock" ) {
+      if ( not enable_fast_clock() ) {
+	LOG( Warning, "no invariant TSC, using clock_gettime" );
+      }
+    } else if ( arg.compare( 0, 5, "--cc=" ) == 0 ) {
+      algorithm = arg.substr( 5 );
+      const auto names = controller_names();
+      usage_ok = find( names.begin(), names.end(), algorithm ) != names.end();
+    } else if ( arg == "--retransmit" ) {
+      retransmit = true;
+    } else if ( arg == "--stdin" ) {
+      app_input = true;
+    } else if ( arg == "--gso" ) {
+      gso = true;
+    } else if ( arg.compare( 0, 8, "--trace=" ) == 0 ) {
+      trace_filename = arg.substr( 8 );
+    } else if ( arg.compare( 0, 15, "--trace-events=" ) == 0 ) {
+      trace_events = strtoull( arg.c_str() + 15, nullptr, 10 );
+      usage_ok = trace_events > 0;
+    } else if ( arg.compare( 0, 9, "--engine=" ) == 0 ) {
+      try {
+	engine = Poller::backend_from_name( arg.substr( 9 ) );
+      } catch ( const exception & e ) {
+	print_exception( e );
+	usage_ok = false;
+      }
+    } else {
+      usage_ok = false;
+    }
+  }
+
+  if ( not usage_ok ) {
+    string algorithms;
+    for ( const auto & name : controller_names() ) {
+      algorithms += (algorithms.empty() ? "" : "|") + name;
+    }
+    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [debug] [--cc=" << algorithms << "]"
+	 << " [--engine=poll|epoll|io_uring] [--gso] [--fast-clock] [--retransmit] [--stdin]"
+	 << " [--log-level=error|warning|info|debug|trace]"
+	 << " [--trace=FILE [--trace-events=N]]" << endl;
     return EXIT_FAILURE;
   }
 
   /* create sender object to handle the accounting */
   /* all the interesting work is done by the Controller */
-  DatagrumpSender sender( argv[ 1 ], argv[ 2 ], debug );
+  DatagrumpSender<SenderController> sender( argv[ 1 ], argv[ 2 ], engine, gso, algorithm,
+					    retransmit, app_input, trace_filename, trace_events );
   return sender.loop();
 }
 
-DatagrumpSender::DatagrumpSender( const char * const host,
-				  const char * const port,
-				  const bool debug )
+template <class ControllerType>
+DatagrumpSender<ControllerType>::DatagrumpSender( const char * const host,
+						  const char * const port,
+						  const Poller::Backend engine,
+						  const bool gso,
+						  const string & algorithm,
+						  const bool retransmit,
+						  const bool app_input,
+						  const string & trace_filename,
+						  const uint64_t trace_events )
   : socket_(),
-    controller_( debug ),
+    engine_( engine ),
+    controller_( make_controller( algorithm ) ),
     sequence_number_( 0 ),
-    next_ack_expected_( 0 )
+    retransmit_( retransmit ),
+    retransmit_queue_(),
+    app_input_( app_input ? new ApplicationInput( STDIN_FILENO ) : nullptr ),
+    app_buffer_(),
+    app_offset_( 0 ),
+    unacked_data_(),
+    header_buffers_( SEND_BATCH_SIZE * ContestMessage::Header::SIZE ),
+    outgoing_(),
+    trace_(),
+    pool_( PACKET_POOL_SIZE ),
+    acks_(),
+    coalesced_ack_(),
+    malformed_( 0 )
 {
   /* turn on timestamps when socket receives a datagram */
   socket_.set_timestamps();
@@ -74,90 +253,349 @@ DatagrumpSender::DatagrumpSender( const char * const host,
      locally with the remote address */
   socket_.connect( Address( host, port ) );  
 
-  cerr << "Sending to " << socket_.peer_address().to_string() << endl;
+  /* with io_uring, the socket does its I/O through rings too */
+  if ( engine_ == Poller::Backend::IoUring and not socket_.enable_io_uring() ) {
+    LOG( Warning, "io_uring not supported, falling back to poll" );
+    engine_ = Poller::Backend::Poll;
+  }
+
+  /* each batch of full-sized datagrams goes down the network stack as one */
+  if ( gso and not socket_.enable_gso() ) {
+    LOG( Warning, "UDP segmentation offload not supported, sending datagrams one by one" );
+  }
+
+  if ( not trace_filename.empty() ) {
+    trace_.reset( new PacketTraceWriter( trace_filename, trace_events, algorithm ) );
+  }
+
+  /* hear about each lost datagram, to resend it or to trace it */
+  controller_->keep_lost( retransmit_ or trace_ );
+
+  LOG( Info, "Sending to {}", socket_.peer_address().to_string() );
 }
 
-void DatagrumpSender::got_ack( const uint64_t timestamp,
-			       const ContestMessage & ack )
+/* append an event, with the controller's state after it, to the trace */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::record_event( const uint8_t type, const uint64_t time,
+						    const uint64_t sequence_number,
+						    const uint64_t send_timestamp,
+						    const uint64_t recv_timestamp,
+						    const uint64_t payload_length )
+{
+  PacketEvent event;
+  event.time = time;
+  event.sequence_number = sequence_number;
+  event.send_timestamp = send_timestamp;
+  event.recv_timestamp = recv_timestamp;
+  event.payload_length = payload_length;
+  event.type = type;
+  controller_->trace_state( event );
+
+  trace_->append( event );
+}
+
+/* a stray datagram (not from the receiver) is no reason to stop */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::drop_malformed( const char * const what )
+{
+  malformed_++;
+  LOG( Warning, "dropped a {} ({} so far)", what, malformed_ );
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::got_ack( const uint64_t timestamp,
+					       const ContestMessageView & ack )
 {
   if ( not ack.is_ack() ) {
-    throw runtime_error( "sender got something other than an ack from the receiver" );
+    drop_malformed( "datagram other than an ack" );
+    return;
+  }
+
+  /* an ack of several datagrams goes to the controller all at once */
+  if ( CoalescedAck::is_coalesced( ack ) ) {
+    if ( not coalesced_ack_.parse( ack ) ) {
+      drop_malformed( "malformed coalesced ack" );
+      return;
+    }
+    for ( const auto & datagram : coalesced_ack_.datagrams ) {
+      unacked_data_.erase( datagram.sequence_number );
+    }
+
+    controller_->acks_received( coalesced_ack_, ack.send_timestamp(), timestamp );
+
+    /* (and so has whatever its ranges show, whether or not it was named) */
+    uint64_t sequence_number;
+    while ( controller_->take_sacked( sequence_number ) ) {
+      unacked_data_.erase( sequence_number );
+    }
+
+    /* (traced at the ack's arrival less the time the receiver held each
+       one, as the controller's RTT samples are, so that RTTs from the
+       trace leave out the receiver's ack delay) */
+    if ( trace_ ) {
+      uint64_t previous = 0;
+      for ( const auto & datagram : coalesced_ack_.datagrams ) {
+	previous = Controller::unheld_ack_time( datagram, ack.send_timestamp(), timestamp, previous );
+	record_event( PacketEvent::Acked, previous, datagram.sequence_number,
+		      datagram.send_timestamp, datagram.recv_timestamp, datagram.payload_length );
+      }
+    }
+    return;
   }
 
-  /* Update sender's counter */
-  next_ack_expected_ = max( next_ack_expected_,
-			    ack.header.ack_sequence_number + 1 );
+  unacked_data_.erase( ack.ack_sequence_number() );
 
   /* Inform congestion controller */
-  controller_.ack_received( ack.header.ack_sequence_number,
-			    ack.header.ack_send_timestamp,
-			    ack.header.ack_recv_timestamp,
+  controller_->ack_received( ack.ack_sequence_number(),
+			    ack.ack_send_timestamp(),
+			    ack.ack_recv_timestamp(),
 			    timestamp,
-          ack.header.ack_payload_length,
-          ack.header.delivered,
-          ack.header.delivered_time);
+          ack.ack_payload_length(),
+          ack.delivered(),
+          ack.delivered_time());
+
+  if ( trace_ ) {
+    record_event( PacketEvent::Acked, timestamp, ack.ack_sequence_number(),
+		  ack.ack_send_timestamp(), ack.ack_recv_timestamp(), ack.ack_payload_length() );
+  }
 }
 
-void DatagrumpSender::send_datagram( const bool after_timeout )
+/* queue the datagrams the controller has taken as lost for retransmission
+   (and trace them) */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::take_losses( const uint64_t time )
 {
+  uint64_t sequence_number;
+  while ( controller_->take_lost( sequence_number ) ) {
+    LOG( Debug, "At time {} datagram {} was lost", time, sequence_number );
 
-  /* All messages use the same dummy payload */
-  static const string dummy_payload( 1424, 'x' );
+    if ( retransmit_ ) {
+      retransmit_queue_.push_back( sequence_number );
+    }
 
-  ContestMessage cm( sequence_number_++, controller_.get_delivered(), 
-    controller_.get_delivered_time(), dummy_payload );
-  cm.set_send_timestamp();
-  socket_.send( cm.to_string() );
+    if ( trace_ ) {
+      record_event( PacketEvent::Lost, time, sequence_number, 0, 0, 0 );
+    }
+  }
+}
 
-  /* Inform congestion controller */
-  controller_.datagram_was_sent( cm.header.sequence_number,
-				 cm.header.send_timestamp,
-         1424,
+/* is there anything to send: lost data, or the application's next data? */
+template <class ControllerType>
+bool DatagrumpSender<ControllerType>::has_data()
+{
+  /* (lost application data that has been acked after all needn't go again) */
+  while ( app_input_ and not retransmit_queue_.empty()
+	  and unacked_data_.count( retransmit_queue_.front() ) == 0 ) {
+    retransmit_queue_.pop_front();
+  }
+
+  return not app_input_ or not retransmit_queue_.empty() or app_offset_ < app_buffer_.size();
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::stage_datagram( const bool after_timeout )
+{
+
+  /* All messages use the same dummy payload (shared, never copied) */
+  static const string dummy_payload( MAX_PAYLOAD, 'x' );
+
+  const uint64_t sequence_number = sequence_number_++;
+  const char * payload = dummy_payload.data();
+  size_t payload_length = dummy_payload.size();
+
+  /* lost data goes again before new data */
+  const bool retransmission = has_data() and not retransmit_queue_.empty();
+  if ( retransmission ) {
+    const uint64_t lost = retransmit_queue_.front();
+    retransmit_queue_.pop_front();
+    LOG( Debug, "Retransmitting datagram {} as {}", lost, sequence_number );
+
+    if ( app_input_ ) {
+      /* (the data is now this datagram's) */
+      const auto data = unacked_data_.find( lost );
+      string moved = move( data->second );
+      unacked_data_.erase( data );
+      const string & kept = unacked_data_[ sequence_number ] = move( moved );
+      payload = kept.data();
+      payload_length = kept.size();
+    }
+  } else if ( app_input_ ) {
+    /* the application's next data (nothing, for a probe after a timeout) */
+    payload = app_buffer_.data() + app_offset_;
+    payload_length = min( app_buffer_.size() - app_offset_, MAX_PAYLOAD );
+    app_offset_ += payload_length;
+
+    if ( retransmit_ ) {
+      const string & kept = unacked_data_[ sequence_number ] = string( payload, payload_length );
+      payload = kept.data();
+    }
+  }
+
+  ContestMessage::Header header( sequence_number, controller_->get_delivered(),
+    controller_->get_delivered_time() );
+  header.set_send_timestamp();
+
+  char * const header_buffer = &header_buffers_[ outgoing_.size() * ContestMessage::Header::SIZE ];
+  header.serialize( header_buffer );
+  outgoing_.push_back( { header_buffer, ContestMessage::Header::SIZE,
+			 payload, payload_length, nullptr } );
+
+  /* Inform congestion controller (the datagram goes out with
+     the rest of the batch, stamped with this send time) */
+  controller_->datagram_was_sent( header.sequence_number,
+				 header.send_timestamp,
+         payload_length,
 				 after_timeout );
+
+  if ( trace_ ) {
+    record_event( (after_timeout or retransmission) ? PacketEvent::Retransmitted : PacketEvent::Sent,
+		  header.send_timestamp, header.sequence_number,
+		  header.send_timestamp, 0, payload_length );
+  }
+}
+
+/* send every staged datagram with one system call */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::flush()
+{
+  if ( outgoing_.empty() ) {
+    return;
+  }
+
+  socket_.send_batch( outgoing_ );
+  outgoing_.clear();
+
+  /* the application data that went out has no more use */
+  app_buffer_.erase( 0, app_offset_ );
+  app_offset_ = 0;
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::send_datagram( const bool after_timeout )
+{
+  stage_datagram( after_timeout );
+  flush();
 }
 
-bool DatagrumpSender::window_is_open()
+/* may a datagram go out now, by both the window and the pacing rate? */
+template <class ControllerType>
+bool DatagrumpSender<ControllerType>::window_is_open()
 {
-  // return controller_.window_is_open();
-  return sequence_number_ - next_ack_expected_ < controller_.window_size();
+  return controller_->window_is_open() and controller_->should_send_packet();
 }
 
-int DatagrumpSender::loop()
+template <class ControllerType>
+int DatagrumpSender<ControllerType>::loop()
 {
   /* read and write from the receiver using an event-driven "poller" */
-  Poller poller;
+  Poller poller( engine_ );
 
   /* first rule: if the window is open, close it by
      sending more datagrams */
   poller.add_action( Action( socket_, Direction::Out, [&] () {
-	/* Close the window */
-	while ( window_is_open()) {
-    send_datagram( false );
+	/* Close the window, a batch at a time */
+	while ( window_is_open() and has_data() ) {
+	  stage_datagram( false );
+	  if ( outgoing_.size() >= SEND_BATCH_SIZE ) {
+	    flush();
+	  }
 	}
+	flush();
 	return ResultType::Continue;
       },
-      /* We're only interested in this rule when the window is open */
-      [&] () { return window_is_open(); } ) );
+      /* We're only interested in this rule when the window is open
+	 (and there's something to send) */
+      [&] () { return window_is_open() and has_data(); } ) );
 
+  /* the application's data, as it comes */
+  if ( app_input_ ) {
+    poller.add_action( Action( app_input_->wakeup(), Direction::In, [&] () {
+	  app_input_->wakeup().read();
+	  app_input_->take( app_buffer_ );
+	  return ResultType::Continue;
+	},
+	[&] () { return app_buffer_.size() < APP_BUFFER_SIZE; } ) );
+  }
+
+
+  /* the loss-detection timer (see the third rule): due when the oldest
+     datagram in flight has waited out its reordering window, or else
+     after a retransmission timeout with no acks */
+  const auto loss_detection_deadline = [&] () {
+    const uint64_t timeout = timestamp_us() + controller_->timeout_us();
+    const uint64_t loss_time = controller_->loss_time();
+    return loss_time ? min( loss_time, timeout ) : timeout;
+  };
+  Poller::TimerId loss_detection_timer = 0;
 
   /* second rule: if sender receives an ack,
      process it and inform the controller
-     (by using the sender's got_ack method) */
-  poller.add_action( Action( socket_, Direction::In, [&] () {
-	const UDPSocket::received_datagram recd = socket_.recv();
-	const ContestMessage ack  = recd.payload;
-	got_ack( recd.timestamp, ack );
+     (by using the sender's got_ack method),
+     and push back the loss-detection timer */
+  poller.add_action( Action( socket_.receive_event_fd(), Direction::In, [&] () {
+	/* drain every ack that is already waiting */
+	socket_.recv_batch( RECV_BATCH_SIZE, pool_, acks_ );
+	for ( const auto & recd : acks_ ) {
+	  if ( not ContestMessageView::fits( recd.buffer ) ) {
+	    drop_malformed( "datagram too short for a header" );
+	    continue;
+	  }
+	  got_ack( recd.timestamp, ContestMessageView( recd.buffer ) );
+	}
+	take_losses( timestamp_us() );
+	poller.rearm_timer( loss_detection_timer, loss_detection_deadline() );
 	return ResultType::Continue;
       } ) );
 
-  /* Run these two rules forever */
+  /* third rule: when a datagram's reordering window passes, it is
+     lost; if no ack arrives for a while, everything in flight is,
+     and one datagram goes out to try to get things moving again
+     (unless there's nothing in flight or to send) */
+  loss_detection_timer = poller.add_timer( loss_detection_deadline(), [&] () {
+      const uint64_t now = timestamp_us();
+      const uint64_t loss_time = controller_->loss_time();
+      if ( loss_time and loss_time <= now ) {
+	controller_->detect_losses();
+      } else if ( controller_->datagrams_in_flight() > 0 or has_data() ) {
+	send_datagram( true );
+      }
+      take_losses( now );
+      poller.rearm_timer( loss_detection_timer, loss_detection_deadline() );
+      return ResultType::Continue;
+    } );
+
+  /* the pacing timer wakes the poller when the window is open but
+     the pacing rate holds back the next datagram (so that the first
+     rule can send it); a deadline already past would only make every
+     poll return at once while the socket can't be written */
+  bool pacing_timer_armed = false;
+
+  /* Run these rules forever (or, with application data,
+     until all of it has been sent and acked or lost) */
   while ( true ) {
-    const auto ret = poller.poll( controller_.timeout_ms() );
+    /* nothing to send, though the window is open: the next delivery
+       rates show only what the application gave */
+    if ( controller_->window_is_open() and not has_data() ) {
+      controller_->application_limited();
+    }
+
+    if ( app_input_ and app_input_->finished() and not has_data()
+	 and controller_->datagrams_in_flight() == 0 ) {
+      return EXIT_SUCCESS;
+    }
+
+    if ( controller_->window_is_open() and has_data() and not pacing_timer_armed
+	 and controller_->next_send_time_us() > timestamp_us() ) {
+      poller.add_timer( controller_->next_send_time_us(), [&] () {
+	  pacing_timer_armed = false;
+	  return ResultType::Continue;
+	} );
+      pacing_timer_armed = true;
+    }
+
+    const auto ret = poller.poll( -1 );
     if ( ret.result == PollResult::Exit ) {
       return ret.exit_status;
-    } else if ( ret.result == PollResult::Timeout ) {
-      /* After a timeout, send one datagram to try to get things moving again */
-      send_datagram( true );
     }
   }
 }
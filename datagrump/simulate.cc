@@ -0,0 +1,289 @@
+/* evaluate congestion controllers in simulation, faster than real time:
+   every algorithm (and, for BBR, every combination of the tunables
+   given) runs over every trace, on as many threads as there are CPUs,
+   and each run reports what mm-throughput-graph would */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bbr_controller.hh"
+#include "simulation.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* how long to run over a constant rate, unless given (in microseconds) */
+static const uint64_t DEFAULT_RATE_DURATION = 30000000;
+
+/* a comma-separated list of numbers */
+static vector<double> parse_list( const string & value )
+{
+  vector<double> ret;
+  istringstream stream( value );
+  string item;
+  while ( getline( stream, item, ',' ) ) {
+    size_t used = 0;
+    ret.push_back( stod( item, &used ) );
+    if ( used != item.size() ) {
+      throw runtime_error( "not a number: " + item );
+    }
+  }
+
+  if ( ret.empty() ) {
+    throw runtime_error( "empty list" );
+  }
+  return ret;
+}
+
+static vector<string> split( const string & value )
+{
+  vector<string> ret;
+  istringstream stream( value );
+  string item;
+  while ( getline( stream, item, ',' ) ) {
+    ret.push_back( item );
+  }
+  return ret;
+}
+
+/* one algorithm, with its tunables */
+struct Candidate
+{
+  string algorithm;
+  BBRController::Parameters parameters;
+  string description;
+};
+
+/* one candidate over one trace */
+struct Run
+{
+  size_t candidate, trace;
+  Simulation::Result result;
+};
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  try {
+    vector<string> trace_names;
+    vector<Simulation::Config> traces;
+    Simulation::Config defaults;
+    EmulatedLink::constant_rate( EmulatedLink::DEFAULT_DOWNLINK_MBPS, defaults.downlink );
+
+    vector<string> algorithms { BBRController::name() };
+    vector<double> rt_sample_timeouts { BBRController::Parameters().rt_sample_timeout / 1000.0 };
+    vector<double> stale_update_thresholds { BBRController::Parameters().stale_update_threshold / 1000.0 };
+    vector<double> cwnd_gains { BBRController::Parameters().cwnd_gain };
+    unsigned int threads = max( 1u, thread::hardware_concurrency() );
+    bool usage_ok = true;
+
+    for ( int i = 1; usage_ok and i < argc; i++ ) {
+      const string arg( argv[ i ] );
+      const size_t equals = arg.find( '=' );
+      const string name = arg.substr( 0, equals );
+      const string value = equals == string::npos ? "" : arg.substr( equals + 1 );
+
+      if ( arg.compare( 0, 2, "--" ) != 0 ) {
+	trace_names.push_back( arg );
+	traces.push_back( Simulation::Config() );
+	EmulatedLink::load_trace( arg, traces.back().uplink );
+      } else if ( name == "--uplink-rate" ) {
+	trace_names.push_back( value + " Mbit/s" );
+	traces.push_back( Simulation::Config() );
+	EmulatedLink::constant_rate( stod( value ), traces.back().uplink );
+	traces.back().duration = DEFAULT_RATE_DURATION;
+      } else if ( name == "--cc" ) {
+	algorithms = split( value );
+	const auto names = Controller::names();
+	for ( const auto & algorithm : algorithms ) {
+	  usage_ok = usage_ok and find( names.begin(), names.end(), algorithm ) != names.end();
+	}
+      } else if ( name == "--rt-sample-timeout" ) {
+	rt_sample_timeouts = parse_list( value );
+      } else if ( name == "--stale-update-threshold" ) {
+	stale_update_thresholds = parse_list( value );
+      } else if ( name == "--cwnd-gain" ) {
+	cwnd_gains = parse_list( value );
+      } else if ( name == "--downlink" ) {
+	EmulatedLink::load_trace( value, defaults.downlink );
+      } else if ( name == "--downlink-rate" ) {
+	EmulatedLink::constant_rate( stod( value ), defaults.downlink );
+      } else if ( name == "--delay" ) {
+	defaults.uplink.delay = defaults.downlink.delay = 1000 * stod( value );
+      } else if ( name == "--loss" ) {
+	defaults.uplink.loss = stod( value );
+      } else if ( name == "--queue-packets" ) {
+	defaults.uplink.queue_packets = stoull( value );
+      } else if ( name == "--queue-bytes" ) {
+	defaults.uplink.queue_bytes = stoull( value );
+      } else if ( name == "--duration" ) {
+	defaults.duration = 1e6 * stod( value );
+      } else if ( name == "--seed" ) {
+	defaults.seed = stoul( value );
+      } else if ( name == "--threads" ) {
+	threads = stoul( value );
+	usage_ok = threads > 0;
+      } else {
+	usage_ok = false;
+      }
+    }
+
+    if ( traces.empty() ) {
+      usage_ok = false;
+    }
+
+    if ( not usage_ok ) {
+      string names;
+      for ( const auto & name : Controller::names() ) {
+	names += (names.empty() ? "" : "|") + name;
+      }
+      cerr << "Usage: " << argv[ 0 ] << " TRACE... [--uplink-rate=MBPS]..."
+	   << " [--cc=" << names << "[,...]]"
+	   << " [--rt-sample-timeout=MS[,...]] [--stale-update-threshold=MS[,...]]"
+	   << " [--cwnd-gain=GAIN[,...]]"
+	   << " [--downlink=TRACE|--downlink-rate=MBPS] [--delay=MS] [--loss=RATE]"
+	   << " [--queue-packets=N] [--queue-bytes=N] [--duration=SECONDS]"
+	   << " [--seed=N] [--threads=N]" << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* the options apply to every trace */
+    for ( auto & trace : traces ) {
+      trace.uplink.delay = defaults.uplink.delay;
+      trace.uplink.loss = defaults.uplink.loss;
+      trace.uplink.queue_packets = defaults.uplink.queue_packets;
+      trace.uplink.queue_bytes = defaults.uplink.queue_bytes;
+      trace.downlink = defaults.downlink;
+      if ( defaults.duration ) {
+	trace.duration = defaults.duration;
+      }
+      trace.seed = defaults.seed;
+    }
+
+    /* BBR in every combination of its tunables; the others as they are */
+    vector<Candidate> candidates;
+    for ( const auto & algorithm : algorithms ) {
+      if ( algorithm != BBRController::name() ) {
+	candidates.push_back( { algorithm, BBRController::Parameters(), algorithm } );
+	continue;
+      }
+
+      for ( const double rt_sample_timeout : rt_sample_timeouts ) {
+	for ( const double stale_update_threshold : stale_update_thresholds ) {
+	  for ( const double cwnd_gain : cwnd_gains ) {
+	    BBRController::Parameters parameters;
+	    parameters.rt_sample_timeout = 1000 * rt_sample_timeout;
+	    parameters.stale_update_threshold = 1000 * stale_update_threshold;
+	    parameters.cwnd_gain = cwnd_gain;
+	    parameters.seed = defaults.seed;
+
+	    ostringstream description;
+	    description << algorithm << " rt_sample_timeout=" << rt_sample_timeout
+			<< " stale_update_threshold=" << stale_update_threshold
+			<< " cwnd_gain=" << cwnd_gain;
+	    candidates.push_back( { algorithm, parameters, description.str() } );
+	  }
+	}
+      }
+    }
+
+    vector<Run> runs;
+    for ( size_t candidate = 0; candidate < candidates.size(); candidate++ ) {
+      for ( size_t trace = 0; trace < traces.size(); trace++ ) {
+	runs.push_back( { candidate, trace, Simulation::Result() } );
+      }
+    }
+
+    /* the runs are independent: each thread takes the next one left */
+    atomic<size_t> next_run( 0 );
+    vector<exception_ptr> errors( threads );
+    vector<thread> workers;
+    for ( unsigned int i = 0; i < threads; i++ ) {
+      workers.emplace_back( [&, i] () {
+	  try {
+	    for ( size_t r = next_run++; r < runs.size(); r = next_run++ ) {
+	      const Candidate & candidate = candidates[ runs[ r ].candidate ];
+	      unique_ptr<Controller> controller;
+	      if ( candidate.algorithm == BBRController::name() ) {
+		controller.reset( new BBRController( candidate.parameters ) );
+	      } else {
+		controller = Controller::make( candidate.algorithm );
+	      }
+
+	      Simulation simulation( traces[ runs[ r ].trace ], move( controller ) );
+	      runs[ r ].result = simulation.run();
+	    }
+	  } catch ( ... ) {
+	    errors[ i ] = current_exception();
+	  }
+	} );
+    }
+
+    for ( auto & worker : workers ) {
+      worker.join();
+    }
+
+    for ( const auto & error : errors ) {
+      if ( error ) {
+	rethrow_exception( error );
+      }
+    }
+
+    /* every run, then each candidate's average over the traces (best mean power first) */
+    cout << fixed << setprecision( 2 );
+    vector<Simulation::Result> totals( candidates.size() );
+    vector<double> mean_power( candidates.size() );
+    for ( const auto & run : runs ) {
+      const auto & summary = run.result.uplink;
+      cout << candidates[ run.candidate ].description << " on " << trace_names[ run.trace ] << ": "
+	   << "capacity " << summary.capacity << " Mbit/s, "
+	   << "throughput " << summary.throughput << " Mbit/s, "
+	   << "p95 queueing delay " << summary.queueing_delay << " ms, "
+	   << "p95 signal delay " << summary.signal_delay << " ms, "
+	   << "power " << summary.power()
+	   << " (" << run.result.sent << " sent, " << run.result.retransmitted
+	   << " sent after a timeout)" << endl;
+
+      auto & total = totals[ run.candidate ].uplink;
+      total.capacity += summary.capacity / traces.size();
+      total.throughput += summary.throughput / traces.size();
+      total.queueing_delay += summary.queueing_delay / traces.size();
+      total.signal_delay += summary.signal_delay / traces.size();
+      total.one_way_delay += summary.one_way_delay / traces.size();
+      mean_power[ run.candidate ] += summary.power() / traces.size();
+    }
+
+    vector<size_t> order( candidates.size() );
+    for ( size_t i = 0; i < order.size(); i++ ) {
+      order[ i ] = i;
+    }
+    stable_sort( order.begin(), order.end(), [&] ( const size_t a, const size_t b ) {
+	return mean_power[ a ] > mean_power[ b ];
+      } );
+
+    cout << endl << "Average over " << traces.size() << " trace(s):" << endl;
+    for ( const size_t i : order ) {
+      const auto & total = totals[ i ].uplink;
+      cout << candidates[ i ].description << ": "
+	   << "throughput " << total.throughput << " Mbit/s, "
+	   << "p95 signal delay " << total.signal_delay << " ms, "
+	   << "power " << mean_power[ i ] << endl;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
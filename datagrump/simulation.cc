@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "simulation.hh"
+#include "contest_message.hh"
+
+using namespace std;
+
+/* Payload bytes of each datagram (as sender.cc sends) */
+static const uint64_t PAYLOAD_BYTES = 1424;
+
+/* Virtual time at which a run starts (not 0, which controllers
+   take to mean "never") */
+static const uint64_t START_TIME = 1000000;
+
+uint64_t payload_size( const SimulatedDatagram & datagram )
+{
+  return ContestMessage::Header::SIZE + (datagram.ack ? 0 : datagram.payload_length);
+}
+
+Simulation::Simulation( const Config & config, unique_ptr<Controller> && controller )
+  : config_( config ),
+    controller_( move( controller ) ),
+    now_( START_TIME ),
+    sequence_number_( 0 ),
+    uplink_( config_.uplink, START_TIME, config_.seed ),
+    downlink_( config_.downlink, START_TIME, config_.seed + 1 ),
+    result_()
+{
+  if ( config_.duration == 0 ) {
+    config_.duration = config_.uplink.period;
+  }
+
+  controller_->set_clock( &now_ );
+}
+
+void Simulation::send_datagram( const bool after_timeout )
+{
+  const SimulatedDatagram datagram { sequence_number_++, now_, 0, PAYLOAD_BYTES,
+				     controller_->get_delivered(),
+				     controller_->get_delivered_time(), false };
+
+  controller_->datagram_was_sent( datagram.sequence_number, datagram.send_timestamp,
+				  datagram.payload_length, after_timeout );
+
+  uplink_.advance( now_ );
+  uplink_.arrive( now_, SimulatedDatagram( datagram ) );
+
+  if ( after_timeout ) {
+    result_.retransmitted++;
+  } else {
+    result_.sent++;
+  }
+}
+
+bool Simulation::receive()
+{
+  /* the receiver turns each datagram into its ack */
+  uplink_.advance( now_ );
+  downlink_.advance( now_ );
+  while ( uplink_.ready( now_ ) ) {
+    SimulatedDatagram ack = uplink_.take();
+    ack.recv_timestamp = now_;
+    ack.ack = true;
+    downlink_.arrive( now_, move( ack ) );
+  }
+
+  bool acked = false;
+  while ( downlink_.ready( now_ ) ) {
+    const SimulatedDatagram ack = downlink_.take();
+    controller_->ack_received( ack.sequence_number, ack.send_timestamp, ack.recv_timestamp,
+			       now_, ack.payload_length, ack.delivered, ack.delivered_time );
+    result_.acked++;
+    acked = true;
+  }
+
+  return acked;
+}
+
+Simulation::Result Simulation::run()
+{
+  if ( now_ != START_TIME ) {
+    throw runtime_error( "Simulation: already run" );
+  }
+
+  const uint64_t end = START_TIME + config_.duration;
+
+  /* the loss-detection timer, as in sender.cc: when the oldest datagram
+     in flight waits out its reordering window, or a retransmission
+     timeout after the last ack */
+  uint64_t retransmit_deadline = now_ + controller_->timeout_us();
+
+  while ( now_ < end ) {
+    /* acks push back the retransmission timer */
+    if ( receive() ) {
+      retransmit_deadline = now_ + controller_->timeout_us();
+    }
+
+    const uint64_t loss_time = controller_->loss_time();
+    if ( loss_time and now_ >= loss_time ) {
+      controller_->detect_losses();
+    } else if ( now_ >= retransmit_deadline ) {
+      /* if no ack arrives for a while, send one datagram */
+      send_datagram( true );
+      retransmit_deadline = now_ + controller_->timeout_us();
+    }
+
+    /* if the window is open (and the pacing rate allows), close it */
+    while ( controller_->window_is_open() and controller_->should_send_packet() ) {
+      send_datagram( false );
+    }
+
+    /* skip ahead to whatever happens next */
+    uint64_t next = min( { uplink_.next_event(), downlink_.next_event(),
+			   retransmit_deadline, end } );
+    if ( controller_->loss_time() ) {
+      next = min( next, controller_->loss_time() );
+    }
+    if ( controller_->window_is_open() ) {
+      next = min( next, max( controller_->next_send_time_us(), now_ + 1 ) );
+    }
+    now_ = max( next, now_ + 1 );
+  }
+
+  uplink_.advance( end );
+  result_.uplink = EmulatedLink::summarize( uplink_.statistics(), config_.uplink.delay,
+					    START_TIME, end );
+  return result_;
+}
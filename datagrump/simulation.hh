@@ -0,0 +1,77 @@
+#ifndef SIMULATION_HH
+#define SIMULATION_HH
+
+#include <cstdint>
+#include <memory>
+
+#include "controller.hh"
+#include "emulated_link.hh"
+
+/* What crosses a simulated link in place of a datagram (or its ack):
+   the header fields the sender and receiver would have read */
+struct SimulatedDatagram
+{
+  uint64_t sequence_number;
+  uint64_t send_timestamp;
+  uint64_t recv_timestamp; /* (acks only) */
+  uint64_t payload_length; /* of the datagram, or of the one acked */
+  uint64_t delivered;
+  uint64_t delivered_time;
+  bool ack;
+};
+
+/* (on the wire, a datagram is a header and its payload, and an ack is just the header) */
+uint64_t payload_size( const SimulatedDatagram & datagram );
+
+/* One controller, sending over an emulated uplink to a receiver that
+   acks every datagram over an emulated downlink, all in virtual time:
+   no sockets and no waiting, so a run takes as long as it takes to
+   compute, and the same run always gives the same result. The sender
+   follows the same rules as sender.cc's. */
+class Simulation
+{
+public:
+  struct Config
+  {
+    EmulatedLink::Config uplink {}, downlink {};
+    uint64_t duration = 0; /* in microseconds (0 for one period of the uplink trace) */
+    unsigned int seed = 1; /* of the links' random losses */
+  };
+
+  struct Result
+  {
+    EmulatedLink::Summary uplink {};
+    uint64_t sent = 0, retransmitted = 0, acked = 0; /* datagrams */
+  };
+
+private:
+  typedef BasicEmulatedLink<SimulatedDatagram> Link;
+
+  Config config_;
+  std::unique_ptr<Controller> controller_;
+
+  uint64_t now_; /* the virtual clock (in microseconds) */
+  uint64_t sequence_number_;
+
+  Link uplink_, downlink_;
+
+  Result result_;
+
+  void send_datagram( const bool after_timeout );
+
+  /* datagrams through the uplink are acked; acks through the downlink
+     go to the controller (returns true if there were any) */
+  bool receive();
+
+public:
+  Simulation( const Config & config, std::unique_ptr<Controller> && controller );
+
+  /* run to the end, once */
+  Result run();
+
+  /* forbid copying or assigning */
+  Simulation( const Simulation & other ) = delete;
+  const Simulation & operator=( const Simulation & other ) = delete;
+};
+
+#endif /* SIMULATION_HH */
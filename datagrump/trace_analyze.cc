@@ -0,0 +1,203 @@
+/* offline analysis of a sender's packet trace (sender --trace=FILE):
+   throughput, per-packet delay percentiles, and how close the
+   controller's RTprop and BtlBw estimates were to the real thing */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "packet_trace.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* window over which the achieved delivery rate is measured (in microseconds) */
+static const uint64_t RATE_WINDOW = 100000;
+
+/* nearest-rank percentile of sorted values */
+static double percentile( const vector<double> & sorted, const double p )
+{
+  if ( sorted.empty() ) {
+    return 0;
+  }
+
+  const size_t rank = ceil( p / 100 * sorted.size() );
+  return sorted[ rank ? rank - 1 : 0 ];
+}
+
+/* relative errors of an estimator against the truth */
+class ErrorSummary
+{
+private:
+  vector<double> errors_ {};
+
+public:
+  void add( const double estimate, const double truth )
+  {
+    if ( estimate > 0 and truth > 0 ) {
+      errors_.push_back( (estimate - truth) / truth );
+    }
+  }
+
+  void print( const string & name, const double truth, const string & unit )
+  {
+    cout << name << " (truth " << truth << " " << unit << "): ";
+    if ( errors_.empty() ) {
+      cout << "no estimates in trace" << endl;
+      return;
+    }
+
+    double bias = 0;
+    vector<double> absolute;
+    for ( const double error : errors_ ) {
+      bias += error;
+      absolute.push_back( fabs( error ) );
+    }
+    sort( absolute.begin(), absolute.end() );
+
+    double mean_absolute = 0;
+    for ( const double error : absolute ) {
+      mean_absolute += error;
+    }
+
+    cout << "mean |error| " << 100 * mean_absolute / absolute.size() << "%, "
+	 << "p95 |error| " << 100 * percentile( absolute, 95 ) << "%, "
+	 << "bias " << showpos << 100 * bias / errors_.size() << noshowpos << "%"
+	 << " (" << errors_.size() << " acks)" << endl;
+  }
+};
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  /* the true path properties, if known (otherwise they're taken from the trace) */
+  double true_rtprop = 0; /* in microseconds */
+  double true_btlbw = 0; /* in bytes per microsecond */
+  bool usage_ok = argc >= 2;
+
+  for ( int i = 2; usage_ok and i < argc; i++ ) {
+    const string arg( argv[ i ] );
+    if ( arg.compare( 0, 14, "--true-rtprop=" ) == 0 ) {
+      true_rtprop = 1000 * atof( arg.c_str() + 14 );
+    } else if ( arg.compare( 0, 13, "--true-btlbw=" ) == 0 ) {
+      true_btlbw = atof( arg.c_str() + 13 ) / 8;
+    } else {
+      usage_ok = false;
+    }
+  }
+
+  if ( not usage_ok ) {
+    cerr << "Usage: " << argv[ 0 ] << " TRACE [--true-rtprop=MS] [--true-btlbw=MBPS]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const PacketTraceReader trace( argv[ 1 ] );
+
+    /* one pass over the events for the counts and per-packet delays */
+    uint64_t sent = 0, retransmitted = 0, acked = 0, lost = 0, acked_bytes = 0;
+    uint64_t first_time = 0, last_time = 0;
+    vector<const PacketEvent *> acks;
+    vector<double> sorted_rtts;
+
+    for ( const PacketEvent & event : trace ) {
+      if ( &event == trace.begin() ) {
+	first_time = event.time;
+      }
+      last_time = max( last_time, event.time );
+
+      switch ( event.type ) {
+      case PacketEvent::Sent:
+	sent++;
+	break;
+      case PacketEvent::Retransmitted:
+	retransmitted++;
+	break;
+      case PacketEvent::Acked:
+	acked++;
+	acked_bytes += event.payload_length;
+	acks.push_back( &event );
+	sorted_rtts.push_back( event.time - event.send_timestamp );
+	break;
+      case PacketEvent::Lost:
+	lost++;
+	break;
+      }
+    }
+
+    const double duration = last_time - first_time; /* in microseconds */
+    sort( sorted_rtts.begin(), sorted_rtts.end() );
+    const double min_rtt = percentile( sorted_rtts, 0 );
+
+    cout << fixed << setprecision( 3 );
+    cout << "algorithm: " << trace.algorithm() << endl;
+    cout << "events: " << trace.size() << " (" << sent << " sent, "
+	 << retransmitted << " retransmitted or sent after a timeout, " << acked << " acked, "
+	 << lost << " lost)"
+	 << " over " << duration / 1e6 << " s" << endl;
+
+    if ( acks.empty() or duration <= 0 ) {
+      cout << "no acks: nothing more to analyze" << endl;
+      return EXIT_SUCCESS;
+    }
+
+    cout << "throughput: " << 8 * acked_bytes / duration << " Mbit/s" << endl;
+
+    cout << "RTT (ms): min " << min_rtt / 1000
+	 << ", median " << percentile( sorted_rtts, 50 ) / 1000
+	 << ", p95 " << percentile( sorted_rtts, 95 ) / 1000
+	 << ", p99 " << percentile( sorted_rtts, 99 ) / 1000
+	 << ", max " << sorted_rtts.back() / 1000 << endl;
+
+    cout << "queueing delay (RTT - min RTT, ms): median "
+	 << (percentile( sorted_rtts, 50 ) - min_rtt) / 1000
+	 << ", p95 " << (percentile( sorted_rtts, 95 ) - min_rtt) / 1000
+	 << ", p99 " << (percentile( sorted_rtts, 99 ) - min_rtt) / 1000 << endl;
+
+    /* without ground truth, the best the trace shows: the minimum RTT, and the
+       highest delivery rate over any RATE_WINDOW */
+    if ( true_rtprop == 0 ) {
+      true_rtprop = min_rtt;
+    }
+
+    if ( true_btlbw == 0 ) {
+      uint64_t window_bytes = 0;
+      size_t window_start = 0;
+      for ( size_t i = 0; i < acks.size(); i++ ) {
+	window_bytes += acks[ i ]->payload_length;
+	while ( acks[ i ]->time - acks[ window_start ]->time > RATE_WINDOW ) {
+	  window_bytes -= acks[ window_start++ ]->payload_length;
+	}
+	if ( acks[ i ]->time - acks.front()->time >= RATE_WINDOW ) {
+	  true_btlbw = max( true_btlbw, double( window_bytes ) / RATE_WINDOW );
+	}
+      }
+
+      /* (a trace shorter than the window) */
+      if ( true_btlbw == 0 ) {
+	true_btlbw = acked_bytes / duration;
+      }
+    }
+
+    ErrorSummary rtprop_errors, btlbw_errors;
+    for ( const PacketEvent * ack : acks ) {
+      rtprop_errors.add( ack->rt_estimate, true_rtprop );
+      btlbw_errors.add( ack->btlbw_estimate, true_btlbw );
+    }
+
+    rtprop_errors.print( "RTprop estimate", true_rtprop / 1000, "ms" );
+    btlbw_errors.print( "BtlBw estimate", 8 * true_btlbw, "Mbit/s" );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
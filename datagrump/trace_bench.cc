@@ -0,0 +1,73 @@
+/* per-event cost of the sender's packet trace: filling in an event
+   (with the controller's state, through the Controller interface) and
+   appending it to the memory-mapped file */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+
+#include "controller.hh"
+#include "packet_trace.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const uint64_t EVENTS = 1 << 20;
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << endl;
+    return EXIT_FAILURE;
+  }
+
+  /* a scratch file name (each trace file is unlinked as soon as it's open) */
+  char filename[] = "/tmp/trace-bench.XXXXXX";
+  SystemCall( "close", close( SystemCall( "mkstemp", mkstemp( filename ) ) ) );
+
+  unique_ptr<Controller> controller = Controller::make( "bbr" );
+
+  cout << "events\t\tns/event (raw append)\tns/event (with controller state)" << endl;
+
+  for ( unsigned int trial = 0; trial < 3; trial++ ) {
+    PacketTraceWriter trace( filename, 2 * EVENTS, "bbr" );
+    unlink( filename );
+
+    PacketEvent event {};
+    event.payload_length = 1424;
+
+    /* just the store into the mapping */
+    uint64_t start = timestamp_ns();
+    for ( uint64_t i = 0; i < EVENTS; i++ ) {
+      event.time = event.send_timestamp = i;
+      event.sequence_number = i;
+      trace.append( event );
+    }
+    const double raw_ns = double( timestamp_ns() - start ) / EVENTS;
+
+    /* everything the sender does per event */
+    start = timestamp_ns();
+    for ( uint64_t i = 0; i < EVENTS; i++ ) {
+      event.time = event.send_timestamp = i;
+      event.sequence_number = i;
+      event.type = PacketEvent::Sent;
+      controller->trace_state( event );
+      trace.append( event );
+    }
+    const double full_ns = double( timestamp_ns() - start ) / EVENTS;
+
+    if ( trace.count() != 2 * EVENTS ) {
+      throw runtime_error( "trace-bench: lost events" );
+    }
+
+    cout << trace.count() << "\t\t" << raw_ns << "\t\t\t" << full_ns << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+
+#include "vegas_controller.hh"
+#include "log.hh"
+
+using namespace std;
+
+/* Initial and smallest windows (in datagrams) */
+static const double INITIAL_CWND = 10;
+static const double MIN_CWND = 2;
+
+/* Target range of datagrams queued at the bottleneck, and the
+   queue at which slow start ends */
+static const double ALPHA = 2;
+static const double BETA = 4;
+static const double GAMMA = 1;
+
+VegasController::VegasController()
+  : Controller(), cwnd( INITIAL_CWND ), ssthresh( 1e9 ),
+    round_end( 0 ), round_min_rtt( 0 ), doubling_round( true ), recovery_end( 0 )
+{}
+
+/* Get current window size, in datagrams */
+unsigned int VegasController::window_size()
+{
+  return cwnd;
+}
+
+/* A datagram was sent */
+void VegasController::datagram_was_sent( const uint64_t sequence_number,
+					 const uint64_t send_timestamp,
+					 const uint64_t payload_length,
+					 const bool after_timeout )
+{
+  LOG( Debug, "At time {} sent datagram {} (timeout = {})",
+       send_timestamp, sequence_number, after_timeout );
+
+  count_sent( sequence_number, send_timestamp, payload_length, after_timeout );
+
+  /* a timeout means the whole window was lost: start over from one datagram */
+  if ( after_timeout ) {
+    ssthresh = max( cwnd / 2, MIN_CWND );
+    cwnd = 1;
+    recovery_end = next_sequence_number;
+  }
+}
+
+/* An ack was received */
+void VegasController::ack_received( const uint64_t sequence_number_acked,
+				    const uint64_t send_timestamp_acked,
+				    const uint64_t,
+				    const uint64_t timestamp_ack_received,
+				    const uint64_t payload_length,
+				    const uint64_t,
+				    const uint64_t )
+{
+  uint64_t lost;
+  const bool news = count_acked( sequence_number_acked, send_timestamp_acked,
+				 timestamp_ack_received, payload_length, lost );
+
+  /* (a duplicate or stale ack gives no RTT sample, and doesn't end a round) */
+  if ( news ) {
+    const double rtt = rtt_sample( send_timestamp_acked, timestamp_ack_received );
+    round_min_rtt = round_min_rtt == 0 ? rtt : min( round_min_rtt, rtt );
+  }
+
+  if ( lost and sequence_number_acked >= recovery_end ) {
+    /* losses still halve the window, as in Reno */
+    ssthresh = max( cwnd / 2, MIN_CWND );
+    cwnd = ssthresh;
+    recovery_end = next_sequence_number;
+  } else if ( news and sequence_number_acked >= round_end ) {
+    /* a round is over: how many datagrams did we keep queued? */
+    const double queued = cwnd * (1 - min_rtt / round_min_rtt);
+
+    if ( cwnd < ssthresh ) {
+      if ( queued > GAMMA ) {
+	/* leave slow start, giving back the queue it built */
+	ssthresh = MIN_CWND;
+	cwnd = max( cwnd - queued, MIN_CWND );
+      } else if ( doubling_round ) {
+	/* slow start: double the window every other round, so that
+	   the rounds in between measure the RTT at a steady window */
+	cwnd *= 2;
+      }
+      doubling_round = not doubling_round;
+    } else if ( queued < ALPHA ) {
+      cwnd += 1;
+    } else if ( queued > BETA ) {
+      cwnd = max( cwnd - 1, MIN_CWND );
+    }
+
+    round_end = next_sequence_number;
+    round_min_rtt = 0;
+  }
+
+  LOG( Debug, "At time {} window is {} (base RTT {}, {} lost)",
+       timestamp_ack_received, cwnd, min_rtt, lost );
+}
+
+bool VegasController::window_is_open()
+{
+  return inflight < window_size();
+}
@@ -0,0 +1,48 @@
+#ifndef VEGAS_CONTROLLER_HH
+#define VEGAS_CONTROLLER_HH
+
+#include "controller.hh"
+
+/* TCP Vegas: once per RTT, estimate how many of our datagrams are
+   sitting in the bottleneck queue from how far the RTT is above its
+   minimum, and steer the window to keep that between ALPHA and BETA */
+
+class VegasController final : public Controller
+{
+private:
+  double cwnd; /* in datagrams */
+  double ssthresh; /* slow start until cwnd reaches this */
+
+  /* the current round: it ends when this sequence number is acked */
+  uint64_t round_end;
+  double round_min_rtt; /* smallest RTT seen this round (0 if none) */
+  bool doubling_round; /* slow start doubles the window every other round */
+
+  /* no further cuts until this sequence number is acked */
+  uint64_t recovery_end;
+
+public:
+  /* Name to pick this algorithm by */
+  static std::string name() { return "vegas"; }
+
+  VegasController();
+
+  unsigned int window_size() override;
+
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t payload_length,
+			  const bool after_timeout ) override;
+
+  void ack_received( const uint64_t sequence_number_acked,
+		     const uint64_t send_timestamp_acked,
+		     const uint64_t recv_timestamp_acked,
+		     const uint64_t timestamp_ack_received,
+		     const uint64_t payload_length,
+		     const uint64_t packet_delivered,
+		     const uint64_t packet_delivered_time ) override;
+
+  bool window_is_open() override;
+};
+
+#endif /* VEGAS_CONTROLLER_HH */
@@ -0,0 +1,260 @@
+#include <csignal>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_uring.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* ring indices are shared with the kernel */
+static unsigned int load_acquire( const unsigned int * p )
+{
+  return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+}
+
+static void store_release( unsigned int * p, const unsigned int value )
+{
+  __atomic_store_n( p, value, __ATOMIC_RELEASE );
+}
+
+/* set up a new ring with the kernel */
+IoUring::Setup IoUring::setup( const unsigned int entries )
+{
+  Setup ret;
+  zero( ret.params );
+
+  ret.fd = SystemCall( "io_uring_setup",
+		       syscall( __NR_io_uring_setup, entries, &ret.params ) );
+
+  return ret;
+}
+
+/* construct a ring with room for (at least) entries SQEs */
+IoUring::IoUring( const unsigned int entries )
+  : IoUring( setup( entries ) )
+{}
+
+/* private constructor given an already set-up ring */
+IoUring::IoUring( const Setup & s_setup )
+  : FileDescriptor( s_setup.fd ),
+    params_( s_setup.params ),
+    ring_memory_( nullptr ),
+    ring_memory_size_( 0 ),
+    sqes_( nullptr ),
+    sq_head_(), sq_tail_(), sq_array_(), sq_mask_(), sq_local_tail_(),
+    cq_head_(), cq_tail_(), cqes_(), cq_mask_(),
+    buffer_ring_( nullptr ),
+    buffer_ring_size_( 0 ),
+    buffers_(),
+    buffer_size_( 0 ),
+    buffer_count_( 0 )
+{
+  /* we rely on one mapping covering both rings, and on timeouts
+     passed to io_uring_enter (both since Linux 5.11) */
+  if ( not (params_.features & IORING_FEAT_SINGLE_MMAP)
+       or not (params_.features & IORING_FEAT_EXT_ARG) ) {
+    throw runtime_error( "io_uring: kernel lacks required features" );
+  }
+
+  /* map the submission and completion rings */
+  ring_memory_size_ = max( params_.sq_off.array + params_.sq_entries * sizeof( unsigned int ),
+			   params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe ) );
+  ring_memory_ = mmap( nullptr, ring_memory_size_, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd_num(), IORING_OFF_SQ_RING );
+  if ( ring_memory_ == MAP_FAILED ) {
+    ring_memory_ = nullptr;
+    throw unix_error( "mmap (io_uring rings)" );
+  }
+
+  /* map the submission queue entries */
+  void * sqe_memory = mmap( nullptr, params_.sq_entries * sizeof( io_uring_sqe ),
+			    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			    fd_num(), IORING_OFF_SQES );
+  if ( sqe_memory == MAP_FAILED ) {
+    munmap( ring_memory_, ring_memory_size_ );
+    ring_memory_ = nullptr;
+    throw unix_error( "mmap (io_uring SQEs)" );
+  }
+  sqes_ = static_cast<io_uring_sqe *>( sqe_memory );
+
+  char * const ring = static_cast<char *>( ring_memory_ );
+
+  sq_head_ = reinterpret_cast<unsigned int *>( ring + params_.sq_off.head );
+  sq_tail_ = reinterpret_cast<unsigned int *>( ring + params_.sq_off.tail );
+  sq_array_ = reinterpret_cast<unsigned int *>( ring + params_.sq_off.array );
+  sq_mask_ = *reinterpret_cast<unsigned int *>( ring + params_.sq_off.ring_mask );
+  sq_local_tail_ = *sq_tail_;
+
+  cq_head_ = reinterpret_cast<unsigned int *>( ring + params_.cq_off.head );
+  cq_tail_ = reinterpret_cast<unsigned int *>( ring + params_.cq_off.tail );
+  cqes_ = reinterpret_cast<io_uring_cqe *>( ring + params_.cq_off.cqes );
+  cq_mask_ = *reinterpret_cast<unsigned int *>( ring + params_.cq_off.ring_mask );
+}
+
+/* destructor */
+IoUring::~IoUring()
+{
+  if ( buffer_ring_ ) {
+    munmap( buffer_ring_, buffer_ring_size_ );
+  }
+
+  if ( sqes_ ) {
+    munmap( sqes_, params_.sq_entries * sizeof( io_uring_sqe ) );
+  }
+
+  if ( ring_memory_ ) {
+    munmap( ring_memory_, ring_memory_size_ );
+  }
+}
+
+/* can this kernel (and sandbox) do io_uring with everything we use? */
+bool IoUring::supported()
+{
+  try {
+    IoUring probe( 4 );
+    probe.register_buffer_ring( 1, 64 );
+    return true;
+  } catch ( const exception & ) {
+    return false;
+  }
+}
+
+/* get a zeroed SQE to fill in */
+io_uring_sqe & IoUring::next_sqe()
+{
+  if ( sq_local_tail_ - load_acquire( sq_head_ ) >= params_.sq_entries ) {
+    submit();
+    if ( sq_local_tail_ - load_acquire( sq_head_ ) >= params_.sq_entries ) {
+      throw runtime_error( "io_uring: submission queue full" );
+    }
+  }
+
+  const unsigned int index = sq_local_tail_ & sq_mask_;
+  io_uring_sqe & sqe = sqes_[ index ];
+  zero( sqe );
+  sq_array_[ index ] = index;
+  sq_local_tail_++;
+
+  return sqe;
+}
+
+/* submit queued SQEs and wait for at least min_complete completions */
+bool IoUring::submit_and_wait( const unsigned int min_complete, const int64_t timeout_us )
+{
+  /* publish the SQEs handed out since the last submission */
+  store_release( sq_tail_, sq_local_tail_ );
+  const unsigned int to_submit = sq_local_tail_ - load_acquire( sq_head_ );
+
+  unsigned int flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+  __kernel_timespec timeout;
+  zero( timeout );
+  io_uring_getevents_arg arg;
+  zero( arg );
+
+  if ( min_complete and timeout_us >= 0 ) {
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>( &timeout );
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  if ( 0 == to_submit and 0 == min_complete ) {
+    return load_acquire( cq_tail_ ) != *cq_head_;
+  }
+
+  const long ret = syscall( __NR_io_uring_enter, fd_num(), to_submit, min_complete, flags,
+			    (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr,
+			    (flags & IORING_ENTER_EXT_ARG) ? sizeof( arg ) : 0 );
+  if ( ret < 0 and errno != ETIME ) {
+    throw unix_error( "io_uring_enter" );
+  }
+
+  /* when SQEs were submitted, the kernel reports that count even if the
+     wait timed out, so look at the completion queue itself */
+  return load_acquire( cq_tail_ ) != *cq_head_;
+}
+
+/* pass available completions (up to limit) to handler */
+unsigned int IoUring::reap( const function<void(const io_uring_cqe &)> & handler,
+			    const unsigned int limit )
+{
+  register_read();
+
+  unsigned int head = *cq_head_;
+  unsigned int count = 0;
+
+  while ( count < limit and head != load_acquire( cq_tail_ ) ) {
+    /* copy the CQE and release its slot before the handler can submit more */
+    const io_uring_cqe cqe = cqes_[ head & cq_mask_ ];
+    store_release( cq_head_, ++head );
+
+    handler( cqe );
+    count++;
+  }
+
+  return count;
+}
+
+/* register count buffers of buffer_size bytes each for IOSQE_BUFFER_SELECT */
+void IoUring::register_buffer_ring( const unsigned int count, const size_t buffer_size )
+{
+  if ( buffer_ring_ ) {
+    throw runtime_error( "io_uring: buffer ring already registered" );
+  }
+
+  if ( count == 0 or count > 32768 or (count & (count - 1)) ) {
+    throw runtime_error( "io_uring: buffer count must be a power of two up to 32768" );
+  }
+
+  /* the buffer ring itself must be page-aligned */
+  const size_t page_size = sysconf( _SC_PAGESIZE );
+  const size_t ring_size = ((count * sizeof( io_uring_buf ) + page_size - 1) / page_size) * page_size;
+  void * const ring_memory = mmap( nullptr, ring_size, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0 );
+  if ( ring_memory == MAP_FAILED ) {
+    throw unix_error( "mmap (io_uring buffer ring)" );
+  }
+
+  buffer_ring_ = static_cast<io_uring_buf_ring *>( ring_memory );
+  buffer_ring_size_ = ring_size;
+  buffers_.resize( count * buffer_size );
+  buffer_size_ = buffer_size;
+  buffer_count_ = count;
+
+  io_uring_buf_reg registration;
+  zero( registration );
+  registration.ring_addr = reinterpret_cast<uint64_t>( buffer_ring_ );
+  registration.ring_entries = count;
+  registration.bgid = BUFFER_GROUP;
+
+  SystemCall( "io_uring_register",
+	      syscall( __NR_io_uring_register, fd_num(),
+		       IORING_REGISTER_PBUF_RING, &registration, 1 ) );
+
+  /* hand every buffer to the kernel */
+  for ( unsigned int i = 0; i < count; i++ ) {
+    recycle_buffer( i );
+  }
+}
+
+/* give a provided buffer back to the kernel */
+void IoUring::recycle_buffer( const uint16_t buffer_id )
+{
+  /* (bufs[] is declared as a flexible array, which a C++ compiler may
+     not place at offset 0 the way the kernel does, so index by hand) */
+  io_uring_buf * const entries = reinterpret_cast<io_uring_buf *>( buffer_ring_ );
+
+  const uint16_t tail = buffer_ring_->tail;
+  io_uring_buf & entry = entries[ tail & (buffer_count_ - 1) ];
+
+  entry.addr = reinterpret_cast<uint64_t>( buffer( buffer_id ) );
+  entry.len = buffer_size_;
+  entry.bid = buffer_id;
+
+  __atomic_store_n( &buffer_ring_->tail, uint16_t( tail + 1 ), __ATOMIC_RELEASE );
+}
@@ -0,0 +1,96 @@
+#ifndef IO_URING_HH
+#define IO_URING_HH
+
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+#include "file_descriptor.hh"
+
+/* minimal io_uring instance: a submission queue, a completion queue,
+   and (optionally) one ring of provided buffers for multishot receives */
+class IoUring : public FileDescriptor
+{
+private:
+  /* result of io_uring_setup() */
+  struct Setup
+  {
+    int fd;
+    io_uring_params params;
+  };
+
+  static Setup setup( const unsigned int entries );
+
+  /* private constructor given an already set-up ring */
+  IoUring( const Setup & s_setup );
+
+  io_uring_params params_;
+
+  /* mapped submission and completion rings */
+  void * ring_memory_;
+  size_t ring_memory_size_;
+  io_uring_sqe * sqes_;
+
+  unsigned int * sq_head_;
+  unsigned int * sq_tail_;
+  unsigned int * sq_array_;
+  unsigned int sq_mask_;
+  unsigned int sq_local_tail_; /* SQEs handed out but not yet published */
+
+  unsigned int * cq_head_;
+  unsigned int * cq_tail_;
+  io_uring_cqe * cqes_;
+  unsigned int cq_mask_;
+
+  /* provided buffer ring (if registered) */
+  io_uring_buf_ring * buffer_ring_;
+  size_t buffer_ring_size_;
+  std::vector<char> buffers_;
+  size_t buffer_size_;
+  unsigned int buffer_count_;
+
+public:
+  /* buffer group used by register_buffer_ring() */
+  static const uint16_t BUFFER_GROUP = 0;
+
+  /* construct a ring with room for (at least) entries SQEs */
+  IoUring( const unsigned int entries );
+
+  /* destructor */
+  ~IoUring();
+
+  /* can this kernel (and sandbox) do io_uring with everything we use? */
+  static bool supported();
+
+  /* get a zeroed SQE to fill in (submitting queued SQEs first if the ring is full) */
+  io_uring_sqe & next_sqe();
+
+  /* submit queued SQEs and wait (up to timeout_us, or forever if negative)
+     for at least min_complete completions; returns false on timeout */
+  bool submit_and_wait( const unsigned int min_complete, const int64_t timeout_us = -1 );
+
+  /* submit queued SQEs without waiting */
+  void submit() { submit_and_wait( 0 ); }
+
+  /* pass available completions (up to limit) to handler; returns how many there were */
+  unsigned int reap( const std::function<void(const io_uring_cqe &)> & handler,
+		     const unsigned int limit = -1 );
+
+  /* register count buffers of buffer_size bytes each for IOSQE_BUFFER_SELECT */
+  void register_buffer_ring( const unsigned int count, const size_t buffer_size );
+
+  /* accessors for provided buffers */
+  char * buffer( const uint16_t buffer_id ) { return &buffers_.at( buffer_id * buffer_size_ ); }
+  size_t buffer_size() const { return buffer_size_; }
+
+  /* give a provided buffer back to the kernel */
+  void recycle_buffer( const uint16_t buffer_id );
+
+  /* forbid copying IoUring objects or assigning them */
+  IoUring( const IoUring & other ) = delete;
+  const IoUring & operator=( const IoUring & other ) = delete;
+};
+
+#endif /* IO_URING_HH */
@@ -0,0 +1,235 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "log.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* The ring is a bounded multi-producer queue (after Dmitry Vyukov's):
+   each slot's sequence number says whose turn it is. A producer may
+   fill the slot at position pos when its sequence is pos, and publishes
+   it by setting it to pos + 1; the drain thread empties it then, and
+   hands it to the producer one lap later by setting it to pos + RING_SIZE. */
+static const uint64_t RING_SIZE = 1 << 14;
+
+atomic<Log::Level> Log::level_( Log::Level::Info );
+
+/* owns the ring and the drain thread */
+class LogDrainer
+{
+public:
+  Log::Record ring[ RING_SIZE ];
+  atomic<uint64_t> enqueue_position { 0 };
+  atomic<uint64_t> dropped { 0 };
+
+  /* the consumer side: the drain thread, or a caller of Log::flush() */
+  mutex drain_mutex {};
+  uint64_t dequeue_position { 0 };
+  uint64_t dropped_reported { 0 };
+
+  once_flag start_once {};
+  atomic<bool> stopping { false };
+  thread drain_thread {};
+
+  LogDrainer()
+  {
+    for ( uint64_t i = 0; i < RING_SIZE; i++ ) {
+      ring[ i ].sequence.store( i, memory_order_relaxed );
+    }
+  }
+
+  /* write out whatever is in the ring; returns how many records that was */
+  size_t drain();
+
+  void start()
+  {
+    call_once( start_once, [&] () {
+	drain_thread = thread( [&] () {
+	    while ( not stopping.load() ) {
+	      /* poll often while there's traffic, less so when idle */
+	      this_thread::sleep_for( chrono::milliseconds( drain() ? 1 : 10 ) );
+	    }
+	  } );
+      } );
+  }
+
+  /* at exit, stop the drain thread and write out the rest */
+  ~LogDrainer()
+  {
+    stopping.store( true );
+    if ( drain_thread.joinable() ) {
+      drain_thread.join();
+    }
+    drain();
+  }
+
+  /* forbid copying or assigning */
+  LogDrainer( const LogDrainer & other ) = delete;
+  const LogDrainer & operator=( const LogDrainer & other ) = delete;
+
+  /* the text of one record */
+  static void format_record( const Log::Record & record, string & out );
+};
+
+static LogDrainer drainer;
+
+Log::Record * Log::claim()
+{
+  drainer.start();
+
+  uint64_t position = drainer.enqueue_position.load( memory_order_relaxed );
+  while ( true ) {
+    Record & record = drainer.ring[ position & (RING_SIZE - 1) ];
+    const int64_t lag = int64_t( record.sequence.load( memory_order_acquire ) - position );
+
+    if ( lag == 0 ) {
+      /* the slot is free: try to take it */
+      if ( drainer.enqueue_position.compare_exchange_weak( position, position + 1,
+							   memory_order_relaxed ) ) {
+	return &record;
+      }
+    } else if ( lag < 0 ) {
+      /* the drain thread is a whole lap behind */
+      drainer.dropped.fetch_add( 1, memory_order_relaxed );
+      return nullptr;
+    } else {
+      /* another producer took it first */
+      position = drainer.enqueue_position.load( memory_order_relaxed );
+    }
+  }
+}
+
+void Log::publish( Record & record )
+{
+  record.sequence.store( record.sequence.load( memory_order_relaxed ) + 1,
+			 memory_order_release );
+}
+
+void Log::store_string( Record & record, const unsigned int index,
+			const char * value, const size_t length )
+{
+  /* once the strings are full, later ones all come out empty (pointing
+     at the last byte, which is then always a NUL) */
+  const size_t last = sizeof( record.strings ) - 1;
+  const size_t offset = record.string_bytes >= last ? last : record.string_bytes;
+  const size_t copied = min( length, last - offset );
+
+  record.types[ index ] = Type::String;
+  record.values[ index ].u = offset;
+  memcpy( record.strings + offset, value, copied );
+  record.strings[ offset + copied ] = 0;
+  record.string_bytes = offset + copied + 1;
+}
+
+static const char * const level_names[] = { "error", "warning", "info", "debug", "trace" };
+
+Log::Level Log::level_from_name( const string & name )
+{
+  for ( unsigned int level = 0; level <= unsigned( Level::Trace ); level++ ) {
+    if ( name == level_names[ level ] ) {
+      return Level( level );
+    }
+  }
+
+  throw runtime_error( "unknown log level: " + name );
+}
+
+uint64_t Log::now()
+{
+  return timestamp_ns();
+}
+
+/* the text of one record */
+void LogDrainer::format_record( const Log::Record & record, string & out )
+{
+  char buffer[ 64 ];
+  snprintf( buffer, sizeof( buffer ), "%" PRIu64 ".%06" PRIu64 " %s ",
+	    record.timestamp / 1000000000, record.timestamp / 1000 % 1000000,
+	    level_names[ unsigned( record.level ) ] );
+  out += buffer;
+
+  unsigned int argument = 0;
+  for ( const char * p = record.format; *p; p++ ) {
+    if ( p[ 0 ] != '{' or p[ 1 ] != '}' or argument >= record.argument_count ) {
+      out += *p;
+      continue;
+    }
+
+    const auto & value = record.values[ argument ];
+    switch ( record.types[ argument ] ) {
+    case Log::Type::Signed:
+      snprintf( buffer, sizeof( buffer ), "%" PRId64, value.i );
+      break;
+    case Log::Type::Unsigned:
+      snprintf( buffer, sizeof( buffer ), "%" PRIu64, value.u );
+      break;
+    case Log::Type::Double:
+      snprintf( buffer, sizeof( buffer ), "%g", value.d );
+      break;
+    case Log::Type::String:
+      snprintf( buffer, sizeof( buffer ), "%s", record.strings + value.u );
+      break;
+    }
+    out += buffer;
+
+    argument++;
+    p++;
+  }
+
+  out += '\n';
+}
+
+size_t LogDrainer::drain()
+{
+  unique_lock<mutex> lock( drain_mutex );
+
+  string text;
+  size_t count = 0;
+
+  while ( true ) {
+    Log::Record & record = ring[ dequeue_position & (RING_SIZE - 1) ];
+    if ( record.sequence.load( memory_order_acquire ) != dequeue_position + 1 ) {
+      break;
+    }
+
+    format_record( record, text );
+    record.sequence.store( dequeue_position + RING_SIZE, memory_order_release );
+    dequeue_position++;
+    count++;
+  }
+
+  const uint64_t dropped_now = dropped.load( memory_order_relaxed );
+  if ( dropped_now != dropped_reported ) {
+    text += "(log ring full: " + to_string( dropped_now - dropped_reported ) + " records dropped)\n";
+    dropped_reported = dropped_now;
+  }
+
+  /* one system call for the whole batch (errors have nowhere to go) */
+  size_t written = 0;
+  while ( written < text.size() ) {
+    const ssize_t ret = ::write( STDERR_FILENO, text.data() + written, text.size() - written );
+    if ( ret <= 0 ) {
+      break;
+    }
+    written += ret;
+  }
+
+  return count;
+}
+
+void Log::flush()
+{
+  drainer.drain();
+}
+
+uint64_t Log::dropped()
+{
+  return drainer.dropped.load( memory_order_relaxed );
+}
@@ -0,0 +1,161 @@
+#ifndef LOG_HH
+#define LOG_HH
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/* Low-overhead logging. LOG( level, format, args... ) copies the format
+   pointer and its arguments (numbers, and strings up to a few dozen
+   bytes in all) into a fixed-size record in a lock-free in-memory ring,
+   without formatting or system calls. A background thread drains the
+   ring, replaces each "{}" in the format with the next argument, and
+   writes the lines to stderr in batches. If the ring is full, records
+   are dropped (and counted) rather than blocking the caller.
+
+   A statement whose level is above the runtime level (see
+   Log::set_level, Info by default) costs one relaxed load and a
+   branch, and one above LOG_COMPILE_LEVEL is compiled out entirely,
+   arguments and all. */
+
+/* 0 = Error, 1 = Warning, 2 = Info, 3 = Debug, 4 = Trace */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 4
+#endif
+
+#define LOG( level, ... )						\
+  do {									\
+    if ( Log::Level::level <= Log::Level( LOG_COMPILE_LEVEL )		\
+	 and Log::enabled( Log::Level::level ) ) {			\
+      Log::write( Log::Level::level, __VA_ARGS__ );			\
+    }									\
+  } while ( 0 )
+
+class Log
+{
+public:
+  enum class Level : uint8_t { Error, Warning, Info, Debug, Trace };
+
+  static const unsigned int MAX_ARGUMENTS = 6;
+
+private:
+  enum class Type : uint8_t { Signed, Unsigned, Double, String };
+
+  /* one log statement, as the drain thread will see it */
+  struct alignas( 64 ) Record
+  {
+    std::atomic<uint64_t> sequence; /* ring slot state (see log.cc) */
+    uint64_t timestamp; /* in nanoseconds */
+    const char * format; /* must outlive the program (a string literal) */
+    Level level;
+    uint8_t argument_count;
+    uint8_t string_bytes; /* used of strings */
+    Type types[ MAX_ARGUMENTS ];
+    union {
+      int64_t i;
+      uint64_t u;
+      double d;
+    } values[ MAX_ARGUMENTS ]; /* strings: offset into strings */
+    char strings[ 40 ];
+  };
+
+  static std::atomic<Level> level_;
+
+  friend class LogDrainer;
+
+  /* claim a slot in the ring (nullptr if it's full), and hand it to the drain thread */
+  static Record * claim();
+  static void publish( Record & record );
+
+  /* store one argument */
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value and std::is_signed<T>::value>::type
+  store( Record & record, const unsigned int index, const T value )
+  {
+    record.types[ index ] = Type::Signed;
+    record.values[ index ].i = value;
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value and std::is_unsigned<T>::value>::type
+  store( Record & record, const unsigned int index, const T value )
+  {
+    record.types[ index ] = Type::Unsigned;
+    record.values[ index ].u = value;
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value>::type
+  store( Record & record, const unsigned int index, const T value )
+  {
+    record.types[ index ] = Type::Double;
+    record.values[ index ].d = value;
+  }
+
+  /* strings are copied (and truncated to fit what's left of the record) */
+  static void store( Record & record, const unsigned int index, const char * value )
+  {
+    store_string( record, index, value, strlen( value ) );
+  }
+
+  static void store( Record & record, const unsigned int index, const std::string & value )
+  {
+    store_string( record, index, value.data(), value.size() );
+  }
+
+  static void store_string( Record & record, const unsigned int index,
+			    const char * value, const size_t length );
+
+  static void store_all( Record &, const unsigned int ) {}
+
+  template <typename T, typename... Rest>
+  static void store_all( Record & record, const unsigned int index,
+			 const T & value, const Rest &... rest )
+  {
+    store( record, index, value );
+    store_all( record, index + 1, rest... );
+  }
+
+  /* the time for the record */
+  static uint64_t now();
+
+public:
+  /* log statements above this level are skipped */
+  static void set_level( const Level level ) { level_.store( level, std::memory_order_relaxed ); }
+  static Level level() { return level_.load( std::memory_order_relaxed ); }
+  static bool enabled( const Level level ) { return level <= Log::level(); }
+
+  /* "error", "warning", "info", "debug" or "trace" */
+  static Level level_from_name( const std::string & name );
+
+  /* queue a record for the drain thread (use the LOG macro instead) */
+  template <typename... Args>
+  static void write( const Level level, const char * format, const Args &... args )
+  {
+    static_assert( sizeof...( Args ) <= MAX_ARGUMENTS, "too many arguments to LOG" );
+
+    Record * record = claim();
+    if ( not record ) {
+      return;
+    }
+
+    record->timestamp = now();
+    record->format = format;
+    record->level = level;
+    record->argument_count = sizeof...( Args );
+    record->string_bytes = 0;
+    store_all( *record, 0, args... );
+
+    publish( *record );
+  }
+
+  /* write out everything logged so far (also done at exit) */
+  static void flush();
+
+  /* number of records dropped because the ring was full */
+  static uint64_t dropped();
+};
+
+#endif /* LOG_HH */
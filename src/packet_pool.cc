@@ -0,0 +1,125 @@
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "packet_pool.hh"
+#include "util.hh"
+
+using namespace std;
+
+static_assert( PacketPool::BUFFER_SIZE % PacketPool::CACHE_LINE == 0,
+	       "packet buffers must each start on a cache line" );
+
+/* a cache-aligned block of size bytes from the heap */
+static char * aligned_block( const size_t size )
+{
+  void * block;
+  const int error = posix_memalign( &block, PacketPool::CACHE_LINE, size );
+  if ( error ) {
+    throw unix_error( "posix_memalign", error );
+  }
+  return static_cast<char *>( block );
+}
+
+PacketPool::PacketPool( const size_t count )
+  : storage_( aligned_block( count * BUFFER_SIZE ) ),
+    count_( count ),
+    free_list_( nullptr ),
+    stats_()
+{
+  /* thread every buffer onto the free list, first buffer first out */
+  for ( size_t i = count; i > 0; i-- ) {
+    FreeBuffer * const buffer = reinterpret_cast<FreeBuffer *>( storage_ + (i - 1) * BUFFER_SIZE );
+    buffer->next = free_list_;
+    free_list_ = buffer;
+  }
+}
+
+PacketPool::~PacketPool()
+{
+  free( storage_ );
+}
+
+PacketBuffer PacketPool::acquire()
+{
+  char * data;
+  if ( free_list_ ) {
+    data = reinterpret_cast<char *>( free_list_ );
+    free_list_ = free_list_->next;
+  } else {
+    data = aligned_block( BUFFER_SIZE );
+    stats_.overflows++;
+  }
+
+  stats_.acquired++;
+  stats_.in_use++;
+  if ( stats_.in_use > stats_.high_water ) {
+    stats_.high_water = stats_.in_use;
+  }
+
+  return PacketBuffer( this, data );
+}
+
+void PacketPool::release( char * data )
+{
+  stats_.released++;
+  stats_.in_use--;
+
+  if ( data < storage_ or data >= storage_ + count_ * BUFFER_SIZE ) {
+    /* (it came from the heap) */
+    free( data );
+    return;
+  }
+
+  FreeBuffer * const buffer = reinterpret_cast<FreeBuffer *>( data );
+  buffer->next = free_list_;
+  free_list_ = buffer;
+}
+
+void PacketBuffer::release()
+{
+  if ( data_ ) {
+    pool_->release( data_ );
+    data_ = nullptr;
+    length_ = 0;
+  }
+}
+
+PacketBuffer::PacketBuffer( PacketBuffer && other )
+  : pool_( other.pool_ ), data_( other.data_ ), length_( other.length_ )
+{
+  other.data_ = nullptr;
+  other.length_ = 0;
+}
+
+PacketBuffer & PacketBuffer::operator=( PacketBuffer && other )
+{
+  if ( this != &other ) {
+    release();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    length_ = other.length_;
+    other.data_ = nullptr;
+    other.length_ = 0;
+  }
+  return *this;
+}
+
+size_t PacketBuffer::capacity() const
+{
+  return data_ ? PacketPool::BUFFER_SIZE : 0;
+}
+
+void PacketBuffer::set_length( const size_t length )
+{
+  if ( length > capacity() ) {
+    throw runtime_error( "packet too big for its buffer" );
+  }
+  length_ = length;
+}
+
+void PacketBuffer::assign( const char * data, const size_t length )
+{
+  set_length( length );
+  memcpy( data_, data, length );
+}
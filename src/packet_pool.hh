@@ -0,0 +1,103 @@
+#ifndef PACKET_POOL_HH
+#define PACKET_POOL_HH
+
+#include <cstddef>
+#include <cstdint>
+
+class PacketPool;
+
+/* A packet buffer taken from a PacketPool, and given back when the
+   handle goes away (so it is moved, never copied) */
+class PacketBuffer
+{
+private:
+  PacketPool * pool_;
+  char * data_;
+  size_t length_;
+
+  friend class PacketPool;
+  PacketBuffer( PacketPool * pool, char * data ) : pool_( pool ), data_( data ), length_( 0 ) {}
+
+  void release();
+
+public:
+  /* no buffer */
+  PacketBuffer() : pool_( nullptr ), data_( nullptr ), length_( 0 ) {}
+
+  PacketBuffer( PacketBuffer && other );
+  PacketBuffer & operator=( PacketBuffer && other );
+  ~PacketBuffer() { release(); }
+
+  /* forbid copying */
+  PacketBuffer( const PacketBuffer & other ) = delete;
+  PacketBuffer & operator=( const PacketBuffer & other ) = delete;
+
+  /* the bytes (capacity() of them, of which length() are in use) */
+  char * data() { return data_; }
+  const char * data() const { return data_; }
+  size_t length() const { return length_; }
+  void set_length( const size_t length );
+  size_t capacity() const;
+
+  /* replace the contents with a copy of length bytes */
+  void assign( const char * data, const size_t length );
+
+  bool empty() const { return data_ == nullptr; }
+};
+
+/* A fixed number of packet buffers, allocated together once and each
+   aligned to a cache line, so that datagrams can be received, parsed,
+   built and sent without touching the heap. Free buffers are kept on
+   a list threaded through the buffers themselves, so taking or giving
+   one back is a couple of pointer moves. If every buffer is out, one
+   comes from the heap instead (and goes back there), counted in the
+   stats, so that a pool too small for its load shows up rather than
+   failing. (Not thread-safe: each thread should have its own.) */
+class PacketPool
+{
+public:
+  /* room in each buffer: a contest datagram, or an MTU-sized one */
+  static const size_t BUFFER_SIZE = 2048;
+
+  static const size_t CACHE_LINE = 64;
+
+  struct Stats
+  {
+    uint64_t acquired; /* buffers handed out */
+    uint64_t released; /* buffers given back */
+    uint64_t overflows; /* buffers taken from the heap, the pool being empty */
+    uint64_t in_use; /* out now */
+    uint64_t high_water; /* most out at once */
+  };
+
+private:
+  /* what a free buffer holds */
+  struct FreeBuffer
+  {
+    FreeBuffer * next;
+  };
+
+  char * storage_;
+  size_t count_;
+  FreeBuffer * free_list_;
+  Stats stats_;
+
+  friend class PacketBuffer;
+  void release( char * data );
+
+public:
+  explicit PacketPool( const size_t count );
+  ~PacketPool();
+
+  /* forbid copying (buffers point back to their pool) */
+  PacketPool( const PacketPool & other ) = delete;
+  PacketPool & operator=( const PacketPool & other ) = delete;
+
+  /* take a free buffer (of length 0) */
+  PacketBuffer acquire();
+
+  size_t size() const { return count_; }
+  const Stats & stats() const { return stats_; }
+};
+
+#endif /* PACKET_POOL_HH */
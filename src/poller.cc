@@ -2,16 +2,127 @@
 #include <cassert>
 #include <numeric>
 
+#include <sys/epoll.h>
+
 #include "poller.hh"
+#include "timestamp.hh"
 #include "util.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* the epoll backend passes poll directions straight through */
+static_assert( POLLIN == EPOLLIN and POLLOUT == EPOLLOUT,
+	       "poll and epoll event bits differ" );
+
+/* io_uring user_data: registration index and generation of an armed poll */
+static uint64_t poll_tag( const size_t registration_index, const uint32_t generation )
+{
+  return (uint64_t( registration_index ) << 32) | generation;
+}
+
+/* io_uring user_data of poll removals (whose completions we ignore) */
+static const uint64_t REMOVAL_TAG = uint64_t( -1 );
+
+Poller::Poller( const Backend backend )
+  : backend_( (backend == Backend::IoUring and not IoUring::supported())
+	      ? Backend::Poll : backend ),
+    actions_(),
+    pollfds_(),
+    epoll_fd_( backend_ == Backend::Epoll
+	       ? SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) )
+	       : -1 ),
+    ring_( backend_ == Backend::IoUring ? new IoUring( 64 ) : nullptr ),
+    registrations_(),
+    interested_(),
+    stale_(),
+    conditional_(),
+    interested_registrations_( 0 ),
+    ready_(),
+    timers_( timestamp_us() ),
+    timer_callbacks_(),
+    expired_()
+{}
+
+/* microseconds to a timespec for the system calls that wait
+   (nullptr, meaning forever, if negative) */
+static const timespec * to_timespec( const int64_t timeout_us, timespec & ts )
+{
+  if ( timeout_us < 0 ) {
+    return nullptr;
+  }
+
+  ts.tv_sec = timeout_us / 1000000;
+  ts.tv_nsec = (timeout_us % 1000000) * 1000;
+  return &ts;
+}
+
+/* backend names */
+Poller::Backend Poller::backend_from_name( const string & name )
+{
+  if ( name == "poll" ) {
+    return Backend::Poll;
+  } else if ( name == "epoll" ) {
+    return Backend::Epoll;
+  } else if ( name == "io_uring" ) {
+    return Backend::IoUring;
+  }
+
+  throw runtime_error( "unknown Poller backend: " + name );
+}
+
+string Poller::backend_name( const Backend backend )
+{
+  switch ( backend ) {
+  case Backend::Epoll:
+    return "epoll";
+  case Backend::IoUring:
+    return "io_uring";
+  case Backend::Poll:
+    break;
+  }
+
+  return "poll";
+}
+
 void Poller::add_action( Poller::Action action )
 {
   actions_.push_back( action );
   pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+  interested_.push_back( false );
+
+  if ( backend_ == Backend::Poll ) {
+    return;
+  }
+
+  /* share the registration of an fd that is already known */
+  size_t index = 0;
+  while ( index < registrations_.size() and registrations_[ index ].fd != action.fd.fd_num() ) {
+    index++;
+  }
+
+  if ( index == registrations_.size() ) {
+    /* register a new fd (with no events until someone is interested) */
+    if ( backend_ == Backend::Epoll ) {
+      epoll_event event;
+      zero( event );
+      event.data.u32 = index;
+      SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD,
+					  action.fd.fd_num(), &event ) );
+    }
+
+    registrations_.push_back( { action.fd.fd_num(), 0, 0, 0, false, false, {} } );
+  }
+
+  Registration & registration = registrations_[ index ];
+  registration.actions.push_back( actions_.size() - 1 );
+
+  if ( action.conditional and not registration.conditional ) {
+    registration.conditional = true;
+    conditional_.push_back( index );
+  }
+
+  mark_stale( index );
 }
 
 unsigned int Poller::Action::service_count() const
@@ -19,31 +130,260 @@ unsigned int Poller::Action::service_count() const
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+/* which events (if any) we care about for this action right now */
+short Poller::events_wanted( Action & action ) const
+{
+  /* don't poll in on fds that have had EOF */
+  if ( action.direction == Direction::In and action.fd.eof() ) {
+    return 0;
+  }
+
+  return (action.active and action.when_interested()) ? action.direction : 0;
+}
+
+/* which events (if any) we care about for this fd right now */
+short Poller::events_wanted( Registration & registration )
+{
+  short events = 0;
+  for ( const auto & action_index : registration.actions ) {
+    const short wanted = events_wanted( actions_.at( action_index ) );
+    interested_.at( action_index ) = wanted;
+    events |= wanted;
+  }
+  return events;
+}
+
+/* have the registration looked at again before the next wait
+   (the conditional ones always are) */
+void Poller::mark_stale( const size_t registration_index )
+{
+  Registration & registration = registrations_[ registration_index ];
+  if ( not registration.stale and not registration.conditional ) {
+    registration.stale = true;
+    stale_.push_back( registration_index );
+  }
+}
+
+/* look again only at the registrations whose interest may have changed */
+template <class Apply>
+bool Poller::update_interest( Apply && apply )
+{
+  const auto refresh = [&] ( const size_t index ) {
+    Registration & registration = registrations_[ index ];
+    const short wanted = events_wanted( registration );
+
+    if ( bool( wanted ) != bool( registration.wanted ) ) {
+      if ( wanted ) {
+	interested_registrations_++;
+      } else {
+	interested_registrations_--;
+      }
+    }
+
+    registration.wanted = wanted;
+    registration.stale = false;
+    apply( index, registration );
+  };
+
+  for ( const auto & index : stale_ ) {
+    refresh( index );
+  }
+  stale_.clear();
+
+  for ( const auto & index : conditional_ ) {
+    refresh( index );
+  }
+
+  return interested_registrations_ > 0;
+}
+
+/* call the callbacks of the interested actions that are ready for revents
+   (after which their interest may have changed) */
+bool Poller::service_ready( const size_t registration_index, const short revents, Result & result )
+{
+  mark_stale( registration_index );
+
+  const Registration & registration = registrations_[ registration_index ];
+  for ( const auto & action_index : registration.actions ) {
+    /* we only want to call callback if the fd is ready
+       in the direction this action asked for */
+    if ( interested_.at( action_index )
+	 and (revents & actions_.at( action_index ).direction) ) {
+      if ( not service( action_index, result ) ) {
+	return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* run one action's callback and interpret its result
+   (returns false if the Poller should stop with the given result) */
+bool Poller::service( const size_t action_index, Result & result )
+{
+  Action & action = actions_.at( action_index );
+
+  const auto count_before = action.service_count();
+  auto callback_result = action.callback();
+
+  if ( count_before == action.service_count() ) {
+    throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+  }
+
+  switch ( callback_result.result ) {
+  case ResultType::Exit:
+    result = Result( Result::Type::Exit, callback_result.exit_status );
+    return false;
+  case ResultType::Cancel:
+    action.active = false;
+  case ResultType::Continue:
+    break;
+  }
+
+  return true;
+}
+
+Poller::TimerId Poller::add_timer( const uint64_t deadline_us,
+				   const Action::CallbackType & callback )
+{
+  const TimerId id = timers_.add( deadline_us );
+  const uint32_t index = id;
+
+  if ( index >= timer_callbacks_.size() ) {
+    timer_callbacks_.resize( index + 1 );
+  }
+  timer_callbacks_[ index ] = callback;
+
+  return id;
+}
+
+void Poller::rearm_timer( const TimerId id, const uint64_t deadline_us )
+{
+  timers_.rearm( id, deadline_us );
+}
+
+void Poller::cancel_timer( const TimerId id )
+{
+  /* (the callback itself stays until the slot is reused,
+     since this may be called from that very callback) */
+  timers_.cancel( id );
+}
+
+/* run the callbacks of expired timers */
+void Poller::service_timers( Result & result )
+{
+  if ( timers_.empty() ) {
+    return;
+  }
+
+  expired_.clear();
+  timers_.advance( timestamp_us(), expired_ );
+
+  for ( size_t i = 0; i < expired_.size(); i++ ) {
+    const TimerId id = expired_[ i ];
+
+    /* an earlier callback may have cancelled or rearmed this timer */
+    if ( not timers_.valid( id ) or timers_.pending( id ) ) {
+      continue;
+    }
+
+    /* run the callback from a local, so it survives the timer being
+       cancelled and its slot reused by a new timer meanwhile */
+    const uint32_t index = id;
+    Action::CallbackType callback = move( timer_callbacks_[ index ] );
+    const auto callback_result = callback();
+    result = Result::Type::Success;
+
+    if ( timers_.valid( id ) ) {
+      timer_callbacks_[ index ] = move( callback );
+
+      if ( callback_result.result == ResultType::Cancel or not timers_.pending( id ) ) {
+	cancel_timer( id );
+      }
+    }
+
+    if ( callback_result.result == ResultType::Exit ) {
+      result = Result( Result::Type::Exit, callback_result.exit_status );
+
+      /* release the expired timers whose callbacks won't run */
+      for ( i++; i < expired_.size(); i++ ) {
+	if ( timers_.valid( expired_[ i ] ) and not timers_.pending( expired_[ i ] ) ) {
+	  cancel_timer( expired_[ i ] );
+	}
+      }
+      return;
+    }
+  }
+}
+
 Poller::Result Poller::poll( const int & timeout_ms )
+{
+  int64_t timeout_us = timeout_ms < 0 ? -1 : int64_t( timeout_ms ) * 1000;
+
+  /* wake up in time for the next timer */
+  bool timer_due = false;
+  if ( not timers_.empty() ) {
+    const uint64_t next = timers_.next_expiry();
+    const uint64_t now = timestamp_us();
+    const int64_t until_next = next > now ? next - now : 0;
+
+    if ( timeout_us < 0 or until_next <= timeout_us ) {
+      timeout_us = until_next;
+      timer_due = true;
+    }
+  }
+
+  Result result = Result::Type::Success;
+
+  switch ( backend_ ) {
+  case Backend::Epoll:
+    result = poll_epoll( timeout_us );
+    break;
+  case Backend::IoUring:
+    result = poll_io_uring( timeout_us );
+    break;
+  case Backend::Poll:
+    result = poll_poll( timeout_us );
+    break;
+  }
+
+  if ( result.result == Result::Type::Exit ) {
+    return result;
+  }
+
+  /* waking for a timer isn't a timeout, even if it was early */
+  if ( result.result == Result::Type::Timeout and timer_due ) {
+    result = Result::Type::Success;
+  }
+
+  service_timers( result );
+
+  return result;
+}
+
+Poller::Result Poller::poll_poll( const int64_t timeout_us )
 {
   assert( pollfds_.size() == actions_.size() );
 
   /* tell poll whether we care about each fd */
   for ( unsigned int i = 0; i < actions_.size(); i++ ) {
     assert( pollfds_.at( i ).fd == actions_.at( i ).fd.fd_num() );
-    pollfds_.at( i ).events = (actions_.at( i ).active and actions_.at( i ).when_interested())
-      ? actions_.at( i ).direction : 0;
-
-    /* don't poll in on fds that have had EOF */
-    if ( actions_.at( i ).direction == Direction::In
-	 and actions_.at( i ).fd.eof() ) {
-      pollfds_.at( i ).events = 0;
-    }
+    pollfds_.at( i ).events = events_wanted( actions_.at( i ) );
   }
 
-  /* Quit if no member in pollfds_ has a non-zero direction */
-  if ( not accumulate( pollfds_.begin(), pollfds_.end(), false,
-		       [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
+  /* Quit if no member in pollfds_ has a non-zero direction
+     (and no timer is pending) */
+  if ( timers_.empty()
+       and not accumulate( pollfds_.begin(), pollfds_.end(), false,
+			   [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
     return Result::Type::Exit;
   }
 
   try {
-    if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
+    timespec ts;
+    if ( 0 == SystemCall( "ppoll", ::ppoll( pollfds_.data(), pollfds_.size(),
+					    to_timespec( timeout_us, ts ), nullptr ) ) ) {
       return Result::Type::Timeout;
     }
   } catch ( unix_error const& e ) {
@@ -60,21 +400,171 @@ Poller::Result Poller::poll( const int & timeout_ms )
     if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
       /* we only want to call callback if revents includes
 	 the event we asked for */
-      const auto count_before = actions_.at( i ).service_count();
-      auto result = actions_.at( i ).callback();
+      Result result = Result::Type::Success;
+      if ( not service( i, result ) ) {
+	return result;
+      }
+    }
+  }
+
+  return Result::Type::Success;
+}
+
+/* epoll_pwait2() (Linux 5.11) takes a timeout finer than a millisecond */
+static int epoll_wait_us( const int epoll_fd, epoll_event * events,
+			  const int max_events, const int64_t timeout_us )
+{
+  static bool have_epoll_pwait2 = true;
+
+  if ( have_epoll_pwait2 ) {
+    timespec ts;
+    const int ret = epoll_pwait2( epoll_fd, events, max_events,
+				  to_timespec( timeout_us, ts ), nullptr );
+    if ( ret >= 0 or errno != ENOSYS ) {
+      return ret;
+    }
+    have_epoll_pwait2 = false;
+  }
+
+  /* round up, so as not to wake before a timer is due */
+  return epoll_wait( epoll_fd, events, max_events,
+		     timeout_us < 0 ? -1 : (timeout_us + 999) / 1000 );
+}
+
+Poller::Result Poller::poll_epoll( const int64_t timeout_us )
+{
+  /* update an fd's registration only if the interest in it changed */
+  const bool any_interest = update_interest( [&] ( const size_t index, Registration & registration ) {
+      if ( registration.wanted != registration.events ) {
+	epoll_event event;
+	zero( event );
+	event.events = registration.wanted;
+	event.data.u32 = index;
+	SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_MOD,
+					    registration.fd, &event ) );
+	registration.events = registration.wanted;
+      }
+    } );
+
+  /* Quit if nobody is interested in anything (and no timer is pending) */
+  if ( not any_interest and timers_.empty() ) {
+    return Result::Type::Exit;
+  }
+
+  epoll_event ready[ 64 ];
+  int ready_count = 0;
+
+  try {
+    ready_count = SystemCall( "epoll_wait",
+			      epoll_wait_us( epoll_fd_.fd_num(), ready,
+					     max( size_t( 1 ), min( registrations_.size(),
+								    sizeof( ready ) / sizeof( ready[ 0 ] ) ) ),
+					     timeout_us ) );
+    if ( ready_count == 0 ) {
+      return Result::Type::Timeout;
+    }
+  } catch ( unix_error const& e ) {
+    if ( e.code().value() == EINTR ) {
+      return Result::Type::Exit;
+    }
+    throw;
+  }
+
+  /* only visit the fds that are actually ready */
+  for ( int i = 0; i < ready_count; i++ ) {
+    if ( ready[ i ].events & (EPOLLERR | EPOLLHUP) ) {
+      return Result::Type::Exit;
+    }
+
+    Result result = Result::Type::Success;
+    if ( not service_ready( ready[ i ].data.u32, ready[ i ].events, result ) ) {
+      return result;
+    }
+  }
+
+  return Result::Type::Success;
+}
+
+Poller::Result Poller::poll_io_uring( const int64_t timeout_us )
+{
+  /* (re-)arm a one-shot poll for each fd we care about, and
+     cancel the armed poll of an fd whose interest changed (an fd
+     whose poll completed is stale, so is looked at again here) */
+  const bool any_interest = update_interest( [&] ( const size_t index, Registration & registration ) {
+      if ( registration.wanted != registration.events ) {
+	if ( registration.events ) {
+	  io_uring_sqe & removal = ring_->next_sqe();
+	  removal.opcode = IORING_OP_POLL_REMOVE;
+	  removal.fd = -1;
+	  removal.addr = poll_tag( index, registration.generation );
+	  removal.user_data = REMOVAL_TAG;
+	}
+
+	registration.generation++;
+	registration.events = 0;
 
-      if ( count_before == actions_.at( i ).service_count() ) {
-	throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+	if ( registration.wanted ) {
+	  io_uring_sqe & poll = ring_->next_sqe();
+	  poll.opcode = IORING_OP_POLL_ADD;
+	  poll.fd = registration.fd;
+	  poll.poll32_events = registration.wanted;
+	  poll.user_data = poll_tag( index, registration.generation );
+	  registration.events = registration.wanted;
+	}
       }
+    } );
 
-      switch ( result.result ) {
-      case ResultType::Exit:
-	return Result( Result::Type::Exit, result.exit_status );
-      case ResultType::Cancel:
-	actions_.at( i ).active = false;
-      case ResultType::Continue:
-	break;
+  /* Quit if nobody is interested in anything (and no timer is pending) */
+  if ( not any_interest and timers_.empty() ) {
+    return Result::Type::Exit;
+  }
+
+  /* submit the new polls and wait, all with one system call */
+  try {
+    if ( not ring_->submit_and_wait( 1, timeout_us ) ) {
+      return Result::Type::Timeout;
+    }
+  } catch ( unix_error const& e ) {
+    if ( e.code().value() == EINTR ) {
+      return Result::Type::Exit;
+    }
+    throw;
+  }
+
+  ready_.clear();
+  ring_->reap( [&] ( const io_uring_cqe & cqe ) {
+      if ( cqe.user_data == REMOVAL_TAG ) {
+	return;
       }
+
+      const size_t registration_index = cqe.user_data >> 32;
+      Registration & registration = registrations_.at( registration_index );
+
+      /* ignore completions of polls we have since cancelled */
+      if ( uint32_t( cqe.user_data ) != registration.generation ) {
+	return;
+      }
+
+      /* the poll was one-shot, so it will need re-arming */
+      registration.events = 0;
+      mark_stale( registration_index );
+
+      if ( cqe.res < 0 ) {
+	throw unix_error( "io_uring poll", -cqe.res );
+      }
+
+      ready_.emplace_back( registration_index, cqe.res );
+    } );
+
+  /* only visit the fds that are actually ready */
+  for ( const auto & ready : ready_ ) {
+    if ( ready.second & (POLLERR | POLLHUP | POLLNVAL) ) {
+      return Result::Type::Exit;
+    }
+
+    Result result = Result::Type::Success;
+    if ( not service_ready( ready.first, ready.second, result ) ) {
+      return result;
     }
   }
 
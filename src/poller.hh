@@ -2,11 +2,15 @@
 #define POLLER_HH
 
 #include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <poll.h>
 
 #include "file_descriptor.hh"
+#include "io_uring.hh"
+#include "timer_wheel.hh"
 
 class Poller
 {
@@ -29,21 +33,31 @@ public:
     std::function<bool(void)> when_interested;
     bool active;
 
+    /* whether interest hangs on when_interested(), which is then asked
+       before every wait (the interest of other actions only changes
+       when they run, or are cancelled, or their fd reaches EOF) */
+    bool conditional;
+
+    Action( FileDescriptor & s_fd,
+	    const PollDirection & s_direction,
+	    const CallbackType & s_callback )
+      : fd( s_fd ), direction( s_direction ), callback( s_callback ),
+	when_interested( [] () { return true; } ), active( true ), conditional( false ) {}
+
     Action( FileDescriptor & s_fd,
 	    const PollDirection & s_direction,
 	    const CallbackType & s_callback,
-	    const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+	    const std::function<bool(void)> & s_when_interested )
       : fd( s_fd ), direction( s_direction ), callback( s_callback ),
-	when_interested( s_when_interested ), active( true ) {}
+	when_interested( s_when_interested ), active( true ), conditional( true ) {}
 
     unsigned int service_count() const;
   };
 
-private:
-  std::vector< Action > actions_;
-  std::vector< pollfd > pollfds_;
+  /* how the Poller waits for events
+     (IoUring falls back to Poll if the kernel can't do it) */
+  enum class Backend { Poll, Epoll, IoUring };
 
-public:
   struct Result
   {
     enum class Type { Success, Timeout, Exit } result;
@@ -52,8 +66,102 @@ public:
       : result( s_result ), exit_status( s_status ) {}
   };
 
-  Poller() : actions_(), pollfds_() {}
+private:
+  Backend backend_;
+
+  std::vector< Action > actions_;
+
+  /* poll backend: rebuilt on every call */
+  std::vector< pollfd > pollfds_;
+
+  /* epoll and io_uring backends: each fd is registered once (even if
+     several actions share it), and its events are only changed
+     when the actions' interest in it changes */
+  struct Registration
+  {
+    int fd;
+    short events; /* registered with epoll, or armed as an io_uring poll */
+    short wanted; /* what the actions last wanted */
+    uint32_t generation; /* io_uring: tells stale poll completions apart */
+    bool conditional; /* has a conditional action, so is looked at before every wait */
+    bool stale; /* an action ran since it was last looked at */
+    std::vector< size_t > actions;
+  };
+
+  FileDescriptor epoll_fd_;
+  std::unique_ptr< IoUring > ring_;
+  std::vector< Registration > registrations_;
+  std::vector< bool > interested_;
+
+  /* the registrations to look at before the next wait */
+  std::vector< size_t > stale_;
+  std::vector< size_t > conditional_;
+
+  /* how many registrations some action wants events from */
+  size_t interested_registrations_;
+
+  /* io_uring backend: completed polls, as (registration, revents) */
+  std::vector< std::pair< size_t, short > > ready_;
+
+  /* timers (in microseconds), with callbacks indexed by the low 32 bits of the timer id */
+  TimerWheel timers_;
+  std::vector< Action::CallbackType > timer_callbacks_;
+  std::vector< TimerWheel::TimerId > expired_;
+
+  /* which events (if any) we care about for this action right now */
+  short events_wanted( Action & action ) const;
+
+  /* which events (if any) we care about for this fd right now */
+  short events_wanted( Registration & registration );
+
+  /* have the registration looked at again before the next wait */
+  void mark_stale( const size_t registration_index );
+
+  /* look again at the stale and conditional registrations, and call
+     apply( index, registration ) to bring the backend's events for
+     each in line with registration.wanted; returns whether any
+     registration is wanted at all */
+  template <class Apply>
+  bool update_interest( Apply && apply );
+
+  /* call the callbacks of the interested actions that are ready for revents */
+  bool service_ready( const size_t registration_index, const short revents, Result & result );
+
+  /* run one action's callback and interpret its result */
+  bool service( const size_t action_index, Result & result );
+
+  /* run the callbacks of expired timers (setting result
+     to Success if any ran, or to Exit if one asked to) */
+  void service_timers( Result & result );
+
+  /* wait up to timeout_us (forever if negative), then service ready fds */
+  Result poll_poll( const int64_t timeout_us );
+  Result poll_epoll( const int64_t timeout_us );
+  Result poll_io_uring( const int64_t timeout_us );
+
+public:
+  Poller( const Backend backend = Backend::Poll );
+
+  /* the backend actually in use */
+  Backend backend() const { return backend_; }
+
+  /* backend names ("poll", "epoll" and "io_uring") */
+  static Backend backend_from_name( const std::string & name );
+  static std::string backend_name( const Backend backend );
   void add_action( Action action );
+
+  /* one-shot timers on the microsecond clock of timestamp_us():
+     a timer's callback runs once its deadline has passed, and the timer is
+     then released unless the callback rearmed it (a Cancel result
+     releases it regardless, and Exit makes poll() return Exit) */
+  typedef TimerWheel::TimerId TimerId;
+  TimerId add_timer( const uint64_t deadline_us, const Action::CallbackType & callback );
+  void rearm_timer( const TimerId id, const uint64_t deadline_us );
+  void cancel_timer( const TimerId id );
+  bool timer_pending( const TimerId id ) const { return timers_.pending( id ); }
+
+  /* wait (up to timeout_ms, or until the next timer is due) and service
+     ready fds and expired timers; Timeout means neither happened */
   Result poll( const int & timeout_ms );
 };
 
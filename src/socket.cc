@@ -1,4 +1,8 @@
 #include <sys/socket.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+
+#include <algorithm>
 
 #include "socket.hh"
 #include "util.hh"
@@ -75,67 +79,300 @@ void Socket::connect( const Address & address )
 				    address.size() ) );
 }
 
-/* receive datagram and where it came from */
-UDPSocket::received_datagram UDPSocket::recv()
+/* did we get the whole datagram? (if not, it is counted, to be dropped) */
+bool UDPSocket::received_whole( const msghdr & header )
+{
+  if ( header.msg_flags & MSG_TRUNC ) {
+    truncated_++;
+    return false;
+  } else if ( header.msg_flags & MSG_CTRUNC ) {
+    throw runtime_error( "recvfrom (ancillary data truncated)" );
+  } else if ( header.msg_flags ) {
+    throw runtime_error( "recvfrom (unhandled flag)" );
+  }
+
+  return true;
+}
+
+/* what the ancillary data says about a received payload */
+struct received_control
 {
-  static const ssize_t RECEIVE_MTU = 65536;
+  uint64_t timestamp; /* in microseconds (-1 if there is none) */
+  size_t segment_size; /* of the datagrams GRO coalesced into it (0 if none) */
+};
 
-  /* receive source address, timestamp and payload */
-  Address::raw datagram_source_address;
-  msghdr header; zero( header );
-  iovec msg_iovec; zero( msg_iovec );
+/* find the timestamp (put on our clock with realtime_offset, from
+   realtime_offset_ns()) and GRO headers (if there are any) */
+static received_control parse_control( msghdr & header, const uint64_t realtime_offset )
+{
+  received_control control = { uint64_t( -1 ), 0 };
+
+  cmsghdr *control_hdr = CMSG_FIRSTHDR( &header );
+  while ( control_hdr ) {
+    if ( control_hdr->cmsg_level == SOL_SOCKET
+	 and control_hdr->cmsg_type == SO_TIMESTAMPNS ) {
+      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( control_hdr ) );
+      control.timestamp = timestamp_ns( *kernel_time, realtime_offset ) / 1000;
+    } else if ( control_hdr->cmsg_level == SOL_UDP
+		and control_hdr->cmsg_type == UDP_GRO ) {
+      control.segment_size = *reinterpret_cast<int *>( CMSG_DATA( control_hdr ) );
+    }
+    control_hdr = CMSG_NXTHDR( &header, control_hdr );
+  }
 
-  char msg_payload[ RECEIVE_MTU ];
-  char msg_control[ RECEIVE_MTU ];
+  return control;
+}
 
-  /* prepare to get the source address */
-  header.msg_name = &datagram_source_address;
-  header.msg_namelen = sizeof( datagram_source_address );
+/* longest GRO holds on to a datagram before passing up what it has
+   coalesced: a NAPI poll's time budget (net.core.netdev_budget_usecs),
+   in microseconds */
+static const uint64_t GRO_MAX_HOLD = 2000;
+
+/* hand a received payload to deliver( timestamp, payload, length ): as
+   it is, or split back into the datagrams GRO coalesced (given their
+   size, or 0 if it didn't), each with an estimate of when it arrived */
+template <class Deliver>
+static void split_received( const uint64_t timestamp,
+			    const char * payload, const size_t length,
+			    const size_t segment_size, Deliver && deliver )
+{
+  if ( segment_size == 0 or length <= segment_size ) {
+    deliver( timestamp, payload, length );
+    return;
+  }
 
-  /* prepare to get the payload */
-  msg_iovec.iov_base = msg_payload;
-  msg_iovec.iov_len = sizeof( msg_payload );
-  header.msg_iov = &msg_iovec;
-  header.msg_iovlen = 1;
+  /* the kernel stamped the buffer with its first datagram's arrival;
+     the last arrived before GRO passed the buffer up, so by now and
+     within GRO_MAX_HOLD, and the rest are taken as evenly spaced */
+  const size_t count = (length + segment_size - 1) / segment_size;
+  uint64_t spread = 0;
+  if ( timestamp != uint64_t( -1 ) ) {
+    const uint64_t last = min( timestamp_us(), timestamp + GRO_MAX_HOLD );
+    spread = last > timestamp ? last - timestamp : 0;
+  }
 
-  /* prepare to get the timestamp */
-  header.msg_control = msg_control;
-  header.msg_controllen = sizeof( msg_control );
+  for ( size_t i = 0; i < count; i++ ) {
+    const size_t offset = i * segment_size;
+    deliver( timestamp == uint64_t( -1 ) ? timestamp : timestamp + spread * i / (count - 1),
+	     payload + offset, min( segment_size, length - offset ) );
+  }
+}
+
+/* receive into the first max_n entries of batch_iovecs_ */
+size_t UDPSocket::receive_prepared( const size_t max_n )
+{
+  /* prepare to get the source address, payload and timestamp of each datagram */
+  for ( size_t i = 0; i < max_n; i++ ) {
+    msghdr & header = batch_headers_[ i ].msg_hdr;
+    zero( batch_headers_[ i ] );
 
-  /* call recvmsg */
-  ssize_t recv_len = SystemCall( "recvmsg",
-				 recvmsg( fd_num(), &header, 0 ) );
+    header.msg_name = &batch_addresses_[ i ];
+    header.msg_namelen = sizeof( batch_addresses_[ i ] );
+
+    header.msg_iov = &batch_iovecs_[ i ];
+    header.msg_iovlen = 1;
+
+    header.msg_control = &batch_controls_[ i * CONTROL_SIZE ];
+    header.msg_controllen = CONTROL_SIZE;
+  }
+
+  /* call recvmmsg (waiting only for the first datagram) */
+  const int count = SystemCall( "recvmmsg",
+				recvmmsg( fd_num(), &batch_headers_[ 0 ], max_n,
+					  MSG_WAITFORONE, nullptr ) );
 
   register_read();
 
-  /* make sure we got the whole datagram */
-  if ( header.msg_flags & MSG_TRUNC ) {
-    throw runtime_error( "recvfrom (oversized datagram)" );
-  } else if ( header.msg_flags ) {
-    throw runtime_error( "recvfrom (unhandled flag)" );
+  /* (one reading of the clocks puts the whole batch's timestamps on ours) */
+  realtime_offset_ = realtime_offset_ns();
+
+  return count;
+}
+
+/* grow the scratch space if this batch is bigger than any before
+   (with room for the payloads only if they are received there) */
+void UDPSocket::reserve_batch( const size_t max_n, const bool payloads )
+{
+  if ( payloads and batch_payloads_.size() < max_n * receive_size() ) {
+    batch_payloads_.resize( max_n * receive_size() );
   }
 
-  uint64_t timestamp = -1;
+  if ( batch_headers_.size() < max_n ) {
+    batch_controls_.resize( max_n * CONTROL_SIZE );
+    batch_addresses_.resize( max_n );
+    batch_iovecs_.resize( max_n );
+    batch_headers_.resize( max_n );
+  }
+}
+
+/* point the first max_n entries of batch_iovecs_ at the scratch payloads */
+void UDPSocket::prepare_scratch_payloads( const size_t max_n )
+{
+  reserve_batch( max_n, true );
+  for ( size_t i = 0; i < max_n; i++ ) {
+    batch_iovecs_[ i ].iov_base = &batch_payloads_[ i * receive_size() ];
+    batch_iovecs_[ i ].iov_len = receive_size();
+  }
+}
 
-  /* find the timestamp header (if there is one) */
-  cmsghdr *ts_hdr = CMSG_FIRSTHDR( &header );
-  while ( ts_hdr ) {
-    if ( ts_hdr->cmsg_level == SOL_SOCKET
-	 and ts_hdr->cmsg_type == SO_TIMESTAMPNS ) {
-      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( ts_hdr ) );
-      timestamp = timestamp_ms( *kernel_time );
+/* receive datagram and where it came from */
+UDPSocket::received_datagram UDPSocket::recv()
+{
+  if ( gro_ ) {
+    throw runtime_error( "recv: a GRO socket can only receive with recv_batch" );
+  }
+
+  /* receive source address, timestamp and payload
+     (dropping any datagram too big to receive whole) */
+  prepare_scratch_payloads( 1 );
+  do {
+    receive_prepared( 1 );
+  } while ( not received_whole( batch_headers_[ 0 ].msg_hdr ) );
+
+  msghdr & header = batch_headers_[ 0 ].msg_hdr;
+  return { Address( batch_addresses_[ 0 ], header.msg_namelen ),
+	   parse_control( header, realtime_offset_ ).timestamp,
+	   string( &batch_payloads_[ 0 ], batch_headers_[ 0 ].msg_len ) };
+}
+
+/* receive up to max_n datagrams with one system call */
+vector<UDPSocket::received_datagram> UDPSocket::recv_batch( const size_t max_n )
+{
+  if ( max_n == 0 ) {
+    throw runtime_error( "recv_batch: batch size must be positive" );
+  }
+
+  vector<received_datagram> ret;
+
+  if ( recv_ring_ ) {
+    /* collect completed receives, waiting for one if there are none */
+    const auto deliver = [&] ( const Address & source_address, const uint64_t timestamp,
+			       const char * payload, const size_t length ) {
+      ret.push_back( { source_address, timestamp, string( payload, length ) } );
+    };
+    ring_receive( max_n, deliver );
+    while ( ret.empty() ) {
+      recv_ring_->submit_and_wait( 1 );
+      ring_receive( max_n, deliver );
     }
-    ts_hdr = CMSG_NXTHDR( &header, ts_hdr );
+
+    register_read();
+
+    return ret;
   }
 
-  received_datagram ret = { Address( datagram_source_address,
-				     header.msg_namelen ),
-			    timestamp,
-			    string( msg_payload, recv_len ) };
+  prepare_scratch_payloads( max_n );
+  const size_t count = receive_prepared( max_n );
+
+  ret.reserve( count );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    msghdr & header = batch_headers_[ i ].msg_hdr;
+    if ( not received_whole( header ) ) {
+      continue;
+    }
+
+    const Address source_address( batch_addresses_[ i ], header.msg_namelen );
+    const received_control control = parse_control( header, realtime_offset_ );
+
+    split_received( control.timestamp, &batch_payloads_[ i * receive_size() ],
+		    batch_headers_[ i ].msg_len, control.segment_size,
+		    [&] ( const uint64_t timestamp, const char * payload, const size_t length ) {
+		      ret.push_back( { source_address, timestamp, string( payload, length ) } );
+		    } );
+  }
 
   return ret;
 }
 
+/* receive up to max_n datagrams with one system call, into pooled buffers */
+void UDPSocket::recv_batch( const size_t max_n, PacketPool & pool, vector<received_packet> & packets )
+{
+  if ( max_n == 0 ) {
+    throw runtime_error( "recv_batch: batch size must be positive" );
+  }
+
+  packets.clear();
+
+  /* copy each datagram that isn't received straight into its buffer
+     (dropping any too big for one, as if it had been truncated) */
+  const auto deliver = [&] ( const Address & source_address, const uint64_t timestamp,
+			     const char * payload, const size_t length ) {
+    if ( length > PacketPool::BUFFER_SIZE ) {
+      truncated_++;
+      return;
+    }
+    packets.push_back( { source_address, timestamp, pool.acquire() } );
+    packets.back().buffer.assign( payload, length );
+  };
+
+  if ( recv_ring_ ) {
+    /* collect completed receives, waiting for one if there are none */
+    ring_receive( max_n, deliver );
+    while ( packets.empty() ) {
+      recv_ring_->submit_and_wait( 1 );
+      ring_receive( max_n, deliver );
+    }
+
+    register_read();
+    return;
+  }
+
+  if ( gro_ ) {
+    /* receive into the scratch space, then split each payload up */
+    prepare_scratch_payloads( max_n );
+    const size_t count = receive_prepared( max_n );
+
+    for ( size_t i = 0; i < count; i++ ) {
+      msghdr & header = batch_headers_[ i ].msg_hdr;
+      if ( not received_whole( header ) ) {
+	continue;
+      }
+
+      const Address source_address( batch_addresses_[ i ], header.msg_namelen );
+      const received_control control = parse_control( header, realtime_offset_ );
+
+      split_received( control.timestamp, &batch_payloads_[ i * receive_size() ],
+		      batch_headers_[ i ].msg_len, control.segment_size,
+		      [&] ( const uint64_t timestamp, const char * payload, const size_t length ) {
+			deliver( source_address, timestamp, payload, length );
+		      } );
+    }
+    return;
+  }
+
+  /* receive each datagram straight into a buffer of its own */
+  reserve_batch( max_n, false );
+  for ( size_t i = 0; i < max_n; i++ ) {
+    packets.push_back( { Address(), 0, pool.acquire() } );
+    batch_iovecs_[ i ].iov_base = packets[ i ].buffer.data();
+    batch_iovecs_[ i ].iov_len = packets[ i ].buffer.capacity();
+  }
+
+  const size_t count = receive_prepared( max_n );
+
+  /* keep the whole datagrams at the front, in order */
+  size_t kept = 0;
+  for ( size_t i = 0; i < count; i++ ) {
+    msghdr & header = batch_headers_[ i ].msg_hdr;
+    if ( not received_whole( header ) ) {
+      continue;
+    }
+
+    received_packet & packet = packets[ kept ];
+    if ( kept != i ) {
+      packet.buffer = move( packets[ i ].buffer );
+    }
+    packet.source_address = Address( batch_addresses_[ i ], header.msg_namelen );
+    packet.timestamp = parse_control( header, realtime_offset_ ).timestamp;
+    packet.buffer.set_length( batch_headers_[ i ].msg_len );
+    kept++;
+  }
+
+  /* (the buffers left over go back to the pool) */
+  packets.erase( packets.begin() + kept, packets.end() );
+}
+
 /* send datagram to specified address */
 void UDPSocket::sendto( const Address & destination, const string & payload )
 {
@@ -170,6 +407,166 @@ void UDPSocket::send( const string & payload )
   }
 }
 
+/* total length of an outgoing datagram */
+static size_t datagram_length( const msghdr & header )
+{
+  size_t length = 0;
+  for ( size_t j = 0; j < header.msg_iovlen; j++ ) {
+    length += header.msg_iov[ j ].iov_len;
+  }
+  return length;
+}
+
+/* send the first count prepared entries of send_headers_ */
+void UDPSocket::send_prepared( const size_t count )
+{
+  if ( send_ring_ ) {
+    /* submit every datagram as a SQE, then wait for them all */
+    for ( size_t i = 0; i < count; i++ ) {
+      io_uring_sqe & sqe = send_ring_->next_sqe();
+      sqe.opcode = IORING_OP_SENDMSG;
+      sqe.fd = fd_num();
+      sqe.addr = reinterpret_cast<uint64_t>( &send_headers_[ i ].msg_hdr );
+      sqe.len = 1;
+      sqe.user_data = i;
+    }
+
+    size_t completed = 0;
+    while ( completed < count ) {
+      send_ring_->submit_and_wait( 1 );
+      completed += send_ring_->reap( [&] ( const io_uring_cqe & cqe ) {
+	  if ( cqe.res < 0 ) {
+	    throw unix_error( "io_uring sendmsg", -cqe.res );
+	  } else if ( size_t( cqe.res ) != datagram_length( send_headers_.at( cqe.user_data ).msg_hdr ) ) {
+	    throw runtime_error( "datagram payload too big for io_uring sendmsg" );
+	  }
+	} );
+    }
+
+    register_write();
+    return;
+  }
+
+  /* sendmmsg may stop early, so keep going until everything is out */
+  size_t sent = 0;
+  while ( sent < count ) {
+    const int batch = SystemCall( "sendmmsg",
+				  sendmmsg( fd_num(), &send_headers_[ sent ],
+					    count - sent, 0 ) );
+
+    register_write();
+
+    for ( int i = 0; i < batch; i++ ) {
+      if ( send_headers_[ sent + i ].msg_len != datagram_length( send_headers_[ sent + i ].msg_hdr ) ) {
+	throw runtime_error( "datagram payload too big for sendmmsg()" );
+      }
+    }
+
+    sent += batch;
+  }
+}
+
+/* send several datagrams to connected address with one system call */
+void UDPSocket::send_batch( const vector<string> & payloads )
+{
+  if ( send_headers_.size() < payloads.size() ) {
+    send_iovecs_.resize( 2 * payloads.size() );
+    send_headers_.resize( payloads.size() );
+  }
+
+  for ( size_t i = 0; i < payloads.size(); i++ ) {
+    zero( send_headers_[ i ] );
+    send_iovecs_[ i ].iov_base = const_cast<char *>( payloads[ i ].data() );
+    send_iovecs_[ i ].iov_len = payloads[ i ].size();
+    send_headers_[ i ].msg_hdr.msg_iov = &send_iovecs_[ i ];
+    send_headers_[ i ].msg_hdr.msg_iovlen = 1;
+  }
+
+  send_prepared( payloads.size() );
+}
+
+/* are two outgoing datagrams for the same place? */
+static bool same_destination( const UDPSocket::gathered_datagram & a,
+			      const UDPSocket::gathered_datagram & b )
+{
+  if ( a.destination == b.destination ) {
+    return true;
+  }
+  return a.destination and b.destination and *a.destination == *b.destination;
+}
+
+/* room for the ancillary data (GSO segment size) of one send */
+static const size_t SEND_CONTROL_SIZE = CMSG_SPACE( sizeof( uint16_t ) );
+
+void UDPSocket::send_batch( const vector<gathered_datagram> & datagrams )
+{
+  if ( send_headers_.size() < datagrams.size() ) {
+    send_iovecs_.resize( 2 * datagrams.size() );
+    send_headers_.resize( datagrams.size() );
+    send_controls_.resize( datagrams.size() * SEND_CONTROL_SIZE );
+  }
+
+  for ( size_t i = 0; i < datagrams.size(); i++ ) {
+    iovec * const parts = &send_iovecs_[ 2 * i ];
+    parts[ 0 ].iov_base = const_cast<char *>( datagrams[ i ].header );
+    parts[ 0 ].iov_len = datagrams[ i ].header_length;
+    parts[ 1 ].iov_base = const_cast<char *>( datagrams[ i ].body );
+    parts[ 1 ].iov_len = datagrams[ i ].body_length;
+  }
+
+  /* each send is a datagram, or (with GSO) a run of them, whose
+     iovecs are already next to each other in send_iovecs_ */
+  size_t count = 0;
+  for ( size_t first = 0; first < datagrams.size(); count++ ) {
+    const size_t segment_size = datagrams[ first ].header_length + datagrams[ first ].body_length;
+
+    size_t end = first + 1;
+    if ( gso_ and segment_size > 0 ) {
+      size_t total = segment_size, last_size = segment_size;
+      while ( end < datagrams.size()
+	      and end - first < MAX_GSO_SEGMENTS
+	      and last_size == segment_size
+	      and same_destination( datagrams[ first ], datagrams[ end ] ) ) {
+	const size_t size = datagrams[ end ].header_length + datagrams[ end ].body_length;
+	if ( size == 0 or size > segment_size or total + size > MAX_GSO_BYTES ) {
+	  break;
+	}
+	total += size;
+	last_size = size;
+	end++;
+      }
+    }
+
+    msghdr & header = send_headers_[ count ].msg_hdr;
+    zero( send_headers_[ count ] );
+    header.msg_iov = &send_iovecs_[ 2 * first ];
+    header.msg_iovlen = 2 * (end - first);
+
+    if ( datagrams[ first ].destination ) {
+      header.msg_name = const_cast<sockaddr *>( &datagrams[ first ].destination->to_sockaddr() );
+      header.msg_namelen = datagrams[ first ].destination->size();
+    }
+
+    /* tell the kernel where to split a run */
+    if ( end - first > 1 ) {
+      char * const control = &send_controls_[ count * SEND_CONTROL_SIZE ];
+      fill( control, control + SEND_CONTROL_SIZE, 0 );
+      header.msg_control = control;
+      header.msg_controllen = SEND_CONTROL_SIZE;
+
+      cmsghdr * const segment_hdr = CMSG_FIRSTHDR( &header );
+      segment_hdr->cmsg_level = SOL_UDP;
+      segment_hdr->cmsg_type = UDP_SEGMENT;
+      segment_hdr->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+      *reinterpret_cast<uint16_t *>( CMSG_DATA( segment_hdr ) ) = segment_size;
+    }
+
+    first = end;
+  }
+
+  send_prepared( count );
+}
+
 /* mark the socket as listening for incoming connections */
 void TCPSocket::listen( const int backlog )
 {
@@ -197,8 +594,181 @@ void Socket::set_reuseaddr()
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int( true ) );
 }
 
+/* let several sockets bind the same address */
+void Socket::set_reuseport()
+{
+  setsockopt( SOL_SOCKET, SO_REUSEPORT, int( true ) );
+}
+
+/* tell the kernel which CPU will handle this socket's traffic */
+void Socket::set_incoming_cpu( const unsigned int cpu )
+{
+  setsockopt( SOL_SOCKET, SO_INCOMING_CPU, int( cpu ) );
+}
+
+/* pick the socket in the reuseport group by the receiving CPU */
+void Socket::steer_by_cpu( const unsigned int group_size )
+{
+  /* A = cpu; A %= group_size; return A */
+  sock_filter code[] = {
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t( SKF_AD_OFF + SKF_AD_CPU ) },
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+    { BPF_RET | BPF_A, 0, 0, 0 },
+  };
+  const sock_fprog program { sizeof( code ) / sizeof( code[ 0 ] ), code };
+
+  setsockopt( SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, program );
+}
+
 /* turn on timestamps on receipt */
 void UDPSocket::set_timestamps()
 {
   setsockopt( SOL_SOCKET, SO_TIMESTAMPNS, int( true ) );
 }
+
+/* turn on UDP segmentation offload in send_batch() */
+bool UDPSocket::enable_gso()
+{
+  /* (the option is there if the kernel can do it) */
+  int segment_size;
+  socklen_t len = sizeof( segment_size );
+  if ( getsockopt( fd_num(), SOL_UDP, UDP_SEGMENT, &segment_size, &len ) < 0 ) {
+    if ( errno == ENOPROTOOPT ) {
+      return false;
+    }
+    throw unix_error( "getsockopt" );
+  }
+
+  gso_ = true;
+  return true;
+}
+
+/* turn on UDP receive offload */
+bool UDPSocket::enable_gro()
+{
+  if ( recv_ring_ ) {
+    return false;
+  }
+
+  const int on = true;
+  if ( ::setsockopt( fd_num(), SOL_UDP, UDP_GRO, &on, sizeof( on ) ) < 0 ) {
+    if ( errno == ENOPROTOOPT ) {
+      return false;
+    }
+    throw unix_error( "setsockopt" );
+  }
+
+  gro_ = true;
+  return true;
+}
+
+/* number and size of the buffers provided for receiving */
+static const unsigned int RING_BUFFER_COUNT = 256;
+static const size_t RING_BUFFER_SIZE = 4096;
+
+/* move recv_batch() and send_batch() onto io_uring */
+bool UDPSocket::enable_io_uring()
+{
+  if ( recv_ring_ ) {
+    return true;
+  }
+
+  if ( gro_ or not IoUring::supported() ) {
+    return false;
+  }
+
+  recv_ring_.reset( new IoUring( 64 ) );
+  send_ring_.reset( new IoUring( 256 ) );
+  recv_ring_->register_buffer_ring( RING_BUFFER_COUNT, RING_BUFFER_SIZE );
+
+  /* each provided buffer holds the source address, the
+     ancillary data (timestamp) and then the payload */
+  zero( ring_recv_header_ );
+  ring_recv_header_.msg_namelen = sizeof( Address::raw );
+  ring_recv_header_.msg_controllen = CONTROL_SIZE;
+
+  ring_arm_receive();
+
+  return true;
+}
+
+/* what to poll for incoming datagrams */
+FileDescriptor & UDPSocket::receive_event_fd()
+{
+  if ( recv_ring_ ) {
+    return *recv_ring_;
+  }
+  return *this;
+}
+
+/* post the multishot receive */
+void UDPSocket::ring_arm_receive()
+{
+  io_uring_sqe & sqe = recv_ring_->next_sqe();
+  sqe.opcode = IORING_OP_RECVMSG;
+  sqe.fd = fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( &ring_recv_header_ );
+  sqe.len = 1;
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = IoUring::BUFFER_GROUP;
+
+  recv_ring_->submit();
+  ring_recv_armed_ = true;
+}
+
+/* collect up to max_n completed receives */
+template <class Deliver>
+void UDPSocket::ring_receive( const size_t max_n, Deliver && deliver )
+{
+  /* (one reading of the clocks puts the whole batch's timestamps on ours) */
+  realtime_offset_ = realtime_offset_ns();
+
+  /* (capturing only two pointers, the handler fits in the std::function without a heap allocation) */
+  recv_ring_->reap( [this, &deliver] ( const io_uring_cqe & cqe ) {
+      /* the multishot receive stops when it runs out of buffers (or on error) */
+      if ( not (cqe.flags & IORING_CQE_F_MORE) ) {
+	ring_recv_armed_ = false;
+      }
+
+      if ( cqe.res == -ENOBUFS ) {
+	return;
+      } else if ( cqe.res < 0 ) {
+	throw unix_error( "io_uring recvmsg", -cqe.res );
+      } else if ( not (cqe.flags & IORING_CQE_F_BUFFER) ) {
+	throw runtime_error( "io_uring recvmsg completed without a buffer" );
+      }
+
+      const uint16_t buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+      char * const buffer = recv_ring_->buffer( buffer_id );
+
+      const io_uring_recvmsg_out & out = *reinterpret_cast<io_uring_recvmsg_out *>( buffer );
+      char * const name = buffer + sizeof( out );
+      char * const control = name + ring_recv_header_.msg_namelen;
+      char * const payload = control + ring_recv_header_.msg_controllen;
+
+      /* look at the flags and timestamp as if recvmsg had returned them */
+      msghdr header;
+      zero( header );
+      header.msg_control = control;
+      header.msg_controllen = out.controllen;
+      header.msg_flags = out.flags;
+
+      if ( not received_whole( header ) ) {
+	recv_ring_->recycle_buffer( buffer_id );
+	return;
+      }
+
+      /* (GRO is never on with io_uring, so there is one datagram) */
+      deliver( Address( *reinterpret_cast<sockaddr *>( name ),
+			min( size_t( out.namelen ), sizeof( Address::raw ) ) ),
+	       parse_control( header, realtime_offset_ ).timestamp,
+	       payload, out.payloadlen );
+
+      recv_ring_->recycle_buffer( buffer_id );
+    }, max_n );
+
+  if ( not ring_recv_armed_ ) {
+    ring_arm_receive();
+  }
+}
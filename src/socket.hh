@@ -2,9 +2,15 @@
 #define SOCKET_HH
 
 #include <functional>
+#include <memory>
+#include <vector>
+
+#include <sys/socket.h>
 
 #include "address.hh"
 #include "file_descriptor.hh"
+#include "io_uring.hh"
+#include "packet_pool.hh"
 
 /* class for network sockets (UDP, TCP, etc.) */
 class Socket : public FileDescriptor
@@ -38,31 +44,196 @@ public:
 
   /* allow local address to be reused sooner, at the cost of some robustness */
   void set_reuseaddr();
+
+  /* let several sockets bind the same address, with the kernel
+     spreading incoming datagrams (or connections) among them */
+  void set_reuseport();
+
+  /* tell the kernel which CPU will handle this socket's traffic */
+  void set_incoming_cpu( const unsigned int cpu );
+
+  /* among the group_size sockets sharing this one's port (with
+     set_reuseport(), in the order they were bound), deliver each
+     datagram to the one whose index is the receiving CPU's number
+     modulo group_size (call after all of them are bound) */
+  void steer_by_cpu( const unsigned int group_size );
 };
 
 /* UDP socket */
 class UDPSocket : public Socket
 {
-public:
-  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ) {}
+private:
+  /* largest datagram we are prepared to receive (a path-MTU datagram,
+     with room to spare: any bigger is dropped and counted in truncated()) */
+  static const size_t RECEIVE_MTU = 2048;
+  static_assert( RECEIVE_MTU == PacketPool::BUFFER_SIZE,
+		 "a pooled buffer holds just the datagrams we are prepared to receive" );
+
+  /* room for the ancillary data (timestamp, GRO segment size) of one datagram */
+  static const size_t CONTROL_SIZE = 256;
+
+  /* most datagrams, and bytes, that GSO sends as one
+     (the kernel's UDP_MAX_SEGMENTS, and the largest UDP payload over IPv4) */
+  static const size_t MAX_GSO_SEGMENTS = 64;
+  static const size_t MAX_GSO_BYTES = 65507;
+
+  /* room for what GRO coalesces into one payload (a 64 KB IP packet) */
+  static const size_t GRO_RECEIVE_SIZE = 65536;
+
+  /* segmentation offload: send runs of equal-sized datagrams to one
+     destination as one, for the kernel (or NIC) to split up, and
+     receive datagrams the kernel coalesced as one, to split up here */
+  bool gso_;
+  bool gro_;
+
+  /* datagrams dropped for being too big to receive whole */
+  uint64_t truncated_;
 
+  /* realtime_offset_ns() when the latest batch was received, to put
+     its kernel timestamps on the clock of timestamp_us() */
+  uint64_t realtime_offset_;
+
+  /* scratch space reused by recv() and recv_batch() */
+  std::vector<char> batch_payloads_;
+  std::vector<char> batch_controls_;
+  std::vector<Address::raw> batch_addresses_;
+  std::vector<iovec> batch_iovecs_;
+  std::vector<mmsghdr> batch_headers_;
+
+  /* scratch space reused by send_batch() (with GSO, a segment size for each send) */
+  std::vector<iovec> send_iovecs_;
+  std::vector<mmsghdr> send_headers_;
+  std::vector<char> send_controls_;
+
+  /* send the first count prepared entries of send_headers_ */
+  void send_prepared( const size_t count );
+
+  /* receive into the first max_n entries of batch_iovecs_ (with
+     one system call, waiting only for the first datagram);
+     returns how many were received */
+  size_t receive_prepared( const size_t max_n );
+
+  /* did we get the whole datagram? (if not, it is counted, to be dropped) */
+  bool received_whole( const msghdr & header );
+
+  /* grow the scratch space if this batch is bigger than any before
+     (with room for the payloads only if they are received there) */
+  void reserve_batch( const size_t max_n, const bool payloads );
+
+  /* point the first max_n entries of batch_iovecs_ at the scratch payloads */
+  void prepare_scratch_payloads( const size_t max_n );
+
+  /* room for each payload in the scratch space */
+  size_t receive_size() const { return gro_ ? GRO_RECEIVE_SIZE : RECEIVE_MTU; }
+
+public:
   struct received_datagram {
     Address source_address;
-    uint64_t timestamp;
+    uint64_t timestamp; /* in microseconds, by timestamp_us() */
     std::string payload;
   };
 
-  /* receive datagram, timestamp, and where it came from */
+  /* a datagram received into a buffer from a PacketPool */
+  struct received_packet {
+    Address source_address;
+    uint64_t timestamp; /* in microseconds, by timestamp_us() */
+    PacketBuffer buffer;
+  };
+
+private:
+  /* io_uring engine (if enabled): a multishot receive stays posted
+     on provided buffers, and sends are submitted as SQEs. Receives and
+     sends complete on separate rings, so the receive ring is readable
+     exactly when received datagrams are waiting. */
+  std::unique_ptr<IoUring> recv_ring_;
+  std::unique_ptr<IoUring> send_ring_;
+  msghdr ring_recv_header_; /* layout of each provided receive buffer */
+  bool ring_recv_armed_;
+
+  void ring_arm_receive();
+
+  /* collect up to max_n completed receives, handing each to
+     deliver( source address, timestamp, payload, length ) */
+  template <class Deliver>
+  void ring_receive( const size_t max_n, Deliver && deliver );
+
+public:
+  UDPSocket()
+    : Socket( AF_INET6, SOCK_DGRAM ),
+      gso_( false ), gro_( false ), truncated_( 0 ), realtime_offset_( 0 ),
+      batch_payloads_(), batch_controls_(), batch_addresses_(),
+      batch_iovecs_(), batch_headers_(),
+      send_iovecs_(), send_headers_(), send_controls_(),
+      recv_ring_(), send_ring_(), ring_recv_header_(), ring_recv_armed_( false )
+  {}
+
+  /* receive datagram, timestamp, and where it came from
+     (not with GRO: use recv_batch(), which hands out every datagram
+     of a coalesced buffer at once) */
   received_datagram recv();
 
+  /* receive up to max_n datagrams with one system call
+     (blocks until at least one datagram is available;
+     with GRO, each may split into several). A datagram too big
+     to receive whole is dropped and counted in truncated(), so a
+     batch can come back empty. */
+  std::vector<received_datagram> recv_batch( const size_t max_n );
+
+  /* the same, into buffers from pool, replacing what was in packets
+     (whose buffers go back to the pool first): once packets has grown
+     to the batch size, this never touches the heap. Without GRO or
+     io_uring, the kernel copies each datagram straight into a buffer. */
+  void recv_batch( const size_t max_n, PacketPool & pool, std::vector<received_packet> & packets );
+
+  /* datagrams dropped so far for being too big to receive whole */
+  uint64_t truncated() const { return truncated_; }
+
   /* send datagram to specified address */
   void sendto( const Address & peer, const std::string & payload );
 
   /* send datagram to connected address */
   void send( const std::string & payload );
 
+  /* outgoing datagram gathered from a header and a body,
+     neither of which is copied before it reaches the kernel */
+  struct gathered_datagram {
+    const char * header;
+    size_t header_length;
+    const char * body;
+    size_t body_length;
+    const Address * destination; /* nullptr for the connected address */
+  };
+
+  /* send several datagrams to connected address with one system call */
+  void send_batch( const std::vector<std::string> & payloads );
+
+  /* send several gathered datagrams (each to its own destination) with one system call
+     (with GSO, each run of datagrams to one destination that are all the same
+     size, but for a shorter last one, goes down the network stack as one) */
+  void send_batch( const std::vector<gathered_datagram> & datagrams );
+
   /* turn on timestamps on receipt */
   void set_timestamps();
+
+  /* turn on UDP segmentation offload (UDP_SEGMENT) in send_batch()
+     (returns false if the kernel can't; each datagram must still
+     fit the path MTU, as the kernel won't fragment segments) */
+  bool enable_gso();
+
+  /* turn on UDP receive offload (UDP_GRO), splitting what the kernel
+     coalesced back into datagrams (returns false if the kernel can't,
+     or if the socket uses io_uring, whose buffers are too small).
+     Only recv_batch() can receive then: recv() would have to keep the
+     rest of a coalesced buffer where no Poller could see it. */
+  bool enable_gro();
+
+  /* move recv_batch() and send_batch() onto io_uring
+     (returns false, leaving the socket as it was, if the kernel
+     can't, or if GRO is on) */
+  bool enable_io_uring();
+
+  /* what to poll for incoming datagrams: the socket itself, or its io_uring */
+  FileDescriptor & receive_event_fd();
 };
 
 /* TCP socket */
@@ -0,0 +1,256 @@
+#include <stdexcept>
+
+#include "timer_wheel.hh"
+
+using namespace std;
+
+const uint32_t TimerWheel::NONE;
+
+/* start the wheel at time now (in ticks) */
+TimerWheel::TimerWheel( const uint64_t now )
+  : now_( now ),
+    timers_(),
+    free_timers_(),
+    list_heads_( LIST_COUNT, NONE ),
+    occupied_( LEVELS * SLOTS / 64 ),
+    level_counts_( LEVELS ),
+    pending_count_( 0 )
+{}
+
+/* does this id name a timer that hasn't been cancelled? */
+bool TimerWheel::valid( const TimerId id ) const
+{
+  const uint32_t index = id;
+  return index < timers_.size()
+    and timers_[ index ].allocated
+    and timers_[ index ].generation == (id >> 32);
+}
+
+TimerWheel::Timer & TimerWheel::lookup( const TimerId id )
+{
+  if ( not valid( id ) ) {
+    throw runtime_error( "TimerWheel: invalid timer" );
+  }
+
+  return timers_[ uint32_t( id ) ];
+}
+
+/* is this timer waiting to expire? */
+bool TimerWheel::pending( const TimerId id ) const
+{
+  return const_cast<TimerWheel *>( this )->lookup( id ).list != NONE;
+}
+
+void TimerWheel::link( const uint32_t index, const uint32_t list )
+{
+  Timer & timer = timers_[ index ];
+  timer.list = list;
+  timer.prev = NONE;
+  timer.next = list_heads_[ list ];
+  if ( timer.next != NONE ) {
+    timers_[ timer.next ].prev = index;
+  }
+  list_heads_[ list ] = index;
+
+  if ( list < OVERFLOW_LIST ) {
+    occupied_[ list / 64 ] |= uint64_t( 1 ) << (list % 64);
+    level_counts_[ list / SLOTS ]++;
+  }
+
+  pending_count_++;
+}
+
+void TimerWheel::unlink( const uint32_t index )
+{
+  Timer & timer = timers_[ index ];
+  const uint32_t list = timer.list;
+
+  if ( timer.prev != NONE ) {
+    timers_[ timer.prev ].next = timer.next;
+  } else {
+    list_heads_[ list ] = timer.next;
+  }
+  if ( timer.next != NONE ) {
+    timers_[ timer.next ].prev = timer.prev;
+  }
+  timer.list = NONE;
+
+  if ( list < OVERFLOW_LIST ) {
+    if ( list_heads_[ list ] == NONE ) {
+      occupied_[ list / 64 ] &= ~(uint64_t( 1 ) << (list % 64));
+    }
+    level_counts_[ list / SLOTS ]--;
+  }
+
+  pending_count_--;
+}
+
+/* put a pending timer on the list its deadline belongs to */
+void TimerWheel::place( const uint32_t index )
+{
+  const uint64_t deadline = timers_[ index ].deadline;
+
+  if ( deadline <= now_ ) {
+    link( index, DUE_LIST );
+    return;
+  }
+
+  /* the level is set by the most significant group of bits
+     in which the deadline differs from the current time */
+  const unsigned int level = (63 - __builtin_clzll( deadline ^ now_ )) / SLOT_BITS;
+  if ( level >= LEVELS ) {
+    link( index, OVERFLOW_LIST );
+    return;
+  }
+
+  const unsigned int slot = (deadline >> (level * SLOT_BITS)) & (SLOTS - 1);
+  link( index, level * SLOTS + slot );
+}
+
+/* re-place every timer on a list */
+void TimerWheel::cascade( const uint32_t list )
+{
+  /* (a timer in the overflow list may go right back to it) */
+  uint32_t index = list_heads_[ list ];
+  while ( index != NONE ) {
+    const uint32_t next = timers_[ index ].next;
+    unlink( index );
+    place( index );
+    index = next;
+  }
+}
+
+/* first occupied slot of level at or after slot (or SLOTS if none) */
+unsigned int TimerWheel::next_occupied( const unsigned int level, const unsigned int slot ) const
+{
+  for ( unsigned int s = slot; s < SLOTS; s = (s | 63) + 1 ) {
+    const uint32_t list = level * SLOTS + s;
+    const uint64_t word = occupied_[ list / 64 ] >> (list % 64);
+    if ( word ) {
+      return s + __builtin_ctzll( word );
+    }
+  }
+
+  return SLOTS;
+}
+
+/* earliest time at which a pending timer may expire */
+uint64_t TimerWheel::next_expiry() const
+{
+  if ( list_heads_[ DUE_LIST ] != NONE ) {
+    return now_;
+  }
+
+  /* the first occupied slot of the lowest non-empty level is where
+     the next timer expires (level 0) or cascades (higher levels) */
+  for ( unsigned int level = 0; level < LEVELS; level++ ) {
+    if ( level_counts_[ level ] == 0 ) {
+      continue;
+    }
+
+    const unsigned int shift = level * SLOT_BITS;
+    const unsigned int slot = next_occupied( level, ((now_ >> shift) & (SLOTS - 1)) + 1 );
+    const uint64_t block_start = (now_ >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+
+    if ( slot < SLOTS ) {
+      return block_start | (uint64_t( slot ) << shift);
+    }
+
+    return block_start + (uint64_t( 1 ) << (shift + SLOT_BITS));
+  }
+
+  if ( list_heads_[ OVERFLOW_LIST ] != NONE ) {
+    return ((now_ >> (LEVELS * SLOT_BITS)) + 1) << (LEVELS * SLOT_BITS);
+  }
+
+  return uint64_t( -1 );
+}
+
+/* add a timer that expires at deadline (in ticks) */
+TimerWheel::TimerId TimerWheel::add( const uint64_t deadline )
+{
+  uint32_t index;
+  if ( free_timers_.empty() ) {
+    index = timers_.size();
+    timers_.push_back( { 0, 0, NONE, NONE, NONE, false } );
+  } else {
+    index = free_timers_.back();
+    free_timers_.pop_back();
+  }
+
+  Timer & timer = timers_[ index ];
+  timer.allocated = true;
+  timer.deadline = deadline;
+  place( index );
+
+  return (uint64_t( timer.generation ) << 32) | index;
+}
+
+/* move a timer (pending or already expired) to a new deadline */
+void TimerWheel::rearm( const TimerId id, const uint64_t deadline )
+{
+  Timer & timer = lookup( id );
+  const uint32_t index = id;
+
+  if ( timer.list != NONE ) {
+    unlink( index );
+  }
+
+  timer.deadline = deadline;
+  place( index );
+}
+
+/* release a timer (pending or already expired) */
+void TimerWheel::cancel( const TimerId id )
+{
+  Timer & timer = lookup( id );
+  const uint32_t index = id;
+
+  if ( timer.list != NONE ) {
+    unlink( index );
+  }
+
+  timer.allocated = false;
+  timer.generation++;
+  free_timers_.push_back( index );
+}
+
+/* advance the clock to now, appending the timers that expired */
+void TimerWheel::advance( const uint64_t now, vector<TimerId> & expired )
+{
+  auto expire = [&] ( const uint32_t list ) {
+    while ( list_heads_[ list ] != NONE ) {
+      const uint32_t index = list_heads_[ list ];
+      unlink( index );
+      expired.push_back( (uint64_t( timers_[ index ].generation ) << 32) | index );
+    }
+  };
+
+  expire( DUE_LIST );
+
+  /* jump from one event (an expiry or a cascade) to the next */
+  while ( true ) {
+    const uint64_t next = next_expiry();
+    if ( next > now or next == now_ ) {
+      break;
+    }
+
+    now_ = next;
+
+    /* cascade the slots that start now, from the top level down */
+    if ( (now_ & ((uint64_t( 1 ) << (LEVELS * SLOT_BITS)) - 1)) == 0 ) {
+      cascade( OVERFLOW_LIST );
+    }
+    for ( unsigned int level = LEVELS - 1; level > 0; level-- ) {
+      const unsigned int shift = level * SLOT_BITS;
+      if ( (now_ & ((uint64_t( 1 ) << shift) - 1)) == 0 ) {
+	cascade( level * SLOTS + ((now_ >> shift) & (SLOTS - 1)) );
+      }
+    }
+
+    expire( DUE_LIST );
+    expire( now_ & (SLOTS - 1) );
+  }
+
+  now_ = max( now_, now );
+}
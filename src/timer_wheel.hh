@@ -0,0 +1,93 @@
+#ifndef TIMER_WHEEL_HH
+#define TIMER_WHEEL_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Hierarchical timer wheel: LEVELS wheels of SLOTS slots each, where
+   a slot at level L spans SLOTS^L ticks. Adding, cancelling and
+   rearming a timer are O(1); advancing the clock does bounded work
+   per level plus O(1) amortized per timer, however far it jumps. */
+class TimerWheel
+{
+public:
+  typedef uint64_t TimerId;
+
+private:
+  static const unsigned int SLOT_BITS = 8;
+  static const unsigned int SLOTS = 1 << SLOT_BITS;
+  static const unsigned int LEVELS = 4;
+
+  /* lists a timer can be on */
+  static const uint32_t OVERFLOW_LIST = LEVELS * SLOTS; /* beyond the top level */
+  static const uint32_t DUE_LIST = OVERFLOW_LIST + 1; /* deadline already passed */
+  static const uint32_t LIST_COUNT = DUE_LIST + 1;
+  static const uint32_t NONE = uint32_t( -1 );
+
+  struct Timer
+  {
+    uint64_t deadline;
+    uint32_t generation; /* tells a reused slot apart from a released timer */
+    uint32_t list; /* NONE if not pending */
+    uint32_t prev, next; /* intrusive list links */
+    bool allocated;
+  };
+
+  uint64_t now_; /* in ticks */
+
+  std::vector<Timer> timers_;
+  std::vector<uint32_t> free_timers_;
+  std::vector<uint32_t> list_heads_;
+
+  /* which slots of each level are occupied */
+  std::vector<uint64_t> occupied_;
+  std::vector<unsigned int> level_counts_;
+  size_t pending_count_;
+
+  Timer & lookup( const TimerId id );
+
+  void link( const uint32_t index, const uint32_t list );
+  void unlink( const uint32_t index );
+
+  /* put a pending timer on the list its deadline belongs to */
+  void place( const uint32_t index );
+
+  /* re-place every timer on a list */
+  void cascade( const uint32_t list );
+
+  /* first occupied slot of level at or after slot (or SLOTS if none) */
+  unsigned int next_occupied( const unsigned int level, const unsigned int slot ) const;
+
+public:
+  /* start the wheel at time now (in ticks) */
+  TimerWheel( const uint64_t now );
+
+  /* add a timer that expires at deadline (in ticks) */
+  TimerId add( const uint64_t deadline );
+
+  /* move a timer (pending or already expired) to a new deadline */
+  void rearm( const TimerId id, const uint64_t deadline );
+
+  /* release a timer (pending or already expired); its id becomes invalid */
+  void cancel( const TimerId id );
+
+  /* does this id name a timer that hasn't been cancelled? */
+  bool valid( const TimerId id ) const;
+
+  /* is this timer waiting to expire? */
+  bool pending( const TimerId id ) const;
+
+  /* advance the clock to now, appending the timers that expired
+     (they stay allocated until cancelled, so they can be rearmed) */
+  void advance( const uint64_t now, std::vector<TimerId> & expired );
+
+  /* earliest time at which a pending timer may expire (or uint64_t( -1 ) if none) */
+  uint64_t next_expiry() const;
+
+  /* number of pending timers */
+  size_t size() const { return pending_count_; }
+  bool empty() const { return pending_count_ == 0; }
+};
+
+#endif /* TIMER_WHEEL_HH */
@@ -1,36 +1,208 @@
 #include <ctime>
 
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
 #include "timestamp.hh"
 #include "util.hh"
 
+/* nanoseconds per microsecond */
+static const uint64_t THOUSAND = 1000;
+
 /* nanoseconds per millisecond */
-static const uint64_t MILLION = 1000000;
+static const uint64_t MILLION = 1000 * THOUSAND;
 
 /* nanoseconds per second */
 static const uint64_t BILLION = 1000 * MILLION;
 
 /* helper functions */
-static timespec current_time()
+static uint64_t current_time_ns( const clockid_t clock )
 {
-  timespec ret;
-  SystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &ret ) );
-  return ret;
+  timespec ts;
+  SystemCall( "clock_gettime", clock_gettime( clock, &ts ) );
+  return ts.tv_sec * BILLION + ts.tv_nsec;
 }
 
-static uint64_t timestamp_ms_raw( const timespec & ts )
+/* the TSC clock: CLOCK_MONOTONIC extrapolated from the last
+   calibration point at the rate measured since the first one */
+struct TscCalibration
+{
+  bool valid;
+
+  uint64_t origin_tsc, origin_ns; /* first calibration point */
+  uint64_t anchor_tsc, anchor_ns; /* latest calibration point */
+  double ns_per_tick;
+
+  uint64_t next_calibration_tsc;
+  uint64_t last_ns; /* keeps the clock from running backwards across calibrations */
+};
+
+static bool fast_clock = false;
+
+/* when the program started, by CLOCK_MONOTONIC */
+static uint64_t epoch_ns()
 {
-  const uint64_t nanos = ts.tv_sec * BILLION + ts.tv_nsec;
-  return nanos / MILLION;
+  const static uint64_t EPOCH = current_time_ns( CLOCK_MONOTONIC );
+  return EPOCH;
+}
+
+#ifdef HAVE_TSC
+
+/* recalibrate about this often */
+static const uint64_t CALIBRATION_INTERVAL_NS = BILLION;
+
+/* calibration shared by every thread to start from */
+static TscCalibration initial_calibration;
+
+/* each thread recalibrates its own copy, so no locking is needed */
+static thread_local TscCalibration calibration;
+
+/* read CLOCK_MONOTONIC and the TSC at (nearly) the same moment */
+static void tsc_sample( uint64_t & tsc, uint64_t & ns )
+{
+  const uint64_t before = __rdtsc();
+  ns = current_time_ns( CLOCK_MONOTONIC );
+  const uint64_t after = __rdtsc();
+  tsc = before + (after - before) / 2;
+}
+
+static void recalibrate( TscCalibration & c, const uint64_t tsc, const uint64_t ns )
+{
+  c.ns_per_tick = double( ns - c.origin_ns ) / double( tsc - c.origin_tsc );
+  c.anchor_tsc = tsc;
+  c.anchor_ns = ns;
+  c.next_calibration_tsc = tsc + uint64_t( CALIBRATION_INTERVAL_NS / c.ns_per_tick );
+}
+
+static uint64_t tsc_time_ns()
+{
+  TscCalibration & c = calibration;
+  if ( not c.valid ) {
+    c = initial_calibration;
+  }
+
+  uint64_t tsc = __rdtsc();
+  if ( tsc >= c.next_calibration_tsc ) {
+    uint64_t ns;
+    tsc_sample( tsc, ns );
+    recalibrate( c, tsc, ns );
+  }
+
+  uint64_t ns = c.anchor_ns;
+  if ( tsc > c.anchor_tsc ) {
+    ns += uint64_t( (tsc - c.anchor_tsc) * c.ns_per_tick );
+  }
+
+  if ( ns < c.last_ns ) {
+    return c.last_ns;
+  }
+  c.last_ns = ns;
+  return ns;
+}
+
+/* does the TSC tick at a constant rate, even in deep C-states? */
+static bool invariant_tsc()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if ( not __get_cpuid( 0x80000000, &eax, &ebx, &ecx, &edx ) or eax < 0x80000007 ) {
+    return false;
+  }
+
+  __get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx );
+  return edx & (1 << 8);
+}
+
+bool enable_fast_clock()
+{
+  if ( fast_clock ) {
+    return true;
+  }
+
+  if ( not invariant_tsc() ) {
+    return false;
+  }
+
+  /* start the program's clock before the TSC clock */
+  epoch_ns();
+
+  /* measure the TSC rate over a few milliseconds to start with */
+  TscCalibration & c = initial_calibration;
+  c = TscCalibration();
+  tsc_sample( c.origin_tsc, c.origin_ns );
+
+  uint64_t tsc, ns;
+  do {
+    tsc_sample( tsc, ns );
+  } while ( ns - c.origin_ns < 5 * MILLION );
+
+  recalibrate( c, tsc, ns );
+  c.last_ns = ns;
+  c.valid = true;
+
+  fast_clock = true;
+  return true;
+}
+
+#else
+
+bool enable_fast_clock()
+{
+  return false;
+}
+
+#endif /* HAVE_TSC */
+
+bool fast_clock_enabled()
+{
+  return fast_clock;
+}
+
+static uint64_t monotonic_ns()
+{
+#ifdef HAVE_TSC
+  if ( fast_clock ) {
+    return tsc_time_ns();
+  }
+#endif
+
+  return current_time_ns( CLOCK_MONOTONIC );
+}
+
+/* Current time since the start of the program */
+uint64_t timestamp_ns()
+{
+  /* (the TSC clock may trail CLOCK_MONOTONIC by a hair) */
+  const uint64_t now = monotonic_ns();
+  const uint64_t epoch = epoch_ns();
+  return now > epoch ? now - epoch : 0;
+}
+
+uint64_t timestamp_us()
+{
+  return timestamp_ns() / THOUSAND;
 }
 
-/* Current time in milliseconds since the start of the program */
 uint64_t timestamp_ms()
 {
-  return timestamp_ms( current_time() );
+  return timestamp_ns() / MILLION;
+}
+
+/* How far CLOCK_REALTIME is ahead of the clock above, now
+   (read afresh each time, so a wall-clock step only skews
+   times converted with an offset read around the step itself) */
+uint64_t realtime_offset_ns()
+{
+  const uint64_t realtime_now = current_time_ns( CLOCK_REALTIME );
+  const uint64_t monotonic_now = timestamp_ns();
+  return realtime_now > monotonic_now ? realtime_now - monotonic_now : 0;
 }
 
-uint64_t timestamp_ms( const timespec & ts )
+/* A CLOCK_REALTIME time on the same clock, in nanoseconds */
+uint64_t timestamp_ns( const timespec & realtime, const uint64_t realtime_offset )
 {
-  const static uint64_t EPOCH = timestamp_ms_raw( current_time() );
-  return timestamp_ms_raw( ts ) - EPOCH;
+  const uint64_t then = realtime.tv_sec * BILLION + realtime.tv_nsec;
+  return then > realtime_offset ? then - realtime_offset : 0;
 }
@@ -4,8 +4,28 @@
 #include <ctime>
 #include <cstdint>
 
-/* Current time in milliseconds since the start of the program */
+/* Current time since the start of the program (on CLOCK_MONOTONIC,
+   so it never jumps when the wall clock is set) */
+uint64_t timestamp_ns();
+uint64_t timestamp_us();
 uint64_t timestamp_ms();
-uint64_t timestamp_ms( const timespec & ts );
+
+/* How far CLOCK_REALTIME is ahead of the clock above, now (in
+   nanoseconds): read it once (say, per batch of datagrams received),
+   then put each CLOCK_REALTIME time taken around then (such as a
+   kernel receive timestamp from SO_TIMESTAMPNS) on the same clock
+   with just a subtraction */
+uint64_t realtime_offset_ns();
+uint64_t timestamp_ns( const timespec & realtime, const uint64_t realtime_offset );
+
+/* Opt in to reading the clock above from the CPU's invariant TSC,
+   calibrated against CLOCK_MONOTONIC now and about once a second after
+   that, instead of calling clock_gettime(). Returns false (and keeps
+   using clock_gettime) if the CPU has no invariant TSC. Call before
+   starting any threads. */
+bool enable_fast_clock();
+
+/* is the TSC clock in use? */
+bool fast_clock_enabled();
 
 #endif /* TIMESTAMP_HH */
@@ -1,10 +1,13 @@
 #ifndef UTIL_HH
 #define UTIL_HH
 
+#include <pthread.h>
+#include <sched.h>
 #include <system_error>
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <vector>
 
 /* tagged_error: system_error + name of what was being attempted */
 class tagged_error : public std::system_error
@@ -58,6 +61,36 @@ inline int SystemCall( const std::string & s_attempt, const int return_value )
   return SystemCall( s_attempt.c_str(), return_value );
 }
 
+/* run the calling thread only on the given CPU */
+inline void pin_thread_to_cpu( const unsigned int cpu )
+{
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  CPU_SET( cpu, &cpus );
+
+  const int error = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+  if ( error ) {
+    throw unix_error( "pthread_setaffinity_np", error );
+  }
+}
+
+/* the CPUs the calling thread may run on (which a cpuset or taskset
+   may have narrowed to other than 0 to N - 1), lowest first */
+inline std::vector<unsigned int> allowed_cpus()
+{
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  SystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( cpus ), &cpus ) );
+
+  std::vector<unsigned int> ret;
+  for ( unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++ ) {
+    if ( CPU_ISSET( cpu, &cpus ) ) {
+      ret.push_back( cpu );
+    }
+  }
+  return ret;
+}
+
 /* zero out an arbitrary structure */
 template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
 
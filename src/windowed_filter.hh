@@ -0,0 +1,108 @@
+#ifndef WINDOWED_FILTER_HH
+#define WINDOWED_FILTER_HH
+
+#include <cstdint>
+#include <functional>
+
+/* Running min or max of the samples seen over a sliding time window,
+   by Kathleen Nichols' algorithm (as in Linux's lib/win_minmax.c): it
+   keeps the best, second-best and third-best samples from successive
+   quarters of the window, so each update is O(1) in time and memory,
+   however many samples the window holds. The result can briefly be a
+   sample up to a quarter window older than the window. */
+template <typename T, class Better>
+class WindowedFilter
+{
+private:
+  struct Sample
+  {
+    T value;
+    uint64_t time;
+  };
+
+  /* best, second-best and third-best samples */
+  Sample samples_[ 3 ];
+  bool empty_;
+
+  static bool at_least_as_good( const T & a, const T & b ) { return not Better()( b, a ); }
+
+  /* age out the best samples as the window slides */
+  const T & age( const Sample & sample, const uint64_t window )
+  {
+    const uint64_t age = sample.time - samples_[ 0 ].time;
+
+    if ( age > window ) {
+      /* the best sample has expired: promote the others, and
+         if the second-best has also expired, promote again */
+      samples_[ 0 ] = samples_[ 1 ];
+      samples_[ 1 ] = samples_[ 2 ];
+      samples_[ 2 ] = sample;
+      if ( sample.time - samples_[ 0 ].time > window ) {
+	samples_[ 0 ] = samples_[ 1 ];
+	samples_[ 1 ] = samples_[ 2 ];
+	samples_[ 2 ] = sample;
+      }
+    } else if ( samples_[ 1 ].time == samples_[ 0 ].time and age > window / 4 ) {
+      /* a quarter window has passed without a second-best sample:
+	 take one from the rest of the window */
+      samples_[ 1 ] = samples_[ 2 ] = sample;
+    } else if ( samples_[ 2 ].time == samples_[ 1 ].time and age > window / 2 ) {
+      /* half a window has passed without a third-best sample:
+	 take one from the rest of the window */
+      samples_[ 2 ] = sample;
+    }
+
+    return samples_[ 0 ].value;
+  }
+
+public:
+  WindowedFilter()
+    : samples_(), empty_( true )
+  {}
+
+  /* forget every sample but this one */
+  const T & reset( const T & value, const uint64_t time )
+  {
+    samples_[ 0 ] = samples_[ 1 ] = samples_[ 2 ] = { value, time };
+    empty_ = false;
+    return samples_[ 0 ].value;
+  }
+
+  /* add a sample taken at time (no earlier than the previous one),
+     and return the best sample within window of it */
+  const T & update( const T & value, const uint64_t time, const uint64_t window )
+  {
+    const Sample sample = { value, time };
+
+    if ( empty_
+	 or at_least_as_good( value, samples_[ 0 ].value )
+	 or time - samples_[ 2 ].time > window ) {
+      /* a new best sample, or nothing left in the window */
+      return reset( value, time );
+    }
+
+    if ( at_least_as_good( value, samples_[ 1 ].value ) ) {
+      samples_[ 1 ] = samples_[ 2 ] = sample;
+    } else if ( at_least_as_good( value, samples_[ 2 ].value ) ) {
+      samples_[ 2 ] = sample;
+    }
+
+    return age( sample, window );
+  }
+
+  /* best sample in the window as of the last update */
+  const T & best() const { return samples_[ 0 ].value; }
+
+  /* when the best sample was taken */
+  uint64_t best_time() const { return samples_[ 0 ].time; }
+
+  bool empty() const { return empty_; }
+};
+
+template <typename T>
+using WindowedMinFilter = WindowedFilter< T, std::less< T > >;
+
+template <typename T>
+using WindowedMaxFilter = WindowedFilter< T, std::greater< T > >;
+
+#endif /* WINDOWED_FILTER_HH */